@@ -7,6 +7,9 @@ fi
 
 mkdir -p bin
 
+# With AddressSanitizer, values, scopes, and environments are allocated with malloc rather than from pools, so that it sees use-after-frees of them (see "flamingo/pool.h").
+# So that the pools, which is what builds without it use, are tested too, another binary is built with -DFLAMINGO_FORCE_POOL for "tests.sh" to run the tests with as well.
+
 debugging="-fsanitize=address,undefined -fno-omit-frame-pointer -g -O0"
 cc_flags="$debugging -std=c11 -Wall -Wextra -Werror -Iflamingo/runtime -Wno-unused-parameter"
 
@@ -17,4 +20,12 @@ cc_flags="$debugging -std=c11 -Wall -Wextra -Werror -Iflamingo/runtime -Wno-unus
 $CC $cc_flags -ferror-limit=0 -c flamingo/flamingo.c -o bin/flamingo.o
 $CC $cc_flags -c main.c -o bin/main.o
 
-$CC $(find bin -name "*.o") -lm $cc_flags -o bin/flamingo
+$CC bin/flamingo.o bin/main.o -lm $cc_flags -o bin/flamingo
+
+$CC $cc_flags -DFLAMINGO_FORCE_POOL -ferror-limit=0 -c flamingo/flamingo.c -o bin/flamingo-pool.o
+$CC bin/flamingo-pool.o bin/main.o -lm $cc_flags -o bin/flamingo-pool
+
+# Program which runs many instances of one program concurrently, which "tests.sh" runs too (see "tests/programs/main.c").
+
+$CC $cc_flags -c tests/programs/main.c -o bin/programs.o
+$CC bin/flamingo.o bin/programs.o -lm -lpthread $cc_flags -o bin/programs
@@ -0,0 +1,392 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Lowered abstract syntax tree.
+ *
+ * Right after parsing, the Tree-sitter tree is lowered into a flat array of typed nodes (see 'lower.h'), which is what the interpreter actually walks.
+ * Node kinds are plain enums, children are referred to by their index in the node array, and literals are decoded ahead of time, so that evaluating a node never has to go through Tree-sitter's string-based node API.
+ *
+ * Index 0 is always the null node, which is used for optional children which aren't there (e.g. a return statement without a return value).
+ * Variable-length children (block statements, arguments, vector elements, &c) are stored as a contiguous run of node indices in {@link flamingo_ast_t#lists}.
+ *
+ * String literals with the same contents share a single entry in the AST's constant table ({@link flamingo_ast_t#consts}), whose value is only created the first time one of them is evaluated.
+ * Identifiers are interned into the same table, so that each name is only made into a symbol once.
+ * These values and symbols are cached by each instance running the AST rather than in the AST itself, so that the AST is never modified once lowered and resolved.
+ *
+ * Each function, class, and lambda also gets a call descriptor ({@link flamingo_ast_t#call_descs}) with everything calling it needs to know about its parameters and body, so that calls don't have to go through its parameter list.
+ * Descriptor 0 is always that of a callable without any parameters.
+ */
+
+#pragma once
+
+#include "flamingo.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define AST_NULL ((flamingo_node_t) 0)
+#define AST_UNRESOLVED UINT32_MAX
+
+typedef struct vm_code_t vm_code_t;
+
+typedef enum {
+	AST_KIND_NULL,
+
+	// A node which couldn't be lowered (e.g. an ERROR node or an unexpected child).
+	// Errors are only raised when the node is actually evaluated, as that's when the tree-walker would've noticed them.
+
+	AST_KIND_INVALID,
+
+	// Statements.
+
+	AST_KIND_SOURCE_FILE,
+	AST_KIND_BLOCK,
+	AST_KIND_FUNCTION_DECLARATION,
+	AST_KIND_IF_CHAIN,
+	AST_KIND_FOR_LOOP,
+	AST_KIND_BREAK,
+	AST_KIND_CONTINUE,
+	AST_KIND_PRINT,
+	AST_KIND_RETURN,
+	AST_KIND_ASSERT,
+	AST_KIND_VAR_DECL,
+	AST_KIND_ASSIGNMENT,
+	AST_KIND_IMPORT,
+	AST_KIND_EXPR_STATEMENT,
+
+	// Expressions.
+
+	AST_KIND_LITERAL,
+	AST_KIND_IDENTIFIER,
+	AST_KIND_SELF,
+	AST_KIND_LAMBDA,
+	AST_KIND_VEC,
+	AST_KIND_MAP,
+	AST_KIND_CALL,
+	AST_KIND_UNARY_EXPR,
+	AST_KIND_BINARY_EXPR,
+	AST_KIND_ACCESS,
+	AST_KIND_INDEX,
+
+	// Miscellaneous.
+
+	AST_KIND_PARAM_LIST,
+	AST_KIND_PARAM,
+} ast_kind_t;
+
+typedef enum {
+	AST_LITERAL_NONE,
+	AST_LITERAL_BOOL,
+	AST_LITERAL_INT,
+	AST_LITERAL_STR,
+} ast_literal_kind_t;
+
+// Operators of unary and binary expressions, decoded when lowering.
+
+typedef enum {
+	AST_OP_UNKNOWN, // Any operator the interpreter doesn't know about, which is only an error once the expression is evaluated.
+
+	// Arithmetic.
+
+	AST_OP_ADD,
+	AST_OP_SUB,
+	AST_OP_MUL,
+	AST_OP_DIV,
+	AST_OP_MOD,
+	AST_OP_POW,
+	AST_OP_NEG, // Unary.
+
+	// Comparisons.
+
+	AST_OP_EQ,
+	AST_OP_NE,
+	AST_OP_LT,
+	AST_OP_LE,
+	AST_OP_GT,
+	AST_OP_GE,
+
+	// Logic.
+
+	AST_OP_AND,
+	AST_OP_OR,
+	AST_OP_XOR,
+	AST_OP_NOT, // Unary.
+} ast_op_t;
+
+// An interned string constant, which is the contents of one or more string literals or identifiers.
+
+typedef struct {
+	uint32_t start;
+	uint32_t size;
+} ast_const_t;
+
+// What an instance caches about a constant as it runs.
+// Both are tied to the instance's pool, so unlike the AST itself, these can't be shared between instances running the same program (see 'program.h').
+
+struct flamingo_const_cache_t {
+	// The shared value of the constant, or NULL if none of its literals have been evaluated yet.
+	// It must never be modified in-place.
+
+	flamingo_val_t* val;
+
+	// The symbol of the constant, or NULL if none of its identifiers have been looked up yet (see 'symbol_of').
+
+	char* symbol;
+};
+
+// A run of node indices in 'flamingo_ast_t.lists'.
+
+typedef struct {
+	uint32_t first;
+	uint32_t count;
+} ast_list_t;
+
+// What's needed to bind a callable's arguments to its parameters and run it (see 'call.h').
+
+typedef struct {
+	// Identifier nodes of the parameters, in order.
+	// The count of this is the callable's arity.
+
+	ast_list_t params;
+
+	// Set if the body is an expression rather than a block (which only lambdas can have).
+
+	bool expr_body;
+
+	// How many levels of expressions and statements deep the body goes, not counting those of callables declared within it.
+	// The tree-walker nests C calls for each of these, so it counts deeply nested bodies as deeper calls (see 'call.h').
+
+	uint32_t nesting;
+} ast_call_desc_t;
+
+typedef struct {
+	ast_kind_t kind;
+
+	// Source span of the node, in bytes.
+
+	uint32_t start;
+	uint32_t end;
+
+	// All the kind-specific data.
+
+	union {
+		struct {
+			uint32_t msg; // Offset of the error message in 'flamingo_ast_t.strs'.
+		} invalid;
+
+		struct {
+			ast_list_t stmts;
+		} block; // Also used for AST_KIND_SOURCE_FILE.
+
+		struct {
+			flamingo_fn_kind_t kind;
+			bool is_static;
+
+			flamingo_node_t name;
+			flamingo_node_t params;
+			flamingo_node_t body;
+
+			uint32_t call_desc; // Index in 'flamingo_ast_t.call_descs'.
+		} function_declaration;
+
+		struct {
+			// Pairs of condition and body nodes, the first pair being the 'if' and the rest being the 'elif's.
+
+			ast_list_t branches;
+			flamingo_node_t else_body;
+		} if_chain;
+
+		struct {
+			flamingo_node_t cur_var_name;
+			flamingo_node_t iterator;
+			flamingo_node_t body;
+		} for_loop;
+
+		struct {
+			flamingo_node_t msg;
+		} print;
+
+		struct {
+			flamingo_node_t rv;
+		} return_;
+
+		struct {
+			flamingo_node_t test;
+			flamingo_node_t msg;
+
+			// Span of the test expression as written, for error messages.
+
+			uint32_t test_start;
+			uint32_t test_end;
+		} assert_;
+
+		struct {
+			bool is_static;
+
+			flamingo_node_t name;
+			flamingo_node_t type;
+			flamingo_node_t initial;
+		} var_decl;
+
+		struct {
+			flamingo_node_t left;
+			flamingo_node_t right;
+
+			// Set if this is of the form 'x = x + ...', in which case the value of 'x' can be added to in-place.
+
+			bool self_add;
+		} assignment;
+
+		struct {
+			bool is_relative;
+			uint32_t path; // Offset in 'flamingo_ast_t.strs' of the path of the file to import, e.g. "a/b.fl" for 'import a.b'.
+		} import;
+
+		struct {
+			flamingo_node_t expr;
+		} expr_statement;
+
+		struct {
+			// Where the variable this identifier refers to is expected to be, as found by the resolver (see 'resolve.h').
+			// This is the number of scopes up from the current one and the index of the variable in that scope, or AST_UNRESOLVED if it has to be looked up by name.
+
+			uint32_t depth;
+			uint32_t slot;
+
+			uint32_t symbol; // Index of the constant with the identifier's name.
+		} identifier; // Also used for AST_KIND_SELF.
+
+		struct {
+			ast_literal_kind_t kind;
+
+			union {
+				bool boolean;
+				int64_t integer;
+
+				struct {
+					uint32_t start;
+					uint32_t size;
+
+					uint32_t constant; // Index in 'flamingo_ast_t.consts'.
+				} str;
+			};
+		} literal;
+
+		struct {
+			flamingo_node_t params;
+			flamingo_node_t body; // Either a block or an expression.
+
+			uint32_t call_desc; // Index in 'flamingo_ast_t.call_descs'.
+		} lambda;
+
+		struct {
+			ast_list_t elems;
+		} vec;
+
+		struct {
+			// Pairs of key and value nodes.
+
+			ast_list_t items;
+		} map;
+
+		struct {
+			flamingo_node_t callable;
+			ast_list_t args;
+		} call;
+
+		struct {
+			flamingo_node_t operand;
+			ast_op_t op;
+
+			// Span of the operator as written, for error messages.
+
+			uint32_t op_start;
+			uint32_t op_size;
+		} unary_expr;
+
+		struct {
+			flamingo_node_t left;
+			flamingo_node_t right;
+			ast_op_t op;
+
+			// Span of the operator as written, for error messages.
+
+			uint32_t op_start;
+			uint32_t op_size;
+		} binary_expr;
+
+		struct {
+			flamingo_node_t accessed;
+			flamingo_node_t accessor;
+		} access;
+
+		struct {
+			flamingo_node_t indexed;
+			flamingo_node_t index;
+		} index;
+
+		struct {
+			ast_list_t params;
+		} param_list;
+
+		struct {
+			flamingo_node_t ident;
+			flamingo_node_t type;
+		} param;
+	};
+} ast_node_t;
+
+struct flamingo_ast_t {
+	size_t node_count;
+	ast_node_t* nodes;
+
+	size_t list_size;
+	flamingo_node_t* lists;
+
+	flamingo_node_t root;
+
+	size_t const_count;
+	ast_const_t* consts;
+
+	size_t call_desc_count;
+	ast_call_desc_t* call_descs;
+
+	// Null-terminated strings nodes refer to by offset, rather than each owning its own, so that nothing in the AST is a pointer (see 'cache.h').
+
+	size_t str_size;
+	char* strs;
+
+	// Bytecode of the code units which have been compiled so far, indexed by the node at their root (see 'bytecode.h').
+	// This is only allocated once the VM first runs something from this AST.
+	// Instances on different threads can be running the same program, so the array and its entries are only ever set atomically (see 'vm_code').
+
+	_Atomic(vm_code_t* _Atomic*) code;
+};
+
+static inline ast_node_t const* ast_node(flamingo_ast_t const* ast, flamingo_node_t node) {
+	assert(node < ast->node_count);
+	return &ast->nodes[node];
+}
+
+static inline ast_node_t const* ast_list_node(flamingo_ast_t const* ast, ast_list_t list, size_t i) {
+	assert(i < list.count);
+	return ast_node(ast, ast->lists[list.first + i]);
+}
+
+static inline char const* ast_str(flamingo_ast_t const* ast, uint32_t str) {
+	assert(str < ast->str_size);
+	return &ast->strs[str];
+}
+
+static inline void ast_free(flamingo_ast_t* ast) {
+	free(ast->nodes);
+	free(ast->lists);
+	free(ast->consts);
+	free(ast->call_descs);
+	free(ast->strs);
+	free(ast);
+}
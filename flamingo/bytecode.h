@@ -0,0 +1,689 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Bytecode compiler.
+ *
+ * This compiles code units (the top-level code of a source file, function and class bodies, and expression bodies of anonymous functions) from the lowered AST to a flat array of register-based instructions, which are then run by the VM (see 'vm.h').
+ * Registers hold immediates (see 'imm.h'), and every instruction which reads a register takes ownership of what it holds and clears it, so a register is always empty before it is written to.
+ *
+ * Control flow (if chains, loops, break, continue, and return) is compiled down to jumps.
+ * Since every scope is pushed lexically, the compiler knows how many scopes must be popped when jumping out of a block, and so jumps carry a count of scopes to pop.
+ *
+ * Anything which doesn't evaluate any sub-expression and isn't hot (function declarations, imports, &c) is compiled to a single instruction which just calls its handler from the tree-walker, so both engines share the same semantics.
+ */
+
+#pragma once
+
+#include "ast.h"
+#include "common.h"
+
+#define VM_NO_REG UINT32_MAX
+
+typedef enum {
+	VM_OP_END,
+	VM_OP_ERROR, // Raise the error of the invalid node.
+
+	// Leaf expressions.
+
+	VM_OP_LITERAL,    // a = literal node.
+	VM_OP_IDENTIFIER, // a = value of identifier node, read as an immediate if c is set.
+	VM_OP_SELF,       // a = self.
+	VM_OP_LAMBDA,     // a = anonymous function node.
+
+	// Compound expressions.
+
+	VM_OP_VEC,            // a = vector of the elements in registers b onwards.
+	VM_OP_MAP_NEW,        // a = empty map with room for the pairs of the map node.
+	VM_OP_MAP_KEY,        // Check that b isn't already a key in the map in a.
+	VM_OP_MAP_INSERT,     // Add the key-value pair in registers b and b + 1 to the map in a.
+	VM_OP_MAP,            // a = the map built in b.
+	VM_OP_CHECK_CALLABLE, // Check that b is callable.
+	VM_OP_CALL,           // a = b(c onwards), b + 1 being the value b was accessed on (if any).
+	VM_OP_TAIL_CALL,      // Same as VM_OP_CALL, but for the value of a return, which the call is deferred past if possible.
+	VM_OP_UNARY,          // a = op b.
+	VM_OP_BINARY,         // a = b op c.
+	VM_OP_SHORT_CIRCUIT,  // If the left operand in b is enough to know the result of the binary node, c = result and jump to a.
+	VM_OP_ACCESS,         // a = b.accessor, keeping b if c is set.
+	VM_OP_CHECK_INDEXED,  // Check that b is indexable.
+	VM_OP_INDEX,          // a = b[c].
+
+	// Statements.
+
+	VM_OP_PRINT,        // Print b.
+	VM_OP_ASSERT,       // Assert b.
+	VM_OP_VAR_DECL,     // Add the variable of the declaration node to the current scope.
+	VM_OP_VAR_INIT,     // Set the value of the last declared variable to b (none if no register).
+	VM_OP_ASSIGN_VAR,   // Start assigning to the identifier node.
+	VM_OP_ASSIGN_ACCESS, // Start assigning to the member of b of the access node.
+	VM_OP_ASSIGN_INDEX, // Start assigning to b[c].
+	VM_OP_ASSIGN,       // Finish assigning b.
+	VM_OP_ASSIGN_ADD,   // Finish assigning b + c for the binary expression node, adding c to b in-place if possible.
+	VM_OP_FN_DECL,      // Declare the function/class of the declaration node.
+	VM_OP_IMPORT,       // Run the import node.
+	VM_OP_CLEAR,        // Drop the value in b.
+
+	// Scopes and control flow.
+
+	VM_OP_PUSH_SCOPE,
+	VM_OP_POP_SCOPE,     // Pop c scopes.
+	VM_OP_DETACH_SCOPE,  // Detach the current scope, which will be the instance scope of a class.
+	VM_OP_JUMP,          // Pop c scopes and jump to a.
+	VM_OP_JUMP_IF_FALSE, // Jump to a if b is false, c being set if this is an elif condition.
+	VM_OP_FOR_PREP,      // Start iterating over b.
+	VM_OP_FOR_NEXT,      // Push a scope with the next element of b in it, or jump to a if there are none left.
+	VM_OP_RETURN_BEGIN,  // Start returning, and if there's nothing more to evaluate, pop c scopes and jump to a.
+	VM_OP_RETURN,        // Return b, and pop c scopes and jump to a.
+	VM_OP_LOOSE_BREAK,   // Break outside of a loop.
+	VM_OP_LOOSE_CONTINUE, // Continue outside of a loop.
+} vm_op_t;
+
+typedef struct {
+	vm_op_t op;
+
+	uint32_t a;
+	uint32_t b;
+	uint32_t c;
+
+	flamingo_node_t node;
+} vm_instr_t;
+
+typedef enum {
+	VM_UNIT_SOURCE,
+	VM_UNIT_FUNCTION,
+	VM_UNIT_CLASS,
+	VM_UNIT_EXPR,
+} vm_unit_kind_t;
+
+struct vm_code_t {
+	vm_unit_kind_t kind;
+
+	size_t instr_count;
+	vm_instr_t* instrs;
+
+	uint32_t reg_count;
+};
+
+// Jumps which need to be patched with the address of some label once it is known.
+
+typedef struct {
+	size_t count;
+	size_t* instrs;
+} compile_patches_t;
+
+typedef struct compile_loop_t compile_loop_t;
+
+struct compile_loop_t {
+	compile_loop_t* parent;
+
+	uint32_t depth; // Scope depth outside of the loop.
+	size_t continue_target;
+
+	compile_patches_t breaks;
+	compile_patches_t continues;
+};
+
+typedef struct {
+	flamingo_ast_t* ast;
+	vm_code_t* code;
+	size_t instr_capacity;
+
+	uint32_t next_reg;
+	uint32_t depth; // Number of scopes pushed since the start of the code unit.
+	uint32_t base_depth; // Depth at which the epilogue takes over.
+
+	compile_loop_t* loop;
+	compile_patches_t returns;
+} compile_t;
+
+static void compile_stmt(compile_t* c, ast_node_t const* node);
+static void compile_expr(compile_t* c, ast_node_t const* node, uint32_t dst);
+
+static size_t compile_emit(compile_t* c, vm_op_t op, uint32_t a, uint32_t b, uint32_t reg_c, ast_node_t const* node) {
+	vm_code_t* const code = c->code;
+
+	if (code->instr_count == c->instr_capacity) {
+		c->instr_capacity = c->instr_capacity == 0 ? 32 : c->instr_capacity * 2;
+
+		code->instrs = realloc(code->instrs, c->instr_capacity * sizeof *code->instrs);
+		assert(code->instrs != NULL);
+	}
+
+	code->instrs[code->instr_count] = (vm_instr_t) {
+		.op = op,
+		.a = a,
+		.b = b,
+		.c = reg_c,
+		.node = node == NULL ? AST_NULL : (flamingo_node_t) (node - c->ast->nodes),
+	};
+
+	return code->instr_count++;
+}
+
+static size_t compile_here(compile_t* c) {
+	return c->code->instr_count;
+}
+
+static void compile_patch_add(compile_patches_t* patches, size_t instr) {
+	patches->instrs = realloc(patches->instrs, (patches->count + 1) * sizeof *patches->instrs);
+	assert(patches->instrs != NULL);
+
+	patches->instrs[patches->count++] = instr;
+}
+
+static void compile_patch_apply(compile_t* c, compile_patches_t* patches, size_t target) {
+	for (size_t i = 0; i < patches->count; i++) {
+		c->code->instrs[patches->instrs[i]].a = target;
+	}
+
+	free(patches->instrs);
+
+	patches->count = 0;
+	patches->instrs = NULL;
+}
+
+// Registers are allocated like a stack, so that temporaries can be freed all at once after they have been consumed.
+
+static uint32_t compile_reg_alloc(compile_t* c, uint32_t count) {
+	uint32_t const reg = c->next_reg;
+	c->next_reg += count;
+
+	if (c->next_reg > c->code->reg_count) {
+		c->code->reg_count = c->next_reg;
+	}
+
+	return reg;
+}
+
+static void compile_reg_free(compile_t* c, uint32_t reg) {
+	assert(reg <= c->next_reg);
+	c->next_reg = reg;
+}
+
+static ast_node_t const* compile_node(compile_t* c, flamingo_node_t node) {
+	return ast_node(c->ast, node);
+}
+
+static void compile_call(compile_t* c, ast_node_t const* node, uint32_t dst, vm_op_t op) {
+	// The callable goes in the first register, and the value it was accessed on (if any) in the one right after it.
+
+	uint32_t const callable = compile_reg_alloc(c, 2);
+	ast_node_t const* const callable_node = compile_node(c, node->call.callable);
+
+	if (callable_node->kind == AST_KIND_ACCESS) {
+		compile_expr(c, compile_node(c, callable_node->access.accessed), callable + 1);
+		compile_emit(c, VM_OP_ACCESS, callable, callable + 1, true, callable_node);
+	}
+
+	else {
+		compile_expr(c, callable_node, callable);
+	}
+
+	compile_emit(c, VM_OP_CHECK_CALLABLE, VM_NO_REG, callable, VM_NO_REG, NULL);
+
+	// Arguments go in consecutive registers.
+
+	uint32_t const args = compile_reg_alloc(c, node->call.args.count);
+
+	for (size_t i = 0; i < node->call.args.count; i++) {
+		compile_expr(c, ast_list_node(c->ast, node->call.args, i), args + i);
+	}
+
+	compile_emit(c, op, dst, callable, args, node);
+	compile_reg_free(c, callable);
+}
+
+// Compile an expression whose value is only read by the very next instruction (an operand or a condition).
+// Identifiers can then be read as immediates, which don't reference the value of the variable if it's a none, boolean, or integer.
+
+static void compile_operand(compile_t* c, ast_node_t const* node, uint32_t dst) {
+	if (node->kind == AST_KIND_IDENTIFIER) {
+		compile_emit(c, VM_OP_IDENTIFIER, dst, VM_NO_REG, true, node);
+		return;
+	}
+
+	compile_expr(c, node, dst);
+}
+
+static void compile_expr(compile_t* c, ast_node_t const* node, uint32_t dst) {
+	uint32_t reg;
+
+	switch (node->kind) {
+	// 'dst == VM_NO_REG' means that we don't care about the result of the expression and can discard it.
+	// These types of expressions are dead-ends if we're discarding the value and they can't have side-effect either, so just don't compile them (just like 'parse_expr').
+
+	case AST_KIND_LITERAL:
+		if (dst != VM_NO_REG) {
+			compile_emit(c, VM_OP_LITERAL, dst, VM_NO_REG, VM_NO_REG, node);
+		}
+
+		break;
+	case AST_KIND_IDENTIFIER:
+		if (dst != VM_NO_REG) {
+			compile_emit(c, VM_OP_IDENTIFIER, dst, VM_NO_REG, false, node);
+		}
+
+		break;
+	case AST_KIND_LAMBDA:
+		if (dst != VM_NO_REG) {
+			compile_emit(c, VM_OP_LAMBDA, dst, VM_NO_REG, VM_NO_REG, node);
+		}
+
+		break;
+	case AST_KIND_SELF:
+		if (dst != VM_NO_REG) {
+			compile_emit(c, VM_OP_SELF, dst, VM_NO_REG, VM_NO_REG, node);
+		}
+
+		break;
+	case AST_KIND_VEC:
+		reg = compile_reg_alloc(c, node->vec.elems.count);
+
+		for (size_t i = 0; i < node->vec.elems.count; i++) {
+			compile_expr(c, ast_list_node(c->ast, node->vec.elems, i), reg + i);
+		}
+
+		compile_emit(c, VM_OP_VEC, dst, reg, VM_NO_REG, node);
+		compile_reg_free(c, reg);
+
+		break;
+	case AST_KIND_MAP:
+		// The map is built up pair by pair, as duplicate keys have to be caught before the value paired with them is evaluated.
+
+		reg = compile_reg_alloc(c, 3);
+		compile_emit(c, VM_OP_MAP_NEW, reg, VM_NO_REG, VM_NO_REG, node);
+
+		for (size_t i = 0; i < node->map.items.count; i += 2) {
+			compile_expr(c, ast_list_node(c->ast, node->map.items, i), reg + 1);
+			compile_emit(c, VM_OP_MAP_KEY, reg, reg + 1, VM_NO_REG, NULL);
+			compile_expr(c, ast_list_node(c->ast, node->map.items, i + 1), reg + 2);
+			compile_emit(c, VM_OP_MAP_INSERT, reg, reg + 1, VM_NO_REG, NULL);
+		}
+
+		compile_emit(c, VM_OP_MAP, dst, reg, VM_NO_REG, node);
+		compile_reg_free(c, reg);
+
+		break;
+	case AST_KIND_CALL:
+		compile_call(c, node, dst, VM_OP_CALL);
+		break;
+	case AST_KIND_UNARY_EXPR:
+		reg = compile_reg_alloc(c, 1);
+
+		compile_operand(c, compile_node(c, node->unary_expr.operand), reg);
+		compile_emit(c, VM_OP_UNARY, dst, reg, VM_NO_REG, node);
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_BINARY_EXPR:
+		reg = compile_reg_alloc(c, 2);
+
+		compile_operand(c, compile_node(c, node->binary_expr.left), reg);
+
+		// Operators which might not need their right operand skip over it.
+
+		if (node->binary_expr.op == AST_OP_AND || node->binary_expr.op == AST_OP_OR) {
+			size_t const skip = compile_emit(c, VM_OP_SHORT_CIRCUIT, 0, reg, dst, node);
+
+			compile_operand(c, compile_node(c, node->binary_expr.right), reg + 1);
+			compile_emit(c, VM_OP_BINARY, dst, reg, reg + 1, node);
+
+			c->code->instrs[skip].a = compile_here(c);
+		}
+
+		else {
+			compile_operand(c, compile_node(c, node->binary_expr.right), reg + 1);
+			compile_emit(c, VM_OP_BINARY, dst, reg, reg + 1, node);
+		}
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_ACCESS:
+		reg = compile_reg_alloc(c, 1);
+
+		compile_expr(c, compile_node(c, node->access.accessed), reg);
+		compile_emit(c, VM_OP_ACCESS, dst, reg, false, node);
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_INDEX:
+		reg = compile_reg_alloc(c, 2);
+
+		compile_expr(c, compile_node(c, node->index.indexed), reg);
+		compile_emit(c, VM_OP_CHECK_INDEXED, VM_NO_REG, reg, VM_NO_REG, NULL);
+		compile_expr(c, compile_node(c, node->index.index), reg + 1);
+		compile_emit(c, VM_OP_INDEX, dst, reg, reg + 1, node);
+
+		compile_reg_free(c, reg);
+		break;
+	default:
+		compile_emit(c, VM_OP_ERROR, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+		break;
+	}
+}
+
+static void compile_block(compile_t* c, ast_node_t const* node) {
+	if (node->kind != AST_KIND_BLOCK) {
+		compile_emit(c, VM_OP_ERROR, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+		return;
+	}
+
+	compile_emit(c, VM_OP_PUSH_SCOPE, VM_NO_REG, VM_NO_REG, VM_NO_REG, NULL);
+	c->depth++;
+
+	for (size_t i = 0; i < node->block.stmts.count; i++) {
+		compile_stmt(c, ast_list_node(c->ast, node->block.stmts, i));
+	}
+
+	c->depth--;
+	compile_emit(c, VM_OP_POP_SCOPE, VM_NO_REG, VM_NO_REG, 1, NULL);
+}
+
+static void compile_if_chain(compile_t* c, ast_node_t const* node) {
+	compile_patches_t ends = {0};
+	ast_list_t const branches = node->if_chain.branches;
+
+	for (size_t i = 0; i < branches.count; i += 2) {
+		ast_node_t const* const condition = ast_list_node(c->ast, branches, i);
+		ast_node_t const* const body = ast_list_node(c->ast, branches, i + 1);
+
+		// Like in the tree-walker, bodies which couldn't be lowered error before their condition is evaluated.
+
+		if (body->kind == AST_KIND_INVALID) {
+			compile_emit(c, VM_OP_ERROR, VM_NO_REG, VM_NO_REG, VM_NO_REG, body);
+		}
+
+		uint32_t const reg = compile_reg_alloc(c, 1);
+		compile_operand(c, condition, reg);
+
+		size_t const skip = compile_emit(c, VM_OP_JUMP_IF_FALSE, 0, reg, i > 0, NULL);
+		compile_reg_free(c, reg);
+
+		compile_block(c, body);
+		compile_patch_add(&ends, compile_emit(c, VM_OP_JUMP, 0, VM_NO_REG, 0, NULL));
+
+		c->code->instrs[skip].a = compile_here(c);
+	}
+
+	if (node->if_chain.else_body != AST_NULL) {
+		compile_block(c, compile_node(c, node->if_chain.else_body));
+	}
+
+	compile_patch_apply(c, &ends, compile_here(c));
+}
+
+static void compile_for_loop(compile_t* c, ast_node_t const* node) {
+	ast_node_t const* const body = compile_node(c, node->for_loop.body);
+
+	if (body->kind == AST_KIND_INVALID) {
+		compile_emit(c, VM_OP_ERROR, VM_NO_REG, VM_NO_REG, VM_NO_REG, body);
+	}
+
+	// The iterator stays in its register for the whole loop.
+	// The register after it is left empty, and its counter is used to hold the number of iterations.
+
+	uint32_t const iterator = compile_reg_alloc(c, 2);
+
+	compile_expr(c, compile_node(c, node->for_loop.iterator), iterator);
+	compile_emit(c, VM_OP_FOR_PREP, VM_NO_REG, iterator, VM_NO_REG, NULL);
+
+	compile_loop_t loop = {
+		.parent = c->loop,
+		.depth = c->depth,
+	};
+
+	c->loop = &loop;
+
+	// Each iteration gets its own scope for the current variable, in which the body's block scope is pushed.
+
+	size_t const head = compile_emit(c, VM_OP_FOR_NEXT, 0, iterator, VM_NO_REG, node);
+	c->depth++;
+
+	compile_block(c, body);
+
+	compile_patch_apply(c, &loop.continues, compile_here(c));
+	compile_emit(c, VM_OP_POP_SCOPE, VM_NO_REG, VM_NO_REG, 1, NULL);
+	compile_emit(c, VM_OP_JUMP, head, VM_NO_REG, 0, NULL);
+
+	c->depth--;
+
+	size_t const exit = compile_here(c);
+
+	c->code->instrs[head].a = exit;
+	compile_patch_apply(c, &loop.breaks, exit);
+
+	compile_emit(c, VM_OP_CLEAR, VM_NO_REG, iterator, VM_NO_REG, NULL);
+
+	c->loop = loop.parent;
+	compile_reg_free(c, iterator);
+}
+
+static void compile_return(compile_t* c, ast_node_t const* node) {
+	uint32_t const pops = c->depth - c->base_depth;
+	size_t const begin = compile_emit(c, VM_OP_RETURN_BEGIN, 0, VM_NO_REG, pops, node);
+
+	compile_patch_add(&c->returns, begin);
+
+	if (node->return_.rv == AST_NULL) {
+		return;
+	}
+
+	uint32_t const reg = compile_reg_alloc(c, 1);
+	ast_node_t const* const rv = compile_node(c, node->return_.rv);
+
+	// A call in tail position of a function is deferred past the return which follows it if possible (see 'call_defer').
+
+	if (rv->kind == AST_KIND_CALL && c->code->kind == VM_UNIT_FUNCTION) {
+		compile_call(c, rv, reg, VM_OP_TAIL_CALL);
+	}
+
+	else {
+		compile_expr(c, rv, reg);
+	}
+
+	compile_patch_add(&c->returns, compile_emit(c, VM_OP_RETURN, 0, reg, pops, node));
+
+	compile_reg_free(c, reg);
+}
+
+static void compile_assignment(compile_t* c, ast_node_t const* node) {
+	ast_node_t const* const left = compile_node(c, node->assignment.left);
+	uint32_t const reg = compile_reg_alloc(c, 3);
+
+	// Resolve the LHS first.
+	// For accesses, we hold on to the accessed value until the assignment is done, as the variable we're assigning to may belong to it.
+
+	if (left->kind == AST_KIND_IDENTIFIER) {
+		compile_emit(c, VM_OP_ASSIGN_VAR, VM_NO_REG, VM_NO_REG, VM_NO_REG, left);
+	}
+
+	else if (left->kind == AST_KIND_ACCESS) {
+		compile_expr(c, compile_node(c, left->access.accessed), reg);
+		compile_emit(c, VM_OP_ASSIGN_ACCESS, VM_NO_REG, reg, VM_NO_REG, left);
+	}
+
+	else {
+		assert(left->kind == AST_KIND_INDEX);
+
+		compile_expr(c, compile_node(c, left->index.indexed), reg);
+		compile_emit(c, VM_OP_CHECK_INDEXED, VM_NO_REG, reg, VM_NO_REG, NULL);
+		compile_expr(c, compile_node(c, left->index.index), reg + 1);
+		compile_emit(c, VM_OP_ASSIGN_INDEX, VM_NO_REG, reg, reg + 1, left);
+	}
+
+	// Then evaluate the RHS and assign it.
+	// If it adds something to the variable being assigned to, its operands are evaluated separately so that can be done in-place.
+
+	ast_node_t const* const right = compile_node(c, node->assignment.right);
+
+	if (node->assignment.self_add) {
+		compile_expr(c, compile_node(c, right->binary_expr.left), reg + 1);
+		compile_expr(c, compile_node(c, right->binary_expr.right), reg + 2);
+		compile_emit(c, VM_OP_ASSIGN_ADD, VM_NO_REG, reg + 1, reg + 2, right);
+	}
+
+	else {
+		compile_expr(c, right, reg + 2);
+		compile_emit(c, VM_OP_ASSIGN, VM_NO_REG, reg + 2, VM_NO_REG, node);
+	}
+
+	if (left->kind == AST_KIND_ACCESS) {
+		compile_emit(c, VM_OP_CLEAR, VM_NO_REG, reg, VM_NO_REG, NULL);
+	}
+
+	compile_reg_free(c, reg);
+}
+
+static void compile_stmt(compile_t* c, ast_node_t const* node) {
+	uint32_t reg;
+
+	switch (node->kind) {
+	case AST_KIND_BLOCK:
+		compile_block(c, node);
+		break;
+	case AST_KIND_FUNCTION_DECLARATION:
+		compile_emit(c, VM_OP_FN_DECL, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+		break;
+	case AST_KIND_IF_CHAIN:
+		compile_if_chain(c, node);
+		break;
+	case AST_KIND_FOR_LOOP:
+		compile_for_loop(c, node);
+		break;
+	case AST_KIND_BREAK:
+		if (c->loop == NULL) {
+			compile_emit(c, VM_OP_LOOSE_BREAK, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+			break;
+		}
+
+		compile_patch_add(&c->loop->breaks, compile_emit(c, VM_OP_JUMP, 0, VM_NO_REG, c->depth - c->loop->depth, NULL));
+		break;
+	case AST_KIND_CONTINUE:
+		if (c->loop == NULL) {
+			compile_emit(c, VM_OP_LOOSE_CONTINUE, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+			break;
+		}
+
+		// Don't pop the scope of the current variable, that's done after the continue target.
+
+		compile_patch_add(&c->loop->continues, compile_emit(c, VM_OP_JUMP, 0, VM_NO_REG, c->depth - c->loop->depth - 1, NULL));
+		break;
+	case AST_KIND_PRINT:
+		reg = compile_reg_alloc(c, 1);
+
+		compile_expr(c, compile_node(c, node->print.msg), reg);
+		compile_emit(c, VM_OP_PRINT, VM_NO_REG, reg, VM_NO_REG, node);
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_RETURN:
+		compile_return(c, node);
+		break;
+	case AST_KIND_ASSERT:
+		reg = compile_reg_alloc(c, 1);
+
+		compile_expr(c, compile_node(c, node->assert_.test), reg);
+		compile_emit(c, VM_OP_ASSERT, VM_NO_REG, reg, VM_NO_REG, node);
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_VAR_DECL:
+		compile_emit(c, VM_OP_VAR_DECL, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+
+		if (node->var_decl.initial == AST_NULL) {
+			compile_emit(c, VM_OP_VAR_INIT, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+			break;
+		}
+
+		reg = compile_reg_alloc(c, 1);
+
+		compile_expr(c, compile_node(c, node->var_decl.initial), reg);
+		compile_emit(c, VM_OP_VAR_INIT, VM_NO_REG, reg, VM_NO_REG, node);
+
+		compile_reg_free(c, reg);
+		break;
+	case AST_KIND_ASSIGNMENT:
+		compile_assignment(c, node);
+		break;
+	case AST_KIND_IMPORT:
+		compile_emit(c, VM_OP_IMPORT, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+		break;
+	case AST_KIND_EXPR_STATEMENT:
+		compile_expr(c, compile_node(c, node->expr_statement.expr), VM_NO_REG);
+		break;
+	default:
+		compile_emit(c, VM_OP_ERROR, VM_NO_REG, VM_NO_REG, VM_NO_REG, node);
+		break;
+	}
+}
+
+/**
+ * Compile a code unit to bytecode.
+ *
+ * @param ast The AST the code unit is in.
+ * @param body The root of the code unit (source file, function/class body block, or anonymous function body expression).
+ * @param kind The kind of code unit.
+ * @return The compiled code.
+ */
+static vm_code_t* compile(flamingo_ast_t* ast, flamingo_node_t body, vm_unit_kind_t kind) {
+	vm_code_t* const code = calloc(1, sizeof *code);
+	assert(code != NULL);
+
+	code->kind = kind;
+
+	compile_t c = {
+		.ast = ast,
+		.code = code,
+	};
+
+	ast_node_t const* const node = ast_node(ast, body);
+
+	switch (kind) {
+	case VM_UNIT_SOURCE:
+		assert(node->kind == AST_KIND_SOURCE_FILE);
+
+		for (size_t i = 0; i < node->block.stmts.count; i++) {
+			compile_stmt(&c, ast_list_node(ast, node->block.stmts, i));
+		}
+
+		break;
+	case VM_UNIT_FUNCTION:
+	case VM_UNIT_CLASS:
+		assert(node->kind == AST_KIND_BLOCK);
+
+		// The body's block scope is popped (or detached) by the epilogue, so returns don't need to pop it themselves.
+
+		compile_emit(&c, VM_OP_PUSH_SCOPE, VM_NO_REG, VM_NO_REG, VM_NO_REG, NULL);
+		c.depth = c.base_depth = 1;
+
+		for (size_t i = 0; i < node->block.stmts.count; i++) {
+			compile_stmt(&c, ast_list_node(ast, node->block.stmts, i));
+		}
+
+		break;
+	case VM_UNIT_EXPR:
+		compile_expr(&c, node, compile_reg_alloc(&c, 1));
+		break;
+	}
+
+	// Epilogue, which is where returns jump to.
+
+	compile_patch_apply(&c, &c.returns, compile_here(&c));
+
+	if (kind == VM_UNIT_FUNCTION) {
+		compile_emit(&c, VM_OP_POP_SCOPE, VM_NO_REG, VM_NO_REG, 1, NULL);
+	}
+
+	else if (kind == VM_UNIT_CLASS) {
+		compile_emit(&c, VM_OP_DETACH_SCOPE, VM_NO_REG, VM_NO_REG, VM_NO_REG, NULL);
+	}
+
+	compile_emit(&c, VM_OP_END, VM_NO_REG, VM_NO_REG, VM_NO_REG, NULL);
+
+	return code;
+}
+
+static void vm_code_free(vm_code_t* code) {
+	free(code->instrs);
+	free(code);
+}
@@ -0,0 +1,337 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Precompiled module cache.
+ *
+ * Parsing and lowering a module is most of what it costs to start running it, and gives the same AST as long as its source doesn't change.
+ * The lowered and resolved AST of a module can thus be written to a cache file ('.flc'), either next to its source or in a cache directory (see {@link flamingo_cache_path}), and loaded from there the next time instead of parsing the source again.
+ *
+ * Nothing in the AST is a pointer (nodes, lists, constants, and strings all refer to each other by index or offset, see 'ast.h'), so a cache file is just a header followed by each of the AST's arrays as they are in memory.
+ * Loading one is only a matter of mapping it and pointing the AST's arrays into the mapping, which is read-only as nothing modifies an AST once it's been resolved.
+ *
+ * The header holds a hash of the source the AST was lowered from, and the cache is ignored (and later overwritten) if the source has changed since.
+ * It also holds a format version and the size of each of the AST's structures, as these are laid out however this build of the interpreter lays them out, and so a cache can only be loaded by a build which lays them out the same way.
+ * Bump {@link CACHE_VERSION} whenever anything in the AST changes meaning without changing size.
+ *
+ * The header also holds a hash of everything after it, so that a cache file which was corrupted (e.g. on disk, or by something other than us writing to it) is ignored rather than crashing whatever loads it.
+ * The contents of a cache file are otherwise trusted just as much as the source next to it, and aren't validated any further than that and the bounds of its arrays.
+ */
+
+#pragma once
+
+#include "ast.h"
+#include "common.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "FLC"
+#define CACHE_VERSION 2
+
+typedef struct {
+	uint64_t offset;
+	uint64_t count;
+} cache_section_t;
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+
+	// Sizes of the AST's structures in the build which wrote the cache.
+
+	uint32_t node_size;
+	uint32_t const_size;
+	uint32_t call_desc_size;
+	uint32_t index_size;
+
+	// The source the AST was lowered from.
+
+	uint64_t src_hash;
+	uint64_t src_size;
+
+	// Everything after the header.
+
+	uint64_t payload_hash;
+
+	uint32_t root;
+
+	cache_section_t nodes;
+	cache_section_t lists;
+	cache_section_t consts;
+	cache_section_t call_descs;
+	cache_section_t strs;
+} cache_header_t;
+
+// Sections are aligned to the strictest alignment of any structure in them, which is the 64-bit integer of literal nodes.
+
+#define CACHE_ALIGN 8
+
+// FNV-1a, which is plenty to notice a source or cache having changed, and much faster to run over it than parsing it.
+
+#define CACHE_HASH_INIT 0xcbf29ce484222325
+
+static uint64_t cache_hash_update(uint64_t hash, void const* data, size_t size) {
+	uint8_t const* const bytes = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+static uint64_t cache_hash(char const* src, size_t src_size) {
+	return cache_hash_update(CACHE_HASH_INIT, src, src_size);
+}
+
+static void cache_header_init(cache_header_t* header, char const* src, size_t src_size) {
+	memset(header, 0, sizeof *header);
+	memcpy(header->magic, CACHE_MAGIC, sizeof header->magic);
+
+	header->version = CACHE_VERSION;
+
+	header->node_size = sizeof(ast_node_t);
+	header->const_size = sizeof(ast_const_t);
+	header->call_desc_size = sizeof(ast_call_desc_t);
+	header->index_size = sizeof(flamingo_node_t);
+
+	header->src_hash = cache_hash(src, src_size);
+	header->src_size = src_size;
+}
+
+static char* cache_path(char const* path, char const* dir) {
+	char* res = NULL;
+
+	if (dir == NULL) {
+		if (asprintf(&res, "%sc", path) < 0) {
+			return NULL;
+		}
+
+		return res;
+	}
+
+	// Name the cache after the source file, without its directory or '.fl' extension, and tell apart files with the same name by the hash of their full path.
+
+	char* const full_path = realpath(path, NULL);
+	char const* const hashed = full_path == NULL ? path : full_path;
+	uint64_t const hash = cache_hash(hashed, strlen(hashed));
+
+	char const* const slash = strrchr(path, '/');
+	char const* const name = slash == NULL ? path : slash + 1;
+	size_t len = strlen(name);
+
+	if (len > 3 && strcmp(name + len - 3, ".fl") == 0) {
+		len -= 3;
+	}
+
+	int const rv = asprintf(&res, "%s/%.*s-%016" PRIx64 ".flc", dir, (int) len, name, hash);
+	free(full_path);
+
+	return rv < 0 ? NULL : res;
+}
+
+// Check that a section of a mapped cache lies entirely within it, and get a pointer to it if so.
+
+static bool cache_section(void* map, size_t map_size, cache_section_t const* section, size_t elem_size, void** res) {
+	if (section->offset % CACHE_ALIGN != 0 || section->offset > map_size) {
+		return false;
+	}
+
+	if (section->count > (map_size - section->offset) / elem_size) {
+		return false;
+	}
+
+	*res = section->count == 0 ? NULL : (char*) map + section->offset;
+	return true;
+}
+
+// Load the AST of a source from its cache, if there is one which is still up to date.
+// On success, the AST's arrays point into the mapping, which must stay mapped for as long as the AST is used and is released with {@link cache_unmap}.
+
+static flamingo_ast_t* cache_load(char const* path, char const* src, size_t src_size, void** map_ref, size_t* map_size_ref) {
+	int const fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat sb;
+
+	if (fstat(fd, &sb) < 0 || (size_t) sb.st_size < sizeof(cache_header_t)) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t const map_size = sb.st_size;
+	void* const map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	// Make sure the cache was written by a build which lays the AST out like we do, and from the source we have.
+
+	cache_header_t const* const header = map;
+	cache_header_t expected;
+	cache_header_init(&expected, src, src_size);
+
+	if (
+		memcmp(header->magic, expected.magic, sizeof header->magic) != 0 ||
+		header->version != expected.version ||
+		header->node_size != expected.node_size ||
+		header->const_size != expected.const_size ||
+		header->call_desc_size != expected.call_desc_size ||
+		header->index_size != expected.index_size ||
+		header->src_hash != expected.src_hash ||
+		header->src_size != expected.src_size ||
+		header->payload_hash != cache_hash_update(CACHE_HASH_INIT, (char*) map + sizeof *header, map_size - sizeof *header)
+	) {
+		goto err;
+	}
+
+	flamingo_ast_t* const ast = calloc(1, sizeof *ast);
+	assert(ast != NULL);
+
+	if (
+		!cache_section(map, map_size, &header->nodes, sizeof *ast->nodes, (void**) &ast->nodes) ||
+		!cache_section(map, map_size, &header->lists, sizeof *ast->lists, (void**) &ast->lists) ||
+		!cache_section(map, map_size, &header->consts, sizeof *ast->consts, (void**) &ast->consts) ||
+		!cache_section(map, map_size, &header->call_descs, sizeof *ast->call_descs, (void**) &ast->call_descs) ||
+		!cache_section(map, map_size, &header->strs, 1, (void**) &ast->strs)
+	) {
+		free(ast);
+		goto err;
+	}
+
+	ast->node_count = header->nodes.count;
+	ast->list_size = header->lists.count;
+	ast->const_count = header->consts.count;
+	ast->call_desc_count = header->call_descs.count;
+	ast->str_size = header->strs.count;
+	ast->root = header->root;
+
+	// Strings are read straight out of the table, so the last one had better be terminated.
+
+	if (ast->root >= ast->node_count || (ast->str_size > 0 && ast->strs[ast->str_size - 1] != '\0')) {
+		free(ast);
+		goto err;
+	}
+
+	*map_ref = map;
+	*map_size_ref = map_size;
+
+	return ast;
+
+err:
+
+	munmap(map, map_size);
+	return NULL;
+}
+
+static void cache_unmap(flamingo_ast_t* ast, void* map, size_t map_size) {
+	free(ast);
+	munmap(map, map_size);
+}
+
+static bool cache_write_section(FILE* f, uint64_t* offset, uint64_t* hash, cache_section_t* section, void const* data, size_t count, size_t elem_size) {
+	static char const padding[CACHE_ALIGN] = {0};
+	size_t const pad = (CACHE_ALIGN - *offset % CACHE_ALIGN) % CACHE_ALIGN;
+
+	if (fwrite(padding, 1, pad, f) != pad) {
+		return false;
+	}
+
+	*offset += pad;
+	*hash = cache_hash_update(*hash, padding, pad);
+
+	section->offset = *offset;
+	section->count = count;
+
+	if (count > 0 && fwrite(data, elem_size, count, f) != count) {
+		return false;
+	}
+
+	*offset += count * elem_size;
+	*hash = cache_hash_update(*hash, data, count * elem_size);
+
+	return true;
+}
+
+// Write the AST of a source to its cache.
+// The cache is written to a temporary file which is then moved over the old one, so that a cache is never seen half-written, even by another process loading it at the same time.
+// Caching is only ever an optimization, so failing to write the cache (e.g. because the directory isn't writable) isn't an error.
+
+static void cache_store(char const* path, flamingo_ast_t const* ast, char const* src, size_t src_size) {
+	char* tmp_path = NULL;
+
+	if (asprintf(&tmp_path, "%s.XXXXXX", path) < 0) {
+		return;
+	}
+
+	int const fd = mkstemp(tmp_path);
+
+	if (fd < 0) {
+		free(tmp_path);
+		return;
+	}
+
+	// 'mkstemp' creates the file only readable by us, but a cache is only as private as its source.
+
+	if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) < 0) {
+		close(fd);
+		goto err;
+	}
+
+	FILE* const f = fdopen(fd, "wb");
+
+	if (f == NULL) {
+		close(fd);
+		goto err;
+	}
+
+	// Leave room for the header, which is only written once we know where each section ends up.
+
+	cache_header_t header;
+	cache_header_init(&header, src, src_size);
+	header.root = ast->root;
+
+	uint64_t offset = sizeof header;
+	header.payload_hash = CACHE_HASH_INIT;
+
+	if (
+		fseek(f, offset, SEEK_SET) < 0 ||
+		!cache_write_section(f, &offset, &header.payload_hash, &header.nodes, ast->nodes, ast->node_count, sizeof *ast->nodes) ||
+		!cache_write_section(f, &offset, &header.payload_hash, &header.lists, ast->lists, ast->list_size, sizeof *ast->lists) ||
+		!cache_write_section(f, &offset, &header.payload_hash, &header.consts, ast->consts, ast->const_count, sizeof *ast->consts) ||
+		!cache_write_section(f, &offset, &header.payload_hash, &header.call_descs, ast->call_descs, ast->call_desc_count, sizeof *ast->call_descs) ||
+		!cache_write_section(f, &offset, &header.payload_hash, &header.strs, ast->strs, ast->str_size, 1) ||
+		fseek(f, 0, SEEK_SET) < 0 ||
+		fwrite(&header, sizeof header, 1, f) != 1
+	) {
+		fclose(f);
+		goto err;
+	}
+
+	if (fclose(f) != 0 || rename(tmp_path, path) < 0) {
+		goto err;
+	}
+
+	free(tmp_path);
+	return;
+
+err:
+
+	unlink(tmp_path);
+	free(tmp_path);
+}
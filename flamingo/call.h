@@ -14,76 +14,68 @@
 #include "common.h"
 #include "env.h"
 #include "scope.h"
+#include "stack.h"
 #include "var.h"
 
 #include "grammar/block.h"
 #include "grammar/expr.h"
 
-// XXX Right now, there's no way of defining primitive type member parameters, so this is for that.
-// So I'm just ignoring them for now.
-// We need to find a long-term solution at some point.
+// Bind arguments to the parameters of a function or class, as variables in the scope just pushed for the call.
+// Everything needed to do this was worked out when lowering its declaration (see 'ast_call_desc_t'), and the scope's variables are allocated in one go.
 
-static int setup_args_no_param(flamingo_t* flamingo, flamingo_arg_list_t* args) {
-	for (size_t i = 0; i < args->count; i++) {
-		// Create parameter variable.
+static void setup_args(flamingo_t* flamingo, ast_call_desc_t const* desc, flamingo_arg_list_t* args) {
+	assert(args->count == desc->params.count);
+	flamingo_scope_t* const scope = env_cur_scope(flamingo->env);
+	scope_reserve_vars(scope, args->count);
 
-		flamingo_scope_t* const scope = env_cur_scope(flamingo->env);
-		flamingo_var_t* const var = scope_add_var(scope, "nothing to see here!", 0);
+	for (size_t i = 0; i < args->count; i++) {
+		ast_node_t const* const identifier = ast_list_node(flamingo->ast, desc->params, i);
+		flamingo_var_t* const var = scope_add_symbol_var(scope, symbol_of(flamingo, identifier), identifier->end - identifier->start);
 
 		var_set_val(var, args->args[i]);
 		val_incref(args->args[i]);
 	}
-
-	return 0;
 }
 
-static int setup_args(flamingo_t* flamingo, TSNode* params, flamingo_arg_list_t* args) {
-	size_t const param_count = params == NULL ? 0 : ts_node_named_child_count(*params);
-
-	if (args->count != param_count) {
-		return error(flamingo, "callable expected %zu arguments, got %zu instead", param_count, args->count);
-	}
-
-	flamingo_scope_t* const scope = env_cur_scope(flamingo->env);
-
-	for (size_t i = 0; i < args->count; i++) {
-		// Get parameter.
-		// assert: Type should already have been checked when declaring the function/class.
-
-		TSNode const param = ts_node_named_child(*params, i);
-		char const* const param_type = ts_node_type(param);
-		assert(strcmp(param_type, "param") == 0);
+// Return value a function is left with when it returned by deferring a call, so that the rest of its body is skipped like for any other return.
 
-		// Get parameter identifier.
+#define CALL_DEFERRED_RV ((flamingo_val_t*) (intptr_t) 0xDEFE44ED)
 
-		TSNode const identifier = ts_node_child_by_field_name(param, "ident", 5);
-		assert(strcmp(ts_node_type(identifier), "identifier") == 0);
+// Check if a call in tail position (i.e. 'return f(...)') can be deferred until the current function has returned.
+// Only functions can be, as anything else doesn't run in a frame of its own, and classes are always called for the instance they return.
 
-		size_t const start = ts_node_start_byte(identifier);
-		size_t const end = ts_node_end_byte(identifier);
-
-		char const* const name = flamingo->src + start;
-		size_t const size = end - start;
+static bool call_can_defer(flamingo_t* flamingo, flamingo_val_t* callable) {
+	return flamingo->cur_fn_body != AST_NULL && callable->kind == FLAMINGO_VAL_KIND_FN && callable->fn.kind == FLAMINGO_FN_KIND_FUNCTION;
+}
 
-		// Get parameter type if it has one.
+// Defer a call in tail position, which {@link call} then makes in place of the current function once it has returned.
+// This way, tail calls reuse the frame of the function they're returning from, and recursing through them doesn't nest C calls.
+// The callable and arguments are referenced until then, as the caller still releases its own references to them.
 
-		TSNode const type = ts_node_child_by_field_name(param, "type", 4);
-		bool const has_type = !ts_node_is_null(type);
+static void call_defer(flamingo_t* flamingo, flamingo_val_t* callable, flamingo_arg_list_t* args) {
+	assert(flamingo->tail_callable == NULL);
+	assert(flamingo->tail_args.count == 0);
 
-		if (has_type) {
-			assert(strcmp(ts_node_type(type), "type") == 0);
-		}
+	if (args->count > flamingo->tail_args_capacity) {
+		flamingo->tail_args_capacity = args->count;
+		flamingo->tail_args.args = realloc(flamingo->tail_args.args, args->count * sizeof *flamingo->tail_args.args);
+		assert(flamingo->tail_args.args != NULL);
+	}
 
-		(void) type;
+	for (size_t i = 0; i < args->count; i++) {
+		flamingo->tail_args.args[i] = val_incref(args->args[i]);
+	}
 
-		// Create parameter variable, and set to argument list value in same position.
+	flamingo->tail_args.count = args->count;
+	flamingo->tail_callable = val_incref(callable);
+}
 
-		flamingo_var_t* const var = scope_add_var(scope, name, size);
-		var_set_val(var, args->args[i]);
-		val_incref(args->args[i]);
+static void call_release_tail_args(flamingo_t* flamingo) {
+	for (size_t i = 0; i < flamingo->tail_args.count; i++) {
+		val_decref(flamingo->tail_args.args[i]);
 	}
 
-	return 0;
+	flamingo->tail_args.count = 0;
 }
 
 static int call(
@@ -96,6 +88,37 @@ static int call(
 	// Note about calling functions on instances: we don't actually need to add its scope to the environment, because the environment on its callable already has that scope on the scope stack.
 	// If we ever need to know whether or not we're calling on an instance, the following check can be used: accessed_val != NULL && accessed_val->kind == FLAMINGO_VAL_KIND_INST
 
+	// Calls which defer to each other in tail position only count as nesting once, as they're made one after the other in this same C call.
+
+	if (stack_enter(flamingo, 1) < 0) {
+		return -1;
+	}
+
+	// Remember the context we were called from, as we'll have to switch back to it once the callable (and any calls it deferred) are done.
+
+	char* const prev_src = flamingo->src;
+	size_t const prev_src_size = flamingo->src_size;
+	flamingo_ast_t* const prev_ast = flamingo->ast;
+	flamingo_const_cache_t* const prev_consts = flamingo->consts;
+
+	flamingo_node_t const prev_fn_body = flamingo->cur_fn_body;
+	flamingo_env_t* const prev_env = flamingo->env;
+
+	// A callable's body isn't in the loop it might be called from, so 'break' and 'continue' directly in it are errors, just like when the VM resolves them at compile time.
+
+	size_t const prev_in_loop = flamingo->in_loop;
+	flamingo->in_loop = 0;
+
+	// Deferred callable we're currently calling, which we hold a reference to.
+
+	flamingo_val_t* deferred = NULL;
+	flamingo_scope_t* prev_scope;
+
+	// How many more calls deep the body of the callable we're currently calling counts as (see 'stack.h').
+
+	size_t nesting_depth = 0;
+
+again:;
 	bool const is_class = callable->fn.kind == FLAMINGO_FN_KIND_CLASS;
 	bool const is_extern = callable->fn.kind == FLAMINGO_FN_KIND_EXTERN;
 	bool const is_ptm = callable->fn.kind == FLAMINGO_FN_KIND_PTM;
@@ -103,23 +126,19 @@ static int call(
 	// Actually call the callable.
 	// Switch context's source if the callable was created in another.
 
-	char* const prev_src = flamingo->src;
-	size_t const prev_src_size = flamingo->src_size;
-
 	if (callable->fn.src != NULL) {
 		flamingo->src = callable->fn.src;
 		flamingo->src_size = callable->fn.src_size;
+		flamingo->ast = callable->fn.ast;
+		flamingo->consts = callable->fn.consts;
 	}
 
 	// Switch context's current callable body if we were called from another.
 
-	TSNode* const prev_fn_body = flamingo->cur_fn_body;
 	flamingo->cur_fn_body = callable->fn.body;
 
 	// Switch context's current environment to the one closed over by the function.
 
-	flamingo_env_t* const prev_env = flamingo->env;
-
 	if (callable->fn.env != NULL) {
 		flamingo->env = callable->fn.env;
 	}
@@ -127,85 +146,130 @@ static int call(
 	// Create a new scope for the function for the argument assignments.
 	// It's important to set 'scope->class_scope' to false for functions as new scopes will copy the 'class_scope' property from their parents otherwise.
 
+	prev_scope = flamingo->env->scope;
+
 	flamingo_scope_t* const scope = env_push_scope(flamingo->env);
 	scope->class_scope = is_class;
 
-	if (is_ptm) {
-		if (setup_args_no_param(flamingo, args) < 0) {
-			return -1;
-		}
+	// Primitive type members don't have a declaration, so they don't have a call descriptor either.
+	// Their arguments are just passed on as-is, and so are those of external functions, which only need their count to be checked.
+
+	ast_call_desc_t const* const desc = is_ptm ? NULL : &flamingo->ast->call_descs[callable->fn.call_desc];
+
+	if (desc != NULL && args->count != desc->params.count) {
+		error(flamingo, "callable expected %u arguments, got %zu instead", desc->params.count, args->count);
+		goto err;
 	}
 
-	else if (setup_args(flamingo, callable->fn.params, args) < 0) {
-		return -1;
+	if (!is_extern && !is_ptm) {
+		setup_args(flamingo, desc, args);
+	}
+
+	// The arguments of a deferred call are now referenced by the scope, so let go of ours.
+
+	if (args == &flamingo->tail_args) {
+		call_release_tail_args(flamingo);
 	}
 
 	// If external function or primitive type member: call the function's callback.
-	// If function or class: actually parse the function's body.
+	// If function or class: actually parse the function's body, or run it with the VM if that's the engine we're using.
 
-	TSNode* const body = callable->fn.body;
-	bool const is_expr = body != NULL && strcmp(ts_node_type(*body), "expression") == 0;
+	flamingo_node_t const body = callable->fn.body;
+	bool const is_expr = desc != NULL && desc->expr_body;
 
 	flamingo_scope_t* inner_scope;
 
-	if (is_extern || is_ptm) {
-		if (is_extern && flamingo->external_fn_cb == NULL) {
-			return error(flamingo, "cannot call external function without a external function callback being set");
+	if (!is_extern && !is_ptm && flamingo->engine != FLAMINGO_ENGINE_VM) {
+		if (stack_enter(flamingo, desc->nesting / STACK_NESTING_PER_CALL) < 0) {
+			goto err;
 		}
 
-		// Create arg list.
-
-		flamingo_scope_t* const arg_scope = env_cur_scope(flamingo->env);
-
-		size_t const arg_count = arg_scope->vars_size;
-		flamingo_val_t** const args = malloc(arg_count * sizeof *args);
-		assert(args != NULL);
+		nesting_depth = desc->nesting / STACK_NESTING_PER_CALL;
+	}
 
-		for (size_t i = 0; i < arg_count; i++) {
-			args[i] = arg_scope->vars[i].val;
+	if (is_extern || is_ptm) {
+		if (is_extern && flamingo->external_fn_cb == NULL) {
+			error(flamingo, "cannot call external function without a external function callback being set");
+			goto err;
 		}
 
-		flamingo_arg_list_t arg_list = {
-			.count = arg_count,
-			.args = args,
-		};
-
 		// Actually call the external function callback or primitive type member.
 
 		assert(flamingo->cur_fn_rv == NULL);
 
-		if (is_extern && flamingo->external_fn_cb(flamingo, callable, flamingo->external_fn_cb_data, &arg_list, &flamingo->cur_fn_rv) < 0) {
-			return -1;
+		int res = 0;
+
+		if (is_extern) {
+			res = flamingo->external_fn_cb(flamingo, callable, flamingo->external_fn_cb_data, args, &flamingo->cur_fn_rv);
 		}
 
-		else if (is_ptm && callable->fn.ptm_cb(flamingo, accessed_val, &arg_list, &flamingo->cur_fn_rv)) {
-			return -1;
+		else {
+			res = callable->fn.ptm_cb(flamingo, accessed_val, args, &flamingo->cur_fn_rv);
 		}
 
-		free(args);
+		if (res < 0) {
+			goto err;
+		}
 	}
 
 	else if (is_expr) {
 		assert(callable->fn.kind == FLAMINGO_FN_KIND_FUNCTION); // The only kind of callable that can have an expression body.
 
-		if (parse_expr(flamingo, *body, rv, NULL) < 0) {
-			return -1;
+		if (flamingo->engine == FLAMINGO_ENGINE_VM) {
+			if (vm_run(flamingo, body, NULL, rv) < 0) {
+				goto err;
+			}
+		}
+
+		else if (parse_expr(flamingo, ast_node(flamingo->ast, body), rv, NULL) < 0) {
+			goto err;
 		}
 	}
 
-	else if (parse_block(flamingo, *body, is_class ? &inner_scope : NULL) < 0) {
-		return -1;
+	else if (flamingo->engine == FLAMINGO_ENGINE_VM) {
+		if (vm_run(flamingo, body, is_class ? &inner_scope : NULL, NULL) < 0) {
+			goto err;
+		}
+	}
+
+	else if (parse_block(flamingo, ast_node(flamingo->ast, body), is_class ? &inner_scope : NULL) < 0) {
+		goto err;
 	}
 
-	// Unwind the scope stack and switch back to previous source, current function body context, and environment..
+	// Unwind the scope stack.
 
 	env_pop_scope(flamingo->env);
 
+	stack_leave(flamingo, nesting_depth);
+	nesting_depth = 0;
+
+	// If the function returned by deferring a call, there's nothing left of it, so make that call in its place.
+
+	if (flamingo->tail_callable != NULL) {
+		assert(flamingo->cur_fn_rv == CALL_DEFERRED_RV);
+		flamingo->cur_fn_rv = NULL;
+
+		val_decref(deferred);
+		deferred = flamingo->tail_callable;
+		flamingo->tail_callable = NULL;
+
+		callable = deferred;
+		accessed_val = NULL;
+		args = &flamingo->tail_args;
+
+		goto again;
+	}
+
+	// Switch back to previous source, current function body context, and environment.
+
 	flamingo->src = prev_src;
 	flamingo->src_size = prev_src_size;
+	flamingo->ast = prev_ast;
+	flamingo->consts = prev_consts;
 
 	flamingo->cur_fn_body = prev_fn_body;
 	flamingo->env = prev_env;
+	flamingo->in_loop = prev_in_loop;
 
 	// If the function body was an expression, we're done (no return value, call value was already set).
 
@@ -221,7 +285,7 @@ static int call(
 		}
 
 		assert(*rv == NULL);
-		*rv = val_alloc();
+		*rv = val_alloc(flamingo->pool);
 		(*rv)->kind = FLAMINGO_VAL_KIND_INST;
 
 		(*rv)->inst.class = callable;
@@ -235,6 +299,7 @@ static int call(
 		// That means that the class instantiation callback will never be called either, even if the constructor code itself is.
 
 		if (flamingo->class_inst_cb != NULL && flamingo->class_inst_cb(flamingo, *rv, flamingo->class_inst_cb_data, args) < 0) {
+			stack_leave(flamingo, 1);
 			return -1;
 		}
 
@@ -259,7 +324,7 @@ static int call(
 		// If return value was never set, just create a none value.
 
 		if (flamingo->cur_fn_rv == NULL) {
-			flamingo->cur_fn_rv = val_alloc();
+			flamingo->cur_fn_rv = val_alloc(flamingo->pool);
 		}
 
 		assert(*rv == NULL);
@@ -269,5 +334,34 @@ static int call(
 done:
 
 	flamingo->cur_fn_rv = NULL;
+	val_decref(deferred);
+
+	stack_leave(flamingo, 1);
 	return 0;
+
+err:
+
+	// Unwind whatever the callable left on the scope stack and switch back to the previous context, so that the instance is still consistent when the host destroys it.
+
+	while (flamingo->env->scope != prev_scope) {
+		env_pop_scope(flamingo->env);
+	}
+
+	flamingo->src = prev_src;
+	flamingo->src_size = prev_src_size;
+	flamingo->ast = prev_ast;
+	flamingo->consts = prev_consts;
+
+	flamingo->cur_fn_body = prev_fn_body;
+	flamingo->env = prev_env;
+	flamingo->in_loop = prev_in_loop;
+
+	if (args == &flamingo->tail_args) {
+		call_release_tail_args(flamingo);
+	}
+
+	val_decref(deferred);
+	stack_leave(flamingo, 1 + nesting_depth);
+
+	return -1;
 }
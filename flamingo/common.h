@@ -8,6 +8,7 @@
 # define _GNU_SOURCE
 #endif
 
+#include "ast.h"
 #include "flamingo.h"
 #include "runtime/tree_sitter/api.h"
 
@@ -16,54 +17,152 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Immediates (see 'imm.h').
+
+typedef struct imm_t imm_t;
+
+// Slots of indexed elements (see 'grammar/index.h').
+
+typedef struct index_slot_t index_slot_t;
+
+// Symbols (see 'symbol.h').
+
+typedef struct symbol_t symbol_t;
+
 // Grammar parsing prototypes.
 //
 // These functions are used internally by the interpreter to parse and execute various parts of the Flamingo grammar.
-// They typically take a Tree-sitter node and perform the corresponding action.
-
-static inline int parse_vec(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_map(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val, flamingo_val_t** accessed_val_ref);
-static inline int parse_unary_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_binary_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int access_find_var(flamingo_t* flamingo, TSNode node, flamingo_var_t** var, flamingo_val_t** accessed_val);
-static inline int parse_access(flamingo_t* flamingo, TSNode node, flamingo_val_t** val, flamingo_val_t** accessed_val);
-static inline int parse_index(flamingo_t* flamingo, TSNode node, flamingo_val_t** val, flamingo_val_t*** slot, bool lhs);
-static inline int parse_statement(flamingo_t* flamingo, TSNode node);
-static inline int parse_block(flamingo_t* flamingo, TSNode node, flamingo_scope_t** inner_scope);
-static inline int parse_print(flamingo_t* flamingo, TSNode node);
-static inline int parse_return(flamingo_t* flamingo, TSNode node);
+// They typically take a node of the lowered AST (see 'ast.h') and perform the corresponding action.
+
+static inline int parse_vec(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_map(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, flamingo_val_t** accessed_val_ref);
+static inline int parse_unary_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_binary_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_expr_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res);
+static inline int access_find_var(flamingo_t* flamingo, ast_node_t const* node, flamingo_var_t** var, flamingo_val_t** accessed_val);
+static inline int parse_access(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, flamingo_val_t** accessed_val);
+static inline int parse_index(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, index_slot_t* slot, bool lhs);
+static inline int parse_statement(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_block(flamingo_t* flamingo, ast_node_t const* node, flamingo_scope_t** inner_scope);
+static inline int parse_print(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_return(flamingo_t* flamingo, ast_node_t const* node);
 static inline int parse_break(flamingo_t* flamingo);
 static inline int parse_continue(flamingo_t* flamingo);
-static inline int parse_assert(flamingo_t* flamingo, TSNode node);
-static inline int parse_literal(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_identifier(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_self(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_call(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_var_decl(flamingo_t* flamingo, TSNode node);
-static inline int parse_assignment(flamingo_t* flamingo, TSNode node);
-static inline int parse_import(flamingo_t* flamingo, TSNode node);
-static inline int parse_function_declaration(flamingo_t* flamingo, TSNode node, flamingo_fn_kind_t kind);
-static inline int parse_lambda(flamingo_t* flamingo, TSNode node, flamingo_val_t** val);
-static inline int parse_if_chain(flamingo_t* flamingo, TSNode node);
-static inline int parse_for_loop(flamingo_t* flamingo, TSNode node);
-
-static inline bool check_is_static(flamingo_t* flamingo, TSNode node);
-static inline int find_static_members_in_class(flamingo_t* flamingo, flamingo_scope_t* scope, TSNode body);
+static inline int parse_assert(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_literal(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_identifier(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_self(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_call(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_var_decl(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_assignment(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_import(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_function_declaration(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_lambda(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val);
+static inline int parse_if_chain(flamingo_t* flamingo, ast_node_t const* node);
+static inline int parse_for_loop(flamingo_t* flamingo, ast_node_t const* node);
+
+static inline int find_static_members_in_class(flamingo_t* flamingo, flamingo_scope_t* scope, ast_node_t const* body);
+
+// VM prototypes.
+
+/**
+ * Run a code unit with the bytecode VM.
+ *
+ * The code unit is compiled the first time it is run.
+ *
+ * @param flamingo The flamingo instance.
+ * @param body The root node of the code unit in the current AST (source file, function/class body block, or expression body).
+ * @param inner_scope Output parameter for the instance scope if the code unit is a class body, NULL otherwise.
+ * @param rv Output parameter for the value of the code unit if it is an expression body. Can be NULL.
+ * @return 0 on success, -1 on error.
+ */
+static inline int vm_run(flamingo_t* flamingo, flamingo_node_t body, flamingo_scope_t** inner_scope, flamingo_val_t** rv);
+
+// Pool prototypes.
+
+/**
+ * Allocate a block from a pool.
+ *
+ * @param pool The pool to allocate from. If NULL, the block is allocated with malloc.
+ * @param size The size of the block.
+ * @return The new block, which is uninitialized.
+ */
+static inline void* pool_alloc_block(flamingo_pool_t* pool, size_t size);
+
+/**
+ * Free a block allocated with {@link pool_alloc_block}.
+ *
+ * @param pool The pool the block was allocated from.
+ * @param ptr The block to free. Can be NULL.
+ * @param size The size the block was allocated with.
+ */
+static inline void pool_free_block(flamingo_pool_t* pool, void* ptr, size_t size);
+
+/**
+ * Resize a block allocated with {@link pool_alloc_block}.
+ *
+ * @param pool The pool the block was allocated from.
+ * @param ptr The block to resize. Can be NULL, in which case this is just an allocation.
+ * @param old_size The size the block was allocated with.
+ * @param size The new size of the block.
+ * @return The resized block, which may have moved.
+ */
+static inline void* pool_realloc_block(flamingo_pool_t* pool, void* ptr, size_t old_size, size_t size);
+
+// Symbol prototypes.
+
+/**
+ * Intern a key into a pool's symbol table.
+ *
+ * @param pool The pool to intern the key into.
+ * @param key The characters of the key.
+ * @param size The size of the key.
+ * @return The characters of the symbol, which live as long as the pool.
+ */
+static inline char* symbol_intern(flamingo_pool_t* pool, char const* key, size_t size);
+
+/**
+ * Check if two keys are equal, which is usually because they're the same symbol.
+ *
+ * @param a The first key.
+ * @param a_size The size of the first key.
+ * @param b The second key.
+ * @param b_size The size of the second key.
+ * @return Whether the two keys are equal.
+ */
+static inline bool symbol_eq(char const* a, size_t a_size, char const* b, size_t b_size);
+
+/**
+ * Free a pool's symbol table and all of its symbols.
+ *
+ * @param pool The pool.
+ */
+static inline void symbol_table_free(flamingo_pool_t* pool);
+
+/**
+ * Get the symbol of an identifier node, interning it into the instance's pool the first time.
+ *
+ * @param flamingo The flamingo instance.
+ * @param node The identifier (or 'self') node.
+ * @return The characters of the symbol, whose size is that of the identifier.
+ */
+static inline char* symbol_of(flamingo_t* flamingo, ast_node_t const* node);
 
 // Environment prototypes.
 
 /**
  * Allocate a new environment.
  *
+ * @param pool The pool to allocate the environment and its scopes from. Can be NULL.
  * @return The new environment.
  */
-static inline flamingo_env_t* env_alloc(void);
+static inline flamingo_env_t* env_alloc(flamingo_pool_t* pool);
 
 /**
  * Free an environment.
  *
- * This frees the environment and decrements the reference count of all scopes in its stack.
+ * This frees the environment and decrements the reference count of its innermost scope.
  *
  * @param env The environment to free.
  */
@@ -73,7 +172,7 @@ static inline void env_free(flamingo_env_t* env);
  * Create a closure over an environment.
  *
  * This creates a new environment that shares the scopes of the given environment.
- * The reference counts of the scopes are incremented.
+ * Only the reference count of the innermost scope is incremented, as it holds on to the rest.
  *
  * @param env The environment to close over.
  * @return The new environment.
@@ -84,7 +183,7 @@ static inline flamingo_env_t* env_close_over(flamingo_env_t* env);
  * Get the parent scope of the current scope in the environment.
  *
  * @param env The environment.
- * @return The parent scope, or NULL if there is no parent scope (stack size < 2).
+ * @return The parent scope, or NULL if there is no parent scope (fewer than two scopes on the stack).
  */
 static inline flamingo_scope_t* env_parent_scope(flamingo_env_t* env);
 
@@ -102,6 +201,8 @@ static inline flamingo_scope_t* env_cur_scope(flamingo_env_t* env);
  * This pushes the scope onto the stack.
  * Unlike {@link env_push_scope}, this does NOT allocate a new scope or change the reference count of the provided scope.
  *
+ * The scope's parent becomes the current scope if it doesn't have one yet, and otherwise must already be the current scope.
+ *
  * This is useful when you want to restore a previously detached scope.
  *
  * @param env The environment.
@@ -154,6 +255,20 @@ static inline void env_pop_scope(flamingo_env_t* env);
  */
 static inline flamingo_var_t* env_find_var(flamingo_env_t* env, char const* key, size_t key_size);
 
+/**
+ * Find a variable in the environment at the address the resolver bound its identifier to.
+ *
+ * If the identifier couldn't be bound, or the variable isn't at that address (e.g. if it hasn't been declared yet), this falls back to {@link env_find_var}.
+ *
+ * @param env The environment.
+ * @param depth The number of scopes up from the current one the variable is expected to be in, or AST_UNRESOLVED.
+ * @param slot The index of the variable in that scope.
+ * @param key The name of the variable to find.
+ * @param key_size The size of the variable name.
+ * @return The variable if found, or NULL if not found.
+ */
+static inline flamingo_var_t* env_find_var_at(flamingo_env_t* env, uint32_t depth, uint32_t slot, char const* key, size_t key_size);
+
 // Scope prototypes.
 
 /**
@@ -161,9 +276,10 @@ static inline flamingo_var_t* env_find_var(flamingo_env_t* env, char const* key,
  *
  * The scope is initialized with a reference count of 1.
  *
+ * @param pool The pool to allocate the scope and its variables from, which the keys of its variables are also interned into.
  * @return The new scope.
  */
-static inline flamingo_scope_t* scope_alloc(void);
+static inline flamingo_scope_t* scope_alloc(flamingo_pool_t* pool);
 
 /**
  * Free a scope.
@@ -184,6 +300,15 @@ static inline void scope_free(flamingo_scope_t* scope);
  */
 static inline void scope_decref(flamingo_scope_t* scope);
 
+/**
+ * Hash a key (FNV-1a).
+ *
+ * @param key The key to hash.
+ * @param key_size The size of the key.
+ * @return The hash of the key.
+ */
+static inline size_t scope_hash(char const* key, size_t key_size);
+
 /**
  * Add a variable to a scope.
  *
@@ -194,6 +319,26 @@ static inline void scope_decref(flamingo_scope_t* scope);
  */
 static inline flamingo_var_t* scope_add_var(flamingo_scope_t* scope, char const* key, size_t key_size);
 
+/**
+ * Add a variable to a scope, whose name is already a symbol.
+ *
+ * This is the same as {@link scope_add_var}, but doesn't have to intern the name if the symbol is from the scope's pool.
+ *
+ * @param scope The scope to add the variable to.
+ * @param symbol The name of the variable, as a symbol (e.g. from {@link symbol_of}).
+ * @param key_size The size of the variable name.
+ * @return The new variable.
+ */
+static inline flamingo_var_t* scope_add_symbol_var(flamingo_scope_t* scope, char* symbol, size_t key_size);
+
+/**
+ * Make sure a scope has room for a number of variables, so that adding that many more won't allocate.
+ *
+ * @param scope The scope.
+ * @param count The number of variables to make room for, on top of the ones already in the scope.
+ */
+static inline void scope_reserve_vars(flamingo_scope_t* scope, size_t count);
+
 /**
  * Find a variable in a scope.
  *
@@ -212,7 +357,7 @@ static inline flamingo_var_t* scope_shallow_find_var(flamingo_scope_t* scope, ch
 /**
  * Set the value of a variable.
  *
- * This also updates the value's name to match the variable's key.
+ * If the value doesn't have a name yet, this also names it after the variable's key.
  *
  * @param var The variable to set the value of.
  * @param val The value to set. Can be NULL.
@@ -260,20 +405,33 @@ static inline char const* val_role_str(flamingo_val_t* val);
  *
  * The value is initialized with {@link val_init}.
  *
+ * @param pool The pool to allocate the value from. Can be NULL, in which case it's allocated with malloc.
  * @return The new value.
  */
-static inline flamingo_val_t* val_alloc(void);
+static inline flamingo_val_t* val_alloc(flamingo_pool_t* pool);
 
 /**
  * Create a copy of a value.
  *
  * For collections (vectors and maps) and instances, this is a shallow copy.
+ * Collections are copied on write: the copy shares the elements of the original until either is modified, which must be preceded by a call to {@link val_detach}.
+ * Values which are never modified in-place (nones, booleans, integers, and strings) aren't copied at all, and the original is returned with its reference count incremented.
  *
  * @param val The value to copy.
  * @return The new copy of the value.
  */
 static inline flamingo_val_t* val_copy(flamingo_val_t* val);
 
+/**
+ * Make sure a vector or map doesn't share its elements with any of its copies.
+ *
+ * This must be called before modifying a vector or map in-place, so that the modification isn't seen through its copies.
+ * It does nothing for other kinds of values.
+ *
+ * @param val The value to detach.
+ */
+static inline void val_detach(flamingo_val_t* val);
+
 /**
  * Check if two values are equal.
  *
@@ -288,6 +446,17 @@ static inline flamingo_val_t* val_copy(flamingo_val_t* val);
  */
 static inline bool val_eq(flamingo_val_t* x, flamingo_val_t* y);
 
+/**
+ * Hash a value.
+ *
+ * This is consistent with {@link val_eq}: values which are equal always have the same hash.
+ * Like {@link val_eq}, it doesn't take the names of values into account.
+ *
+ * @param val The value to hash.
+ * @return The hash of the value.
+ */
+static inline size_t val_hash(flamingo_val_t* val);
+
 /**
  * Free a value.
  *
@@ -308,6 +477,198 @@ static inline void val_free(flamingo_val_t* val);
  */
 static inline flamingo_val_t* val_decref(flamingo_val_t* val);
 
+// String prototypes.
+
+/**
+ * Free the characters of a string.
+ *
+ * @param str The string value.
+ */
+static inline void str_free(flamingo_val_t* str);
+
+/**
+ * Set a string to the concatenation of two others.
+ *
+ * This appends to the buffer of the left string if it can, so the left string doesn't need to be copied.
+ *
+ * @param str The string value to set, which mustn't have any characters yet.
+ * @param left The left string.
+ * @param right The right string.
+ */
+static inline void str_concat(flamingo_val_t* str, flamingo_val_t* left, flamingo_val_t* right);
+
+/**
+ * Append a string to the end of another in-place.
+ *
+ * @param str The string value to append to.
+ * @param append The string to append.
+ */
+static inline void str_append(flamingo_val_t* str, flamingo_val_t* append);
+
+// Evaluation stack prototypes.
+
+/**
+ * Push a frame onto the evaluation stack.
+ *
+ * @param flamingo The flamingo instance.
+ * @param size The size of the frame in bytes.
+ * @return The frame, zeroed, which stays where it is until it's popped.
+ */
+static inline void* stack_push(flamingo_t* flamingo, size_t size);
+
+/**
+ * Pop a frame off the evaluation stack.
+ *
+ * @param flamingo The flamingo instance.
+ * @param frame The frame, which must be the last one pushed which hasn't been popped yet.
+ */
+static inline void stack_pop(flamingo_t* flamingo, void* frame);
+
+/**
+ * Free every chunk of the evaluation stack.
+ *
+ * @param flamingo The flamingo instance.
+ */
+static inline void stack_free(flamingo_t* flamingo);
+
+/**
+ * Count a call as nesting deeper.
+ *
+ * @param flamingo The flamingo instance.
+ * @param depth How many calls deeper the call nests (1 unless its body is deeply nested, see 'stack.h').
+ * @return 0 on success, or -1 with an error raised if that would go past the instance's maximum depth.
+ */
+static inline int stack_enter(flamingo_t* flamingo, size_t depth);
+
+/**
+ * Count a call entered with {@link stack_enter} as having returned.
+ *
+ * @param flamingo The flamingo instance.
+ * @param depth The depth the call was entered with.
+ */
+static inline void stack_leave(flamingo_t* flamingo, size_t depth);
+
+// Program prototypes.
+
+/**
+ * Parse, lower, and resolve a source into a new program with a single reference, or load its AST from a cache.
+ *
+ * @param src The source code, which the program only frees if it owns it.
+ * @param src_size The size of the source code.
+ * @param owns_src Whether the program takes ownership of the source.
+ * @param cache_path The path of the source's cache, or NULL not to use one.
+ * @return The program, or NULL if the source couldn't be parsed.
+ */
+static inline flamingo_program_t* program_alloc(char* src, size_t src_size, bool owns_src, char const* cache_path);
+
+/**
+ * Check whether a program's AST was loaded from the precompiled module cache rather than parsed.
+ *
+ * @param program The program.
+ * @return Whether the AST was loaded from the cache.
+ */
+static inline bool program_cached(flamingo_program_t* program);
+
+/**
+ * Take a reference to a program.
+ *
+ * @param program The program.
+ * @return The program.
+ */
+static inline flamingo_program_t* program_incref(flamingo_program_t* program);
+
+/**
+ * Let go of a reference to a program, freeing it along with its AST and bytecode if that was the last one.
+ *
+ * @param program The program.
+ */
+static inline void program_decref(flamingo_program_t* program);
+
+// Precompiled module cache prototypes.
+
+/**
+ * Get the path of the precompiled module cache of a source file (see {@link flamingo_cache_path}).
+ *
+ * @param path The path of the source file.
+ * @param dir The cache directory, or NULL to put the cache next to the source file.
+ * @return The path of the cache file, which the caller must free, or NULL if it couldn't be allocated.
+ */
+static inline char* cache_path(char const* path, char const* dir);
+
+// Vector prototypes.
+
+/**
+ * Make room for a number of elements in a vector.
+ *
+ * @param vec The vector value.
+ * @param capacity The number of elements the vector should be able to hold without growing.
+ * @return Whether the room could be allocated, or false (leaving the vector as it was) if it couldn't, or if the capacity is larger than {@link VEC_MAX_CAPACITY}.
+ */
+static inline bool vec_reserve_elems(flamingo_val_t* vec, size_t capacity);
+
+/**
+ * Insert an element into a vector, moving every element after it up by one.
+ *
+ * This takes ownership of the reference to the element.
+ *
+ * @param vec The vector value to insert the element into.
+ * @param i The position to insert the element at, which can be the vector's count to add it to the end.
+ * @param elem The element to insert.
+ */
+static inline void vec_insert_elem(flamingo_val_t* vec, size_t i, flamingo_val_t* elem);
+
+/**
+ * Add an element to the end of a vector.
+ *
+ * This takes ownership of the reference to the element.
+ *
+ * @param vec The vector value to add the element to.
+ * @param elem The element to add.
+ */
+static inline void vec_push_elem(flamingo_val_t* vec, flamingo_val_t* elem);
+
+/**
+ * Remove an element from a vector, moving every element after it down by one.
+ *
+ * @param vec The vector value to remove the element from.
+ * @param i The position of the element to remove.
+ * @return The removed element, whose reference is given to the caller.
+ */
+static inline flamingo_val_t* vec_remove_elem(flamingo_val_t* vec, size_t i);
+
+// Map prototypes.
+
+/**
+ * Make room for a number of entries in a map.
+ *
+ * @param map The map value.
+ * @param capacity The number of entries the map should be able to hold without growing.
+ */
+static inline void map_reserve(flamingo_val_t* map, size_t capacity);
+
+/**
+ * Find the value of a key in a map.
+ *
+ * @param map The map value to search.
+ * @param key The key to find.
+ * @return The slot of the key's value in the map, or NULL if the key isn't in the map.
+ */
+static inline flamingo_val_t** map_find(flamingo_val_t* map, flamingo_val_t* key);
+
+/**
+ * Add an entry to the end of a map.
+ *
+ * This takes ownership of the references to the key and the value.
+ * Vector and map keys are replaced by a snapshot of themselves, so that modifying them in-place afterwards doesn't change the entry's key.
+ * It doesn't check whether the key is already in the map; use {@link map_find} first for that.
+ *
+ * @param map The map value to add the entry to.
+ * @param key The key of the entry.
+ * @param val The value of the entry.
+ * @return The slot of the value in the map, which is only valid until the next entry is added.
+ */
+static inline flamingo_val_t** map_insert(flamingo_val_t* map, flamingo_val_t* key, flamingo_val_t* val);
+
 // Primitive type member prototypes.
 
 /**
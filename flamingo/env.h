@@ -10,6 +10,10 @@
  *
  * When a new block or function is entered, a new scope is typically pushed onto the environment's stack.
  * When the block or function exits, the scope is popped.
+ *
+ * The stack isn't stored as such: the environment only points to its innermost scope, and each scope points to the one it was pushed on top of.
+ * This means that closing over an environment (which every function, lambda, and copy of either does) is just taking a reference to its innermost scope, and closures created in the same place all share the same chain.
+ * Pushing a scope onto a closure's environment (as calling it does) never modifies the scopes underneath, so different environments can safely push on top of the same scope.
  */
 
 #pragma once
@@ -18,89 +22,108 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-static flamingo_env_t* env_alloc(void) {
-	flamingo_env_t* const env = malloc(sizeof *env);
-	assert(env != NULL);
+static flamingo_env_t* env_alloc(flamingo_pool_t* pool) {
+	flamingo_env_t* const env = pool_alloc_block(pool, sizeof *env);
 
-	env->scope_stack_size = 0;
-	env->scope_stack = NULL;
+	env->pool = pool;
+	env->scope = NULL;
 
 	return env;
 }
 
 static void env_free(flamingo_env_t* env) {
-	for (size_t i = 0; i < env->scope_stack_size; i++) {
-		scope_decref(env->scope_stack[i]);
-	}
-
-	free(env->scope_stack);
-	free(env);
+	scope_decref(env->scope);
+	pool_free_block(env->pool, env, sizeof *env);
 }
 
 static flamingo_env_t* env_close_over(flamingo_env_t* env) {
-	flamingo_env_t* const closed_env = env_alloc();
-
-	closed_env->scope_stack_size = env->scope_stack_size;
-	closed_env->scope_stack = malloc(closed_env->scope_stack_size * sizeof *closed_env->scope_stack);
-	assert(closed_env->scope_stack != NULL);
+	flamingo_env_t* const closed_env = env_alloc(env->pool);
 
-	for (size_t i = 0; i < closed_env->scope_stack_size; i++) {
-		flamingo_scope_t* const scope = env->scope_stack[i];
-
-		scope->ref_count++; // TODO Prolly wanna use a 'scope_incref' function or something.
-		closed_env->scope_stack[i] = scope;
+	if (env->scope != NULL) {
+		env->scope->ref_count++;
 	}
 
+	closed_env->scope = env->scope;
 	return closed_env;
 }
 
 static flamingo_scope_t* env_parent_scope(flamingo_env_t* env) {
-	if (env->scope_stack_size < 2) {
+	if (env->scope == NULL) {
 		return NULL;
 	}
 
-	return env->scope_stack[env->scope_stack_size - 2];
+	return env->scope->parent;
 }
 
 static flamingo_scope_t* env_cur_scope(flamingo_env_t* env) {
-	assert(env->scope_stack_size >= 1);
-	return env->scope_stack[env->scope_stack_size - 1];
+	assert(env->scope != NULL);
+	return env->scope;
 }
 
 static void env_gently_attach_scope(flamingo_env_t* env, flamingo_scope_t* scope) {
-	assert(env->scope_stack_size == 0 || env->scope_stack[env->scope_stack_size - 1] != scope);
+	assert(scope != env->scope);
+
+	// A scope only ever has the one parent, so it can only be attached on top of that.
+	// The environment's reference to its previous innermost scope is handed over to the attached scope the first time it's attached.
+
+	if (scope->parent == NULL) {
+		scope->parent = env->scope;
+	}
 
-	env->scope_stack = realloc(env->scope_stack, ++env->scope_stack_size * sizeof *env->scope_stack);
-	assert(env->scope_stack != NULL);
+	else {
+		assert(scope->parent == env->scope);
+		scope_decref(env->scope);
+	}
 
-	env->scope_stack[env->scope_stack_size - 1] = scope;
+	env->scope = scope;
 }
 
 static flamingo_scope_t* env_gently_detach_scope(flamingo_env_t* env) {
-	assert(env->scope_stack_size >= 1);
-	return env->scope_stack[--env->scope_stack_size];
+	flamingo_scope_t* const scope = env_cur_scope(env);
+
+	if (scope->parent != NULL) {
+		scope->parent->ref_count++;
+	}
+
+	env->scope = scope->parent;
+	return scope;
 }
 
 static flamingo_scope_t* env_push_scope(flamingo_env_t* env) {
-	flamingo_scope_t* const scope = scope_alloc();
-	env_gently_attach_scope(env, scope);
+	flamingo_scope_t* const parent = env->scope;
+	flamingo_scope_t* const scope = scope_alloc(env->pool);
+
+	// The environment's reference to the parent becomes the new scope's.
 
-	flamingo_scope_t* const parent = env_parent_scope(env);
+	scope->parent = parent;
 	scope->class_scope = parent != NULL ? parent->class_scope : false;
 
+	env->scope = scope;
 	return scope;
 }
 
 static void env_pop_scope(flamingo_env_t* env) {
+	flamingo_scope_t* const scope = env_cur_scope(env);
+
+	// If nothing else references the scope (i.e. nothing closed over it), its reference to its parent can be handed straight back to the environment.
+
+	if (scope->ref_count == 1) {
+		env->scope = scope->parent;
+		scope->parent = NULL;
+
+		scope_free(scope);
+		return;
+	}
+
 	scope_decref(env_gently_detach_scope(env));
 }
 
 static flamingo_var_t* env_find_var(flamingo_env_t* env, char const* key, size_t key_size) {
-	// Go backwards down the stack to allow for shadowing.
+	// Go from the innermost scope outwards to allow for shadowing.
 
-	for (ssize_t i = env->scope_stack_size - 1; i >= 0; i--) {
-		flamingo_scope_t* const scope = env->scope_stack[i];
+	for (flamingo_scope_t* scope = env->scope; scope != NULL; scope = scope->parent) {
 		flamingo_var_t* const var = scope_shallow_find_var(scope, key, key_size);
 
 		if (var != NULL) {
@@ -110,3 +133,23 @@ static flamingo_var_t* env_find_var(flamingo_env_t* env, char const* key, size_t
 
 	return NULL;
 }
+
+static flamingo_var_t* env_find_var_at(flamingo_env_t* env, uint32_t depth, uint32_t slot, char const* key, size_t key_size) {
+	if (depth != AST_UNRESOLVED) {
+		flamingo_scope_t* scope = env->scope;
+
+		for (uint32_t i = 0; i < depth && scope != NULL; i++) {
+			scope = scope->parent;
+		}
+
+		if (scope != NULL && slot < scope->vars_size) {
+			flamingo_var_t* const var = &scope->vars[slot];
+
+			if (symbol_eq(var->key, var->key_size, key, key_size)) {
+				return var;
+			}
+		}
+	}
+
+	return env_find_var(env, key, key_size);
+}
@@ -6,7 +6,7 @@
  * Flamingo interpreter core.
  *
  * This file contains the main entry points for the Flamingo interpreter, including instance creation, destruction, and script execution.
- * It also manages the integration with Tree-sitter for parsing.
+ * It also manages the integration with Tree-sitter for parsing, the resulting tree being lowered (see 'lower.h') before it is ever executed.
  */
 
 #if __linux__
@@ -22,18 +22,25 @@
 
 #include "parser.c"
 
+#include "cache.h"
 #include "common.h"
 #include "env.h"
 #include "grammar/statement.h"
+#include "imm.h"
+#include "lower.h"
+#include "map.h"
+#include "module.h"
+#include "pool.h"
 #include "primitive_type_member.h"
+#include "program.h"
+#include "resolve.h"
 #include "scope.h"
+#include "stack.h"
+#include "str.h"
+#include "symbol.h"
 #include "val.h"
-
-typedef struct {
-	TSParser* parser;
-	TSTree* tree;
-	TSNode root;
-} ts_state_t;
+#include "vec.h"
+#include "vm.h"
 
 extern TSLanguage const* tree_sitter_flamingo(void);
 
@@ -69,7 +76,10 @@ __attribute__((format(printf, 2, 3))) int flamingo_raise_error(flamingo_t* flami
 	return -1;
 }
 
-int flamingo_create(flamingo_t* flamingo, char const* progname, char* src, size_t src_size) {
+// Set an instance up to run a program it already holds a reference to.
+// On failure, that reference is let go of.
+
+static int create(flamingo_t* flamingo, char const* progname, flamingo_program_t* program) {
 	flamingo->consistent = false;
 
 	// Set initial state up.
@@ -77,83 +87,125 @@ int flamingo_create(flamingo_t* flamingo, char const* progname, char* src, size_
 	flamingo->progname = progname;
 	flamingo->errors_outstanding = false;
 
-	flamingo->src = src;
-	flamingo->src_size = src_size;
+	flamingo->program = program;
+	flamingo->ast = program->ast;
 
+	flamingo->src = program->src;
+	flamingo->src_size = program->src_size;
+
+	flamingo->engine = FLAMINGO_ENGINE_TREE_WALKER;
 	flamingo->inherited_env = false;
 	flamingo->env = NULL;
+	flamingo->pool = NULL;
+
+	flamingo->external_fn_cb = NULL;
+	flamingo->external_fn_cb_data = NULL;
+	flamingo->class_decl_cb = NULL;
+	flamingo->class_decl_cb_data = NULL;
+	flamingo->class_inst_cb = NULL;
+	flamingo->class_inst_cb_data = NULL;
 
-	flamingo->import_count = 0;
-	flamingo->imported_srcs = NULL;
-	flamingo->imported_flamingos = NULL;
+	flamingo->modules = NULL;
+	flamingo->inherited_modules = false;
 
 	flamingo->import_path_count = 0;
 	flamingo->import_paths = NULL;
 
-	flamingo->cur_fn_body = NULL;
+	flamingo->cache = false;
+	flamingo->cache_dir = NULL;
+
+	flamingo->cur_fn_body = AST_NULL;
 	flamingo->cur_fn_rv = NULL;
 
+	flamingo->tail_callable = NULL;
+	flamingo->tail_args.count = 0;
+	flamingo->tail_args.args = NULL;
+	flamingo->tail_args_capacity = 0;
+
+	flamingo->stack = NULL;
+	flamingo->depth = 0;
+	flamingo->max_depth = FLAMINGO_DEFAULT_MAX_DEPTH;
+
 	flamingo->in_loop = 0;
 
-	// Set up Tree-sitter and parser.
+	// Everything the program allocates at runtime comes from this instance's pool, including the values and symbols of the program's constants, which are thus cached here rather than on the program.
 
-	ts_state_t* const ts_state = calloc(1, sizeof *ts_state);
+	flamingo->pool = pool_alloc();
 
-	if (ts_state == NULL) {
-		return error(flamingo, "failed to allocate memory for Tree-sitter state");
-	}
+	flamingo->consts = calloc(flamingo->ast->const_count + 1, sizeof *flamingo->consts);
+	assert(flamingo->consts != NULL);
 
-	TSParser* const parser = ts_parser_new();
+	// Set primitive type members.
 
-	if (parser == NULL) {
-		error(flamingo, "failed to create Tree-sitter parser");
-		goto err_ts_parser_new;
+	primitive_type_member_init(flamingo);
+
+	if (primitive_type_member_std(flamingo) < 0) {
+		goto err_primitive_type_member_std;
 	}
 
-	ts_state->parser = parser;
+	flamingo->consistent = true;
+	return 0;
 
-	TSLanguage const* const lang = tree_sitter_flamingo();
-	ts_parser_set_language(parser, lang);
+err_primitive_type_member_std:
 
-	TSTree* const tree = ts_parser_parse_string(parser, NULL, src, src_size);
+	primitive_type_member_free(flamingo);
+	literal_free_consts(flamingo);
+	pool_release(flamingo->pool);
+	program_decref(program);
 
-	if (tree == NULL) {
-		error(flamingo, "failed to parse source");
-		goto err_ts_parser_parse_string;
-	}
+	return -1;
+}
 
-	ts_state->tree = tree;
-	ts_state->root = ts_tree_root_node(tree);
+int flamingo_create(flamingo_t* flamingo, char const* progname, char* src, size_t src_size) {
+	flamingo_program_t* const program = program_alloc(src, src_size, false, NULL);
 
-	// TODO make sure tree is coherent
-	//      I don't know if Tree-sitter has a simple way to check AST-coherency itself but otherwise just go down the tree and look for any MISSING or UNEXPECTED nodes
+	if (program == NULL) {
+		flamingo->progname = progname;
+		flamingo->errors_outstanding = false;
+		flamingo->consistent = false;
 
-	flamingo->ts_state = ts_state;
+		return error(flamingo, "failed to parse source");
+	}
 
-	// Set primitive type members.
+	return create(flamingo, progname, program);
+}
 
-	primitive_type_member_init(flamingo);
+flamingo_program_t* flamingo_program_create_cached(char const* src, size_t src_size, char const* cache_path) {
+	// Copy the source, as the program can outlive the caller's buffer.
 
-	if (primitive_type_member_std(flamingo) < 0) {
-		goto err_primitive_type_member_std;
-	}
+	char* const owned = malloc(src_size + 1);
+	assert(owned != NULL);
 
-	flamingo->consistent = true;
-	return 0;
+	memcpy(owned, src, src_size);
+	owned[src_size] = '\0';
 
-err_primitive_type_member_std:
+	flamingo_program_t* const program = program_alloc(owned, src_size, true, cache_path);
 
-	ts_tree_delete(tree);
+	if (program == NULL) {
+		free(owned);
+	}
 
-err_ts_parser_parse_string:
+	return program;
+}
+
+flamingo_program_t* flamingo_program_create(char const* src, size_t src_size) {
+	return flamingo_program_create_cached(src, src_size, NULL);
+}
 
-	ts_parser_delete(parser);
+char* flamingo_cache_path(char const* path, char const* cache_dir) {
+	return cache_path(path, cache_dir);
+}
 
-err_ts_parser_new:
+flamingo_program_t* flamingo_program_incref(flamingo_program_t* program) {
+	return program_incref(program);
+}
 
-	free(ts_state);
+void flamingo_program_decref(flamingo_program_t* program) {
+	program_decref(program);
+}
 
-	return -1;
+int flamingo_create_from_program(flamingo_t* flamingo, char const* progname, flamingo_program_t* program) {
+	return create(flamingo, progname, program_incref(program));
 }
 
 void flamingo_destroy(flamingo_t* flamingo) {
@@ -161,41 +213,25 @@ void flamingo_destroy(flamingo_t* flamingo) {
 		return;
 	}
 
-	// Free all the Tree-sitter-related stuff.
-
-	ts_state_t* const ts_state = flamingo->ts_state;
+	// Free the values of the program's constants and let go of the program, which frees its AST and any bytecode compiled from it if no other instance is running it.
 
-	ts_tree_delete(ts_state->tree);
-	ts_parser_delete(ts_state->parser);
-
-	free(ts_state);
+	literal_free_consts(flamingo);
+	program_decref(flamingo->program);
 
 	// If we didn't inherit our scope stack, free it and all the scopes on it.
 
 	if (!flamingo->inherited_env && flamingo->env != NULL) {
-		for (size_t i = 0; i < flamingo->env->scope_stack_size; i++) {
-			scope_empty(flamingo->env->scope_stack[i]);
+		for (flamingo_scope_t* scope = flamingo->env->scope; scope != NULL; scope = scope->parent) {
+			scope_empty(scope);
 		}
 
 		env_free(flamingo->env);
 	}
 
-	// If we imported anything, free all the created flamingo instances and their sources.
-
-	for (size_t i = 0; i < flamingo->import_count; i++) {
-		flamingo_t* const imported_flamingo = &flamingo->imported_flamingos[i];
-		char* const src = flamingo->imported_srcs[i];
-
-		flamingo_destroy(imported_flamingo);
-		free(src);
-	}
-
-	if (flamingo->imported_flamingos != NULL) {
-		free(flamingo->imported_flamingos);
-	}
+	// If the module registry is ours, free all the modules imported into the runtime.
 
-	if (flamingo->imported_srcs != NULL) {
-		free(flamingo->imported_srcs);
+	if (!flamingo->inherited_modules) {
+		modules_free(flamingo->modules);
 	}
 
 	// Free the import paths.
@@ -208,10 +244,25 @@ void flamingo_destroy(flamingo_t* flamingo) {
 		free(flamingo->import_paths);
 	}
 
-	// Finally, free the primitive type members.
+	free(flamingo->cache_dir);
+
+	// Free the buffer arguments to deferred calls are kept in.
+
+	free(flamingo->tail_args.args);
+
+	// Free the evaluation stack.
+
+	stack_free(flamingo);
+
+	// Free the primitive type members.
 
 	primitive_type_member_free(flamingo);
 
+	// Finally, let go of our pool.
+	// Anything allocated from it which is still alive (e.g. values the host held onto) keeps it around until it's freed too.
+
+	pool_release(flamingo->pool);
+
 	flamingo->consistent = false;
 }
 
@@ -239,6 +290,57 @@ void flamingo_register_class_inst_cb(flamingo_t* flamingo, flamingo_class_inst_c
 	flamingo->class_inst_cb_data = data;
 }
 
+void flamingo_set_engine(flamingo_t* flamingo, flamingo_engine_t engine) {
+	flamingo->engine = engine;
+}
+
+void flamingo_set_max_depth(flamingo_t* flamingo, size_t max_depth) {
+	flamingo->max_depth = max_depth;
+}
+
+void flamingo_set_cache(flamingo_t* flamingo, bool enabled, char const* cache_dir) {
+	free(flamingo->cache_dir);
+
+	flamingo->cache = enabled;
+	flamingo->cache_dir = NULL;
+
+	if (cache_dir != NULL) {
+		flamingo->cache_dir = strdup(cache_dir);
+		assert(flamingo->cache_dir != NULL);
+	}
+}
+
+void flamingo_alloc_stats(flamingo_t* flamingo, flamingo_alloc_stats_t* stats) {
+	*stats = (flamingo_alloc_stats_t) {0};
+
+	if (flamingo->pool != NULL) {
+		*stats = flamingo->pool->stats;
+	}
+
+	// Modules share the registry of the instance which created them, so only count them from that one.
+
+	if (flamingo->inherited_modules || flamingo->modules == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < flamingo->modules->count; i++) {
+		flamingo_alloc_stats_t imported_stats;
+		flamingo_alloc_stats(&flamingo->modules->modules[i]->flamingo, &imported_stats);
+
+		stats->allocs += imported_stats.allocs;
+		stats->mallocs += imported_stats.mallocs;
+	}
+}
+
+size_t flamingo_module_count(flamingo_t* flamingo) {
+	return flamingo->modules == NULL ? 0 : flamingo->modules->count;
+}
+
+void flamingo_module_stats(flamingo_t* flamingo, size_t i, flamingo_module_stats_t* stats) {
+	assert(i < flamingo_module_count(flamingo));
+	*stats = flamingo->modules->modules[i]->stats;
+}
+
 void flamingo_add_import_path(flamingo_t* flamingo, char* path) {
 	char* const duped = strdup(path);
 	assert(duped != NULL);
@@ -249,11 +351,9 @@ void flamingo_add_import_path(flamingo_t* flamingo, char* path) {
 	flamingo->import_paths[flamingo->import_path_count++] = duped;
 }
 
-static int parse(flamingo_t* flamingo, TSNode node) {
-	size_t const n = ts_node_child_count(node);
-
-	for (size_t i = 0; i < n; i++) {
-		TSNode const child = ts_node_child(node, i);
+static int parse(flamingo_t* flamingo, ast_node_t const* node) {
+	for (size_t i = 0; i < node->block.stmts.count; i++) {
+		ast_node_t const* const child = ast_list_node(flamingo->ast, node->block.stmts, i);
 
 		if (parse_statement(flamingo, child) < 0) {
 			return -1;
@@ -265,7 +365,7 @@ static int parse(flamingo_t* flamingo, TSNode node) {
 
 int flamingo_inherit_env(flamingo_t* flamingo, flamingo_env_t* env) {
 	if (flamingo->env != NULL) {
-		assert(flamingo->env->scope_stack_size == 0);
+		assert(flamingo->env->scope == NULL);
 		return error(flamingo, "there is already an environment on this flamingo instance");
 	}
 
@@ -276,19 +376,23 @@ int flamingo_inherit_env(flamingo_t* flamingo, flamingo_env_t* env) {
 }
 
 int flamingo_run(flamingo_t* flamingo) {
-	ts_state_t* const ts_state = flamingo->ts_state;
-	assert(strcmp(ts_node_type(ts_state->root), "source_file") == 0);
+	ast_node_t const* const root = ast_node(flamingo->ast, flamingo->ast->root);
+	assert(root->kind == AST_KIND_SOURCE_FILE);
 
 	if (!flamingo->inherited_env) {
 		if (flamingo->env != NULL) {
 			env_free(flamingo->env);
 		}
 
-		flamingo->env = env_alloc();
+		flamingo->env = env_alloc(flamingo->pool);
 		env_push_scope(flamingo->env);
 	}
 
-	return parse(flamingo, ts_state->root);
+	if (flamingo->engine == FLAMINGO_ENGINE_VM) {
+		return vm_run(flamingo, flamingo->ast->root, NULL, NULL);
+	}
+
+	return parse(flamingo, root);
 }
 
 flamingo_var_t* flamingo_find_var(flamingo_t* flamingo, char const* key, size_t key_size) {
@@ -304,11 +408,11 @@ flamingo_val_t* flamingo_val_decref(flamingo_val_t* val) {
 }
 
 flamingo_val_t* flamingo_val_make_none(void) {
-	return val_alloc();
+	return val_alloc(NULL);
 }
 
 flamingo_val_t* flamingo_val_make_int(int64_t integer) {
-	flamingo_val_t* const val = val_alloc();
+	flamingo_val_t* const val = val_alloc(NULL);
 
 	val->kind = FLAMINGO_VAL_KIND_INT;
 	val->integer.integer = integer;
@@ -317,7 +421,7 @@ flamingo_val_t* flamingo_val_make_int(int64_t integer) {
 }
 
 flamingo_val_t* flamingo_val_make_str(size_t size, char* str) {
-	flamingo_val_t* const val = val_alloc();
+	flamingo_val_t* const val = val_alloc(NULL);
 
 	val->kind = FLAMINGO_VAL_KIND_STR;
 
@@ -334,7 +438,7 @@ flamingo_val_t* flamingo_val_make_cstr(char* str) {
 }
 
 flamingo_val_t* flamingo_val_make_bool(bool boolean) {
-	flamingo_val_t* const val = val_alloc();
+	flamingo_val_t* const val = val_alloc(NULL);
 
 	val->kind = FLAMINGO_VAL_KIND_BOOL;
 	val->boolean.boolean = boolean;
@@ -15,6 +15,43 @@ typedef struct flamingo_scope_t flamingo_scope_t;
 typedef struct flamingo_env_t flamingo_env_t;
 typedef struct flamingo_arg_list_t flamingo_arg_list_t;
 
+/**
+ * Execution engine.
+ *
+ * The tree-walker evaluates the AST directly, whereas the VM first compiles each code unit to register-based bytecode and runs that.
+ * Both engines have the same semantics.
+ */
+typedef enum {
+	FLAMINGO_ENGINE_TREE_WALKER,
+	FLAMINGO_ENGINE_VM,
+} flamingo_engine_t;
+
+/**
+ * Allocation statistics.
+ *
+ * Values, scopes, and environments are allocated from per-instance pools rather than directly with malloc.
+ * Comparing these two counters shows how many allocations the pools saved.
+ */
+typedef struct {
+	size_t allocs; // Number of blocks the runtime asked for.
+	size_t mallocs; // Number of times the system allocator actually had to be called for them.
+} flamingo_alloc_stats_t;
+
+/**
+ * Statistics of an imported module.
+ *
+ * Each module is only loaded and run once, however many times it's imported (see {@link flamingo_module_stats}).
+ */
+typedef struct {
+	char const* path; // Canonical path of the module's source.
+
+	size_t imports; // Number of import statements run which imported the module, including the one which loaded it.
+	bool cached; // Whether the module's AST was loaded from the precompiled module cache rather than parsed.
+
+	uint64_t load_ns; // Time spent reading the module's source and parsing it (or loading it from the cache).
+	uint64_t run_ns; // Time spent running the module, including the modules it imported itself.
+} flamingo_module_stats_t;
+
 /**
  * Callback for external functions.
  *
@@ -79,6 +116,13 @@ typedef int (*flamingo_ptm_cb_t)(
 	flamingo_val_t** rv
 );
 
+// Default for how many calls deep a program can go (see {@link flamingo_set_max_depth}).
+// Define this when building to change it, e.g. for hosts running flamingo on threads with smaller stacks.
+
+#if !defined(FLAMINGO_DEFAULT_MAX_DEPTH)
+# define FLAMINGO_DEFAULT_MAX_DEPTH 1000
+#endif
+
 typedef enum {
 	FLAMINGO_VAL_KIND_NONE,
 	FLAMINGO_VAL_KIND_BOOL,
@@ -98,7 +142,17 @@ typedef enum {
 	FLAMINGO_FN_KIND_PTM,
 } flamingo_fn_kind_t;
 
-typedef void* flamingo_ts_node_t; // Opaque type, because user shouldn't have to include Tree-sitter stuff in their namespace (or concern themselves with Tree-sitter at all for that matter).
+// Opaque types, because user shouldn't have to concern themselves with the interpreter's internal representation of the program.
+
+typedef struct flamingo_ast_t flamingo_ast_t;
+typedef struct flamingo_const_cache_t flamingo_const_cache_t;
+typedef struct flamingo_module_t flamingo_module_t;
+typedef struct flamingo_modules_t flamingo_modules_t;
+typedef struct flamingo_program_t flamingo_program_t;
+typedef struct flamingo_pool_t flamingo_pool_t;
+typedef struct flamingo_str_buf_t flamingo_str_buf_t;
+typedef struct flamingo_stack_chunk_t flamingo_stack_chunk_t;
+typedef uint32_t flamingo_node_t; // Index of a node in its AST, 0 meaning no node.
 
 struct flamingo_val_t {
 	char* name;
@@ -107,6 +161,10 @@ struct flamingo_val_t {
 	flamingo_val_kind_t kind;
 	size_t ref_count;
 
+	// The pool this value was allocated from, or NULL if it was allocated with malloc (e.g. values made by the host).
+
+	flamingo_pool_t* pool;
+
 	// The scope this value was created in.
 
 	flamingo_scope_t* owner;
@@ -125,29 +183,55 @@ struct flamingo_val_t {
 		struct {
 			char* str;
 			size_t size;
+
+			// Buffer the string shares with other strings it is a prefix of, or NULL if it owns 'str' outright (see 'str.h').
+
+			flamingo_str_buf_t* buf;
 		} str;
 
 		struct {
 			size_t count;
+			size_t capacity;
 			flamingo_val_t** elems;
+
+			// Copies of a vector share its elements until one of them is modified (see 'val_detach').
+			// This is the number of vectors sharing them, or NULL if they aren't shared.
+
+			size_t* shared;
 		} vec;
 
 		struct {
+			// Keys and their values, in insertion order.
+
 			size_t count;
+			size_t capacity;
 			flamingo_val_t** keys;
 			flamingo_val_t** vals;
+
+			// Hash index of the entries, only built once the map is large enough (see 'map.h').
+			// Each bucket is either 0 if empty, or the index of the entry plus one.
+
+			size_t index_capacity;
+			size_t* index;
+
+			// Like vectors, copies of a map share its entries and index until one of them is modified.
+
+			size_t* shared;
 		} map;
 
 		struct {
-			flamingo_ts_node_t body;
-			flamingo_ts_node_t params;
+			flamingo_node_t body;
+			uint32_t call_desc; // Index of the callable's call descriptor in its AST.
 
 			// The environment the function closes over.
 
 			flamingo_env_t* env;
 
 			// Functions can be defined in other files entirely.
-			// While the Tree-sitter state is held within the nodes themselves, the source they point to is not, which is why we need to keep track of it here.
+			// The nodes above are only indices, so we need to keep track of the AST they belong to and the source it was lowered from here, as well as what the instance which created the function caches about that AST's constants.
+
+			flamingo_ast_t* ast;
+			flamingo_const_cache_t* consts;
 
 			char* src;
 			size_t src_size;
@@ -189,10 +273,24 @@ struct flamingo_var_t {
 
 struct flamingo_scope_t {
 	size_t ref_count;
+	flamingo_pool_t* pool; // Pool the scope and its variables are allocated from.
+
+	// Scope this one was pushed on top of, which it holds a reference to.
+
+	flamingo_scope_t* parent;
+
+	// Variables, in order of declaration.
 
 	size_t vars_size;
+	size_t vars_capacity;
 	flamingo_var_t* vars;
 
+	// Hash index into the variables, only built once a scope gets large enough for linear searches to hurt.
+	// Each bucket holds the index of a variable plus one, or zero if the bucket is empty.
+
+	size_t index_capacity;
+	size_t* index;
+
 	// If scope is an instance's scope or a class' static scope, this will be set to that instance or class.
 
 	flamingo_val_t* owner;
@@ -203,8 +301,12 @@ struct flamingo_scope_t {
 };
 
 struct flamingo_env_t {
-	size_t scope_stack_size;
-	flamingo_scope_t** scope_stack;
+	flamingo_pool_t* pool; // Pool the environment and its scopes are allocated from.
+
+	// Innermost scope, which the environment holds a reference to.
+	// The rest of the scopes are reached through its parents.
+
+	flamingo_scope_t* scope;
 };
 
 struct flamingo_arg_list_t {
@@ -235,18 +337,27 @@ struct flamingo_t {
 
 	// Runtime stuff.
 
+	flamingo_engine_t engine;
 	bool inherited_env;
 	flamingo_env_t* env;
 
-	// Tree-sitter stuff.
+	// Pool which the values, scopes, and environments created by this instance are allocated from (see 'pool.h').
+
+	flamingo_pool_t* pool;
 
-	void* ts_state;
+	// Program the instance runs, which it holds a reference to, and the AST of the code currently running.
+	// This is the program's own AST, unless we're in a function from an imported module.
+	// The same goes for what's cached about the constants of that AST.
 
-	// Import-related stuff, i.e. stuff we have to free ourselves.
+	flamingo_program_t* program;
+	flamingo_ast_t* ast;
+	flamingo_const_cache_t* consts;
 
-	size_t import_count;
-	flamingo_t* imported_flamingos;
-	char** imported_srcs;
+	// Registry of the modules imported so far, keyed by their canonical path (see 'module.h').
+	// It's shared by the whole runtime, i.e. the instance created by the host and all the modules it imports, directly or not, but only freed by the former.
+
+	flamingo_modules_t* modules;
+	bool inherited_modules;
 
 	// Import paths for global imports.
 	// These shouldn't be inherited by imported instances for now.
@@ -254,11 +365,29 @@ struct flamingo_t {
 	size_t import_path_count;
 	char** import_paths;
 
+	// Whether imported modules are loaded from and saved to the precompiled module cache, and the directory it's in, or NULL if each module's cache is next to its source (see 'cache.h').
+	// Unlike import paths, these are inherited by imported instances.
+
+	bool cache;
+	char* cache_dir;
+
 	// Current function stuff.
 
-	flamingo_ts_node_t cur_fn_body;
+	flamingo_node_t cur_fn_body;
 	flamingo_val_t* cur_fn_rv;
 
+	// Call the current function deferred by returning, to be made in its place once it has (see 'call_defer').
+
+	flamingo_val_t* tail_callable;
+	flamingo_arg_list_t tail_args;
+	size_t tail_args_capacity;
+
+	// Evaluation stack, and how many calls deep we are on it (see 'stack.h').
+
+	flamingo_stack_chunk_t* stack;
+	size_t depth;
+	size_t max_depth;
+
 	// Current loop stuff.
 
 	size_t in_loop;
@@ -303,6 +432,79 @@ __attribute__((format(printf, 2, 3))) int flamingo_raise_error(flamingo_t* flami
  */
 int flamingo_create(flamingo_t* flamingo, char const* progname, char* src, size_t src_size);
 
+/**
+ * Parse a source once into a program, which any number of instances can then run.
+ *
+ * The source is parsed, lowered, and its identifiers resolved, which is the same work {@link flamingo_create} does for every instance.
+ * The program is immutable once created, so instances on any thread can run it at the same time, each with its own environment (see {@link flamingo_create_from_program}).
+ * Unlike with {@link flamingo_create}, the source IS copied, so the caller can free it straight away.
+ *
+ * The program starts out with a single reference, which the caller must let go of with {@link flamingo_program_decref}.
+ *
+ * @param src The source code to parse.
+ * @param src_size The size of the source code.
+ * @return The program, or NULL if the source couldn't be parsed.
+ */
+flamingo_program_t* flamingo_program_create(char const* src, size_t src_size);
+
+/**
+ * Create a program like {@link flamingo_program_create}, going through the precompiled module cache.
+ *
+ * If the cache at the given path was written from the same source, the program's AST is loaded from it and the source isn't parsed at all.
+ * Otherwise (e.g. if the source changed since, or there is no cache yet), the source is parsed as usual and the cache is written for next time.
+ * Failing to read or write the cache is never an error, it's only ever skipped.
+ *
+ * @param src The source code to parse.
+ * @param src_size The size of the source code.
+ * @param cache_path The path of the cache file, usually gotten with {@link flamingo_cache_path}.
+ * @return The program, or NULL if the source couldn't be parsed.
+ */
+flamingo_program_t* flamingo_program_create_cached(char const* src, size_t src_size, char const* cache_path);
+
+/**
+ * Get the path of the precompiled module cache of a source file.
+ *
+ * If no cache directory is given, this is next to the source file, with the 'c' suffix (e.g. "a/b.flc" for "a/b.fl").
+ * Otherwise, it's a file in the cache directory named after the source file and a hash of its full path, so that sources with the same name in different directories don't share a cache.
+ *
+ * @param path The path of the source file.
+ * @param cache_dir The cache directory, or NULL.
+ * @return The path of the cache file, which the caller must free.
+ */
+char* flamingo_cache_path(char const* path, char const* cache_dir);
+
+/**
+ * Take a reference to a program.
+ *
+ * This is safe to call from any thread.
+ *
+ * @param program The program.
+ * @return The program.
+ */
+flamingo_program_t* flamingo_program_incref(flamingo_program_t* program);
+
+/**
+ * Let go of a reference to a program, freeing it if that was the last one.
+ *
+ * Instances created from a program hold their own reference to it until they're destroyed, so this can be called as soon as the caller is done creating them.
+ * This is safe to call from any thread.
+ *
+ * @param program The program.
+ */
+void flamingo_program_decref(flamingo_program_t* program);
+
+/**
+ * Create a new flamingo instance which runs an already parsed program.
+ *
+ * This is the same as {@link flamingo_create}, except the source isn't parsed again.
+ *
+ * @param flamingo The flamingo instance to initialize.
+ * @param progname The name of the program (used for error messages).
+ * @param program The program to run, which the instance takes its own reference to.
+ * @return 0 on success, -1 on error.
+ */
+int flamingo_create_from_program(flamingo_t* flamingo, char const* progname, flamingo_program_t* program);
+
 /**
  * Destroy a flamingo instance.
  *
@@ -355,6 +557,72 @@ void flamingo_register_class_decl_cb(flamingo_t* flamingo, flamingo_class_decl_c
  */
 void flamingo_register_class_inst_cb(flamingo_t* flamingo, flamingo_class_inst_cb_t cb, void* data);
 
+/**
+ * Set the execution engine.
+ *
+ * This defaults to {@link FLAMINGO_ENGINE_TREE_WALKER}.
+ * Modules imported after this is set are run with the same engine.
+ *
+ * @param flamingo The flamingo instance.
+ * @param engine The engine to use.
+ */
+void flamingo_set_engine(flamingo_t* flamingo, flamingo_engine_t engine);
+
+/**
+ * Set how many calls deep a program can go.
+ *
+ * Calls nest on the C stack, so a program which recurses too deep (or a host calling into it with too little stack left) would otherwise crash the host.
+ * Past this depth, calls fail with an error instead.
+ * With the tree-walker, a call to a callable whose body is deeply nested counts as more than one call, as evaluating that body nests C calls too.
+ * This defaults to {@link FLAMINGO_DEFAULT_MAX_DEPTH}, which is safe with the usual 8 MiB main thread stack, and modules imported after this is set share the same limit.
+ *
+ * @param flamingo The flamingo instance.
+ * @param max_depth The maximum number of nested calls.
+ */
+void flamingo_set_max_depth(flamingo_t* flamingo, size_t max_depth);
+
+/**
+ * Set whether modules imported by a flamingo instance go through the precompiled module cache.
+ *
+ * This is disabled by default.
+ * When enabled, each imported module is loaded from its cache (see {@link flamingo_cache_path}) if it's up to date, and its cache is written otherwise.
+ * Modules imported by imported modules use the same cache.
+ *
+ * @param flamingo The flamingo instance.
+ * @param enabled Whether to use the cache.
+ * @param cache_dir The directory to put caches in, or NULL to put each next to its source. This is copied.
+ */
+void flamingo_set_cache(flamingo_t* flamingo, bool enabled, char const* cache_dir);
+
+/**
+ * Get the allocation statistics of a flamingo instance.
+ *
+ * This includes the allocations of all the modules it imported.
+ *
+ * @param flamingo The flamingo instance.
+ * @param stats Output parameter for the statistics.
+ */
+void flamingo_alloc_stats(flamingo_t* flamingo, flamingo_alloc_stats_t* stats);
+
+/**
+ * Get the number of modules imported by a flamingo instance, directly or not.
+ *
+ * @param flamingo The flamingo instance.
+ * @return The number of modules.
+ */
+size_t flamingo_module_count(flamingo_t* flamingo);
+
+/**
+ * Get the statistics of a module imported by a flamingo instance.
+ *
+ * Modules are numbered in the order they started loading in.
+ *
+ * @param flamingo The flamingo instance.
+ * @param i The index of the module, less than {@link flamingo_module_count}.
+ * @param stats Output parameter for the statistics, whose path is only valid for as long as the instance is.
+ */
+void flamingo_module_stats(flamingo_t* flamingo, size_t i, flamingo_module_stats_t* stats);
+
 /**
  * Add an import path.
  *
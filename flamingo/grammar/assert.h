@@ -8,44 +8,23 @@
 #include "../common.h"
 #include "../val.h"
 
-static int parse_assert(flamingo_t* flamingo, TSNode node) {
-	size_t const child_count = ts_node_named_child_count(node);
-	assert(child_count == 1 || child_count == 2);
+// Check the already evaluated value of an assertion test, and error if it failed.
+// This takes ownership of the test value.
+// The message is only evaluated if the test fails, which is uncommon enough that it is always evaluated by walking the AST.
 
-	// Get test expression.
+static int assert_check(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t* val) {
+	assert(node->kind == AST_KIND_ASSERT);
 
-	TSNode const test_node = ts_node_child_by_field_name(node, "test", 4);
-	char const* const type = ts_node_type(test_node);
+	bool const has_msg = node->assert_.msg != AST_NULL;
+	ast_node_t const* const msg_node = ast_node(flamingo->ast, node->assert_.msg);
 
-	if (strcmp(ts_node_type(test_node), "expression") != 0) {
-		return error(flamingo, "expected expression for test, got %s", type);
-	}
-
-	// Get message.
-
-	TSNode const msg_node = ts_node_child_by_field_name(node, "msg", 3);
-	bool const has_msg = !ts_node_is_null(msg_node);
-
-	if (has_msg) {
-		char const* const msg_type = ts_node_type(msg_node);
-
-		if (strcmp(msg_type, "expression") != 0) {
-			return error(flamingo, "expected expression for message, got %s", msg_type);
-		}
-	}
-
-	// Evaluate the test expression.
-
-	flamingo_val_t* val = NULL;
+	if (val->kind != FLAMINGO_VAL_KIND_BOOL) {
+		error(flamingo, "expected boolean value for test, got %s", val_type_str(val));
+		val_decref(val);
 
-	if (parse_expr(flamingo, test_node, &val, NULL) < 0) {
 		return -1;
 	}
 
-	if (val->kind != FLAMINGO_VAL_KIND_BOOL) {
-		return error(flamingo, "expected boolean value for test, got %s", val_type_str(val));
-	}
-
 	// If the test succeeded, exit now.
 
 	if (val->boolean.boolean) {
@@ -55,11 +34,8 @@ static int parse_assert(flamingo_t* flamingo, TSNode node) {
 
 	// Otherwise, start by getting a string for the test expression.
 
-	size_t const start = ts_node_start_byte(test_node);
-	size_t const end = ts_node_end_byte(test_node);
-
-	char const* const test_str = flamingo->src + start;
-	size_t const test_size = end - start;
+	char const* const test_str = flamingo->src + node->assert_.test_start;
+	size_t const test_size = node->assert_.test_end - node->assert_.test_start;
 
 	// If we have a message, evaluate it and include it in the error message.
 
@@ -93,5 +69,20 @@ static int parse_assert(flamingo_t* flamingo, TSNode node) {
 
 	// Otherwise, just spit out something generic.
 
+	val_decref(val);
 	return error(flamingo, "assertion test '%.*s' failed", (int) test_size, test_str);
 }
+
+static int parse_assert(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_ASSERT);
+
+	// Evaluate the test expression.
+
+	flamingo_val_t* val = NULL;
+
+	if (parse_expr(flamingo, ast_node(flamingo->ast, node->assert_.test), &val, NULL) < 0) {
+		return -1;
+	}
+
+	return assert_check(flamingo, node, val);
+}
@@ -5,117 +5,222 @@
 #pragma once
 
 #include "access.h"
+#include "binary_expr.h"
 #include "expr.h"
+#include "index.h"
 
 #include "../common.h"
+#include "../imm.h"
 #include "../val.h"
 #include "../var.h"
 
-static int parse_assignment(flamingo_t* flamingo, TSNode node) {
-	assert(strcmp(ts_node_type(node), "assignment") == 0);
-	assert(ts_node_child_count(node) == 3);
+// State of an assignment in between its LHS having been resolved and its RHS having been evaluated.
+// Slot is where the element is in the container (vector/map) for index assignment, which only gets resolved to a pointer once the RHS is evaluated.
 
-	// Get RHS expression.
-
-	TSNode const right_node = ts_node_child_by_field_name(node, "right", 5);
-	char const* const right_type = ts_node_type(right_node);
+typedef struct {
+	char const* lhs;
+	size_t lhs_size;
 
-	if (strcmp(right_type, "expression") != 0) {
-		return error(flamingo, "expected expression for name, got %s", right_type);
-	}
+	flamingo_var_t* var;
+	flamingo_val_t* val;
+	index_slot_t slot;
 
-	// Get LHS identifier or access.
+	flamingo_val_kind_t prev_type;
+	char const* prev_type_str;
+} assignment_t;
 
-	TSNode const left_node = ts_node_child_by_field_name(node, "left", 4);
-	char const* const left_type = ts_node_type(left_node);
+static int assignment_check_lhs(flamingo_t* flamingo, assignment_t* assignment) {
+	// Primitive type checking:
+	// - A function or a class can never be reassigned.
+	// - A variable can't be assigned a value of a different type except if it was none (this is checked in 'assignment_finish').
+	// - TODO This is also where the const qualifier will be checked too (but this feature is to be defined).
 
-	size_t const start = ts_node_start_byte(left_node);
-	size_t const end = ts_node_end_byte(left_node);
+	flamingo_val_t* const val = assignment->val;
 
-	char const* const lhs = flamingo->src + start;
-	size_t const lhs_size = end - start;
+	assignment->prev_type = val->kind;
+	assignment->prev_type_str = val_type_str(val);
 
-	flamingo_var_t* var = NULL;
-	flamingo_val_t* val = NULL;
+	if (assignment->prev_type == FLAMINGO_VAL_KIND_FN && assignment->var != NULL) {
+		return error(flamingo, "cannot assign to %s '%.*s'", val_role_str(val), (int) assignment->lhs_size, assignment->lhs);
+	}
 
-	// Slot is a pointer to the value storage in the container (vector/map).
-	// It is used for index assignment to update the value in place.
+	return 0;
+}
 
-	flamingo_val_t** slot = NULL;
+// Overwrite a none, boolean, or integer in-place with the immediate being assigned to it, saving boxing the immediate into a new value.
+// This can only be done if nothing else references the value.
 
-	if (strcmp(left_type, "identifier") == 0) {
-		var = env_find_var(flamingo->env, lhs, lhs_size);
+static bool assignment_overwrite(flamingo_val_t* val, imm_t rhs) {
+	if (val->ref_count != 1 || rhs.boxed != NULL || rhs.kind != val->kind) {
+		return false;
+	}
 
-		if (var == NULL) {
-			return error(flamingo, "'%.*s' was never declared", (int) lhs_size, lhs);
-		}
+	if (rhs.kind == FLAMINGO_VAL_KIND_BOOL) {
+		val->boolean.boolean = rhs.boolean;
+	}
 
-		val = var->val;
+	else if (rhs.kind == FLAMINGO_VAL_KIND_INT) {
+		val->integer.integer = rhs.integer;
 	}
 
-	else if (strcmp(left_type, "access") == 0) {
-		flamingo_val_t* accessed_val = NULL;
+	return true;
+}
 
-		if (access_find_var(flamingo, left_node, &var, &accessed_val) < 0) {
-			return -1;
+// Assign the evaluated RHS (don't forget to decrement the reference counter of the previous value!).
+// This takes ownership of the RHS.
+
+static int assignment_finish(flamingo_t* flamingo, assignment_t* assignment, imm_t rhs) {
+	flamingo_val_kind_t const prev_type = assignment->prev_type;
+
+	flamingo_var_t* const var = assignment->var;
+	flamingo_val_t* const val = assignment->val;
+	index_slot_t* const slot = &assignment->slot;
+
+	if (rhs.kind != prev_type && (prev_type != FLAMINGO_VAL_KIND_NONE && rhs.kind != FLAMINGO_VAL_KIND_NONE)) {
+		char const* const rhs_type_str = imm_type_str(rhs);
+		imm_free(rhs);
+
+		if (slot->container != NULL) {
+			val_decref(val);
+			val_decref(slot->container);
 		}
 
-		val = var->val;
+		return error(flamingo, "cannot assign %s to '%.*s' (%s)", rhs_type_str, (int) assignment->lhs_size, assignment->lhs, assignment->prev_type_str);
 	}
 
-	else if (strcmp(left_type, "index") == 0) {
-		if (parse_index(flamingo, left_node, &val, &slot, true) < 0) {
-			return -1;
+	if (var != NULL) {
+		if (!assignment_overwrite(var->val, rhs)) {
+			val_decref(var->val);
+			var_set_val(var, imm_box(flamingo, rhs));
 		}
 	}
 
 	else {
-		return error(flamingo, "expected identifier, access, or index for name, got %s", left_type);
+		assert(slot->container != NULL);
+
+		val_decref(val);
+		flamingo_val_t** const elem = index_slot_get(slot);
+
+		if (elem == NULL) {
+			size_t const count = slot->container->vec.count;
+
+			imm_free(rhs);
+			val_decref(slot->container);
+
+			return error(flamingo, "index %zu is out of bounds for vector of size %zu, which it was shrunk to while evaluating the value assigned to it", slot->pos, count);
+		}
+
+		if (!assignment_overwrite(*elem, rhs)) {
+			val_decref(*elem);
+			*elem = imm_box(flamingo, rhs);
+		}
+
+		val_decref(slot->container);
 	}
 
-	// Make sure identifier is already in scope (or a previous one).
+	return 0;
+}
 
-	// Parse RHS expression (don't forget to decrement the reference counter of the previous value!) and primitive type checking:
-	// - A function or a class can never be reassigned.
-	// - A variable can't be assigned a value of a different type except if it was none.
-	// - TODO This is also where the const qualifier will be checked too (but this feature is to be defined).
+// Finish an assignment of the form 'x = x + ...' from its already evaluated operands.
+// If nothing but the variable references its value, strings, vectors, and maps are added to in-place, so that appending to them in a loop doesn't copy them over and over again.
+// This takes ownership of both operands.
+
+static int assignment_add(flamingo_t* flamingo, assignment_t* assignment, ast_node_t const* node, flamingo_val_t* left, flamingo_val_t* right) {
+	assert(node->kind == AST_KIND_BINARY_EXPR);
+	assert(assignment->var != NULL);
 
-	flamingo_val_kind_t const prev_type = val->kind;
-	char const* const prev_type_str = val_type_str(val);
+	// The variable might have been assigned something else in the meantime (e.g. by a function called on the RHS), in which case the left operand is only referenced by us.
 
-	if (prev_type == FLAMINGO_VAL_KIND_FN && var != NULL) {
-		return error(flamingo, "cannot assign to %s '%.*s'", val_role_str(val), (int) lhs_size, lhs);
+	if (assignment->var->val == left && left->ref_count == 2 && binary_expr_append(left, right)) {
+		val_decref(left);
+		val_decref(right);
+
+		return 0;
 	}
 
-	flamingo_val_t* rhs = NULL;
+	imm_t res;
 
-	if (parse_expr(flamingo, right_node, &rhs, NULL) < 0) {
+	if (binary_expr_eval(flamingo, node, imm_from_val(left), imm_from_val(right), &res) < 0) {
 		return -1;
 	}
 
-	if (rhs->kind != prev_type && (prev_type != FLAMINGO_VAL_KIND_NONE && rhs->kind != FLAMINGO_VAL_KIND_NONE)) {
-		val_decref(rhs);
+	return assignment_finish(flamingo, assignment, res);
+}
 
-		if (slot != NULL) {
-			val_decref(val);
+static int parse_assignment(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_ASSIGNMENT);
+
+	// Get RHS expression.
+
+	ast_node_t const* const right_node = ast_node(flamingo->ast, node->assignment.right);
+
+	// Get LHS identifier, access, or index.
+
+	ast_node_t const* const left_node = ast_node(flamingo->ast, node->assignment.left);
+
+	assignment_t assignment = {
+		.lhs = flamingo->src + left_node->start,
+		.lhs_size = left_node->end - left_node->start,
+	};
+
+	// Make sure identifier is already in scope (or a previous one).
+
+	if (left_node->kind == AST_KIND_IDENTIFIER) {
+		assignment.var = env_find_var_at(flamingo->env, left_node->identifier.depth, left_node->identifier.slot, symbol_of(flamingo, left_node), assignment.lhs_size);
+
+		if (assignment.var == NULL) {
+			return error(flamingo, "'%.*s' was never declared", (int) assignment.lhs_size, assignment.lhs);
 		}
 
-		return error(flamingo, "cannot assign %s to '%.*s' (%s)", val_type_str(rhs), (int) lhs_size, lhs, prev_type_str);
+		assignment.val = assignment.var->val;
 	}
 
-	if (var != NULL) {
-		val_decref(var->val);
-		var_set_val(var, rhs);
+	else if (left_node->kind == AST_KIND_ACCESS) {
+		flamingo_val_t* accessed_val = NULL;
+
+		if (access_find_var(flamingo, left_node, &assignment.var, &accessed_val) < 0) {
+			return -1;
+		}
+
+		assignment.val = assignment.var->val;
 	}
 
 	else {
-		assert(slot != NULL);
+		assert(left_node->kind == AST_KIND_INDEX);
 
-		val_decref(*slot);
-		*slot = rhs;
+		if (parse_index(flamingo, left_node, &assignment.val, &assignment.slot, true) < 0) {
+			return -1;
+		}
+	}
 
-		val_decref(val);
+	if (assignment_check_lhs(flamingo, &assignment) < 0) {
+		return -1;
 	}
 
-	return 0;
+	// Parse RHS expression.
+	// If it adds something to the variable being assigned to, evaluate its operands ourselves so that can be done in-place.
+
+	if (node->assignment.self_add) {
+		flamingo_val_t* left = NULL;
+		flamingo_val_t* right = NULL;
+
+		if (parse_expr(flamingo, ast_node(flamingo->ast, right_node->binary_expr.left), &left, NULL) < 0) {
+			return -1;
+		}
+
+		if (parse_expr(flamingo, ast_node(flamingo->ast, right_node->binary_expr.right), &right, NULL) < 0) {
+			val_decref(left);
+			return -1;
+		}
+
+		return assignment_add(flamingo, &assignment, right_node, left, right);
+	}
+
+	imm_t rhs;
+
+	if (parse_expr_imm(flamingo, right_node, &rhs) < 0) {
+		return -1;
+	}
+
+	return assignment_finish(flamingo, &assignment, rhs);
 }
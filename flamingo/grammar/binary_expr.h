@@ -6,307 +6,248 @@
 #include "expr.h"
 
 #include "../common.h"
+#include "../imm.h"
 #include "../val.h"
 
 #include <math.h>
 
-static bool equality(char const* op, size_t op_size, flamingo_val_t* left_val, flamingo_val_t* right_val, flamingo_val_t** val) {
-	if (strncmp(op, "==", op_size) == 0) {
-		(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-		(*val)->boolean.boolean = val_eq(left_val, right_val);
-		return true;
-	}
-
-	if (strncmp(op, "!=", op_size) == 0) {
-		(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-		(*val)->boolean.boolean = !val_eq(left_val, right_val);
-		return true;
-	}
-
-	return false;
-}
-
-static int parse_binary_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "binary_expression") == 0);
-	assert(ts_node_named_child_count(node) == 3);
-
-	// Get left operand.
-
-	TSNode const left = ts_node_child_by_field_name(node, "left", 4);
-	char const* const left_type = ts_node_type(left);
-
-	if (strcmp(left_type, "expression") != 0) {
-		return error(flamingo, "expected expression for left operand, got %s", left_type);
-	}
-
-	// Get right operand.
-
-	TSNode const right = ts_node_child_by_field_name(node, "right", 5);
-	char const* const right_type = ts_node_type(right);
-
-	if (strcmp(right_type, "expression") != 0) {
-		return error(flamingo, "expected expression for right operand, got %s", right_type);
-	}
-
-	// Get operator.
-	// XXX Calling this all 'op_*' because clang-format thinks 'operator' is the C++ keyword and so is annoying with it.
-
-	TSNode const op_node = ts_node_child_by_field_name(node, "operator", 8);
-	char const* const op_type = ts_node_type(op_node);
+// Apply a binary operator to two already evaluated operands.
+// This takes ownership of both operands.
+// Nones, booleans, and integers are worked out without ever being boxed, so only operations on strings, vectors, and maps allocate a value for their result.
 
-	if (strstr("operator", op_type) != NULL) { // XXX Yes, I'm being lazy.
-		return error(flamingo, "expected operator, got %s", op_type);
-	}
-
-	size_t const start = ts_node_start_byte(op_node);
-	size_t const end = ts_node_end_byte(op_node);
-
-	char const* const op = flamingo->src + start;
-	size_t const op_size = end - start;
-
-	// Parse operands.
-
-	flamingo_val_t* left_val = NULL;
-
-	if (parse_expr(flamingo, left, &left_val, NULL) != 0) {
-		return -1;
-	}
-
-	flamingo_val_t* right_val = NULL;
-
-	if (parse_expr(flamingo, right, &right_val, NULL) != 0) {
-		return -1;
-	}
+static int binary_expr_eval(flamingo_t* flamingo, ast_node_t const* node, imm_t left, imm_t right, imm_t* res) {
+	assert(node->kind == AST_KIND_BINARY_EXPR);
+	ast_op_t const op = node->binary_expr.op;
 
 	// Check if the operands are compatible.
 
-	bool const same_types = left_val->kind == right_val->kind;
-	bool const none_comparison = left_val->kind == FLAMINGO_VAL_KIND_NONE || right_val->kind == FLAMINGO_VAL_KIND_NONE;
+	bool const same_types = left.kind == right.kind;
+	bool const none_comparison = left.kind == FLAMINGO_VAL_KIND_NONE || right.kind == FLAMINGO_VAL_KIND_NONE;
 
 	if (!same_types && !none_comparison) {
-		return error(flamingo, "operands have incompatible types: %s and %s", val_type_str(left_val), val_type_str(right_val));
+		return error(flamingo, "operands have incompatible types: %s and %s", imm_type_str(left), imm_type_str(right));
 	}
 
-	flamingo_val_kind_t const kind = left_val->kind; // Same as 'right_val->kind' by this point.
+	flamingo_val_kind_t const kind = left.kind; // Same as 'right.kind' by this point.
 
-	// Allocate our value.
 	// We can stop here if we discard the result, as we've already evaluated our operand expressions (which we need to do as they might modify state).
 	// TODO It would be nice to find a way to check the operands are compatible with the operator before this point so we get errors. Though I don't think this is the only place where we're not doing this correctly so this might be a difficult change to make.
 
-	if (val == NULL) {
+	if (res == NULL) {
 		goto done;
 	}
 
-	assert(*val == NULL);
-	*val = val_alloc();
-
 	// Do the math.
 
 	if (none_comparison) {
-		(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-
-		if (strncmp(op, "==", op_size) == 0) {
-			(*val)->boolean.boolean = same_types;
+		switch (op) {
+		case AST_OP_EQ:
+			*res = imm_bool(same_types);
 			goto done;
-		}
-
-		if (strncmp(op, "!=", op_size) == 0) {
-			(*val)->boolean.boolean = !same_types;
+		case AST_OP_NE:
+			*res = imm_bool(!same_types);
 			goto done;
+		default:
+			return error(flamingo, "can only check for equality to none value");
 		}
-
-		return error(flamingo, "can only check for equality to none value");
 	}
 
-	if (kind == FLAMINGO_VAL_KIND_INT) {
+	// Dispatch on the kind of the operands first, and then on the operator.
+	// Every other kind of operand than these is boxed.
+
+	flamingo_val_t* const left_val = left.boxed;
+	flamingo_val_t* const right_val = right.boxed;
+
+	switch (kind) {
+	case FLAMINGO_VAL_KIND_INT: {
+		int64_t const l = imm_integer(left);
+		int64_t const r = imm_integer(right);
+
+		switch (op) {
 		// Integer arithmetic.
 
-		if (strncmp(op, "+", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = left_val->integer.integer + right_val->integer.integer;
+		case AST_OP_ADD:
+			*res = imm_int(l + r);
 			goto done;
-		}
-
-		if (strncmp(op, "-", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = left_val->integer.integer - right_val->integer.integer;
+		case AST_OP_SUB:
+			*res = imm_int(l - r);
 			goto done;
-		}
-
-		if (strncmp(op, "*", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = left_val->integer.integer * right_val->integer.integer;
+		case AST_OP_MUL:
+			*res = imm_int(l * r);
 			goto done;
-		}
-
-		if (strncmp(op, "/", op_size) == 0) {
-			if (right_val->integer.integer == 0) {
+		case AST_OP_DIV:
+			if (r == 0) {
 				return error(flamingo, "division by zero");
 			}
 
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = left_val->integer.integer / right_val->integer.integer;
+			*res = imm_int(l / r);
 			goto done;
-		}
-
-		if (strncmp(op, "%", op_size) == 0) {
-			if (right_val->integer.integer == 0) {
+		case AST_OP_MOD:
+			if (r == 0) {
 				return error(flamingo, "modulo by zero");
 			}
 
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = left_val->integer.integer % right_val->integer.integer;
+			*res = imm_int(l % r);
 			goto done;
-		}
-
-		if (strncmp(op, "**", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = pow(left_val->integer.integer, right_val->integer.integer);
+		case AST_OP_POW:
+			*res = imm_int(pow(l, r));
 			goto done;
-		}
 
 		// Comparisons.
 
-		if (equality(op, op_size, left_val, right_val, val)) {
+		case AST_OP_EQ:
+			*res = imm_bool(l == r);
 			goto done;
-		}
-
-		if (strncmp(op, "<", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->integer.integer < right_val->integer.integer;
+		case AST_OP_NE:
+			*res = imm_bool(l != r);
 			goto done;
-		}
-
-		if (strncmp(op, "<=", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->integer.integer <= right_val->integer.integer;
+		case AST_OP_LT:
+			*res = imm_bool(l < r);
 			goto done;
-		}
-
-		if (strncmp(op, ">", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->integer.integer > right_val->integer.integer;
+		case AST_OP_LE:
+			*res = imm_bool(l <= r);
 			goto done;
-		}
-
-		if (strncmp(op, ">=", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->integer.integer >= right_val->integer.integer;
+		case AST_OP_GT:
+			*res = imm_bool(l > r);
+			goto done;
+		case AST_OP_GE:
+			*res = imm_bool(l >= r);
 			goto done;
+		default:
+			break;
 		}
+
+		break;
 	}
+	case FLAMINGO_VAL_KIND_BOOL: {
+		bool const l = imm_boolean(left);
+		bool const r = imm_boolean(right);
 
-	if (kind == FLAMINGO_VAL_KIND_BOOL) {
+		switch (op) {
 		// Logical operators.
 
-		if (strncmp(op, "&&", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->boolean.boolean && right_val->boolean.boolean;
+		case AST_OP_AND:
+			*res = imm_bool(l && r);
 			goto done;
-		}
-
-		if (strncmp(op, "||", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = left_val->boolean.boolean || right_val->boolean.boolean;
+		case AST_OP_OR:
+			*res = imm_bool(l || r);
 			goto done;
-		}
-
-		if (strncmp(op, "^^", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = (!!left_val->boolean.boolean) ^ (!!right_val->boolean.boolean);
+		case AST_OP_XOR:
+		case AST_OP_NE:
+			*res = imm_bool(l != r);
 			goto done;
-		}
-
-		if (equality(op, op_size, left_val, right_val, val)) {
+		case AST_OP_EQ:
+			*res = imm_bool(l == r);
 			goto done;
+		default:
+			break;
 		}
-	}
 
-	if (kind == FLAMINGO_VAL_KIND_STR) {
+		break;
+	}
+	case FLAMINGO_VAL_KIND_STR:
+		switch (op) {
 		// String concatenation.
 		// TODO Multiplication (but then I need to rethink the whole operands having to have the same type thing). (For vectors too.)
 
-		if (strncmp(op, "+", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_STR;
+		case AST_OP_ADD: {
+			flamingo_val_t* const val = val_alloc(flamingo->pool);
+			val->kind = FLAMINGO_VAL_KIND_STR;
 
-			(*val)->str.size = left_val->str.size + right_val->str.size;
-			(*val)->str.str = malloc((*val)->str.size * sizeof *(*val)->str.str);
-			assert((*val)->str.str != NULL);
-
-			memcpy((*val)->str.str, left_val->str.str, left_val->str.size);
-			memcpy((*val)->str.str + left_val->str.size, right_val->str.str, right_val->str.size);
+			str_concat(val, left_val, right_val);
 
+			*res = imm_from_val(val);
 			goto done;
 		}
 
-		if (equality(op, op_size, left_val, right_val, val)) {
+		// Comparisons.
+		// String constants are shared, so the operands often are the very same value.
+
+		case AST_OP_EQ:
+		case AST_OP_NE: {
+			bool const eq = left_val == right_val || (left_val->str.size == right_val->str.size && memcmp(left_val->str.str, right_val->str.str, left_val->str.size) == 0);
+			*res = imm_bool(op == AST_OP_EQ ? eq : !eq);
+
 			goto done;
 		}
-	}
+		default:
+			break;
+		}
 
-	if (kind == FLAMINGO_VAL_KIND_VEC) {
+		break;
+	case FLAMINGO_VAL_KIND_VEC:
+		switch (op) {
 		// Vector concatenation.
 
-		if (strncmp(op, "+", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_VEC;
+		case AST_OP_ADD: {
+			flamingo_val_t* const val = val_alloc(flamingo->pool);
+			val->kind = FLAMINGO_VAL_KIND_VEC;
 
-			(*val)->vec.count = left_val->vec.count + right_val->vec.count;
-			(*val)->vec.elems = malloc((*val)->vec.count * sizeof *(*val)->vec.elems);
-			assert((*val)->vec.elems != NULL);
+			val->vec.count = left_val->vec.count + right_val->vec.count;
+			val->vec.capacity = val->vec.count;
+			val->vec.elems = malloc(val->vec.count * sizeof *val->vec.elems);
+			assert(val->vec.elems != NULL);
 
 			// Copy all the elements from the left vector.
 
 			for (size_t i = 0; i < left_val->vec.count; i++) {
-				(*val)->vec.elems[i] = val_copy(left_val->vec.elems[i]);
+				val->vec.elems[i] = val_copy(left_val->vec.elems[i]);
 			}
 
 			// Copy all the elements from the right vector.
 
-			for (size_t i = left_val->vec.count; i < (*val)->vec.count; i++) {
-				(*val)->vec.elems[i] = val_copy(right_val->vec.elems[i - left_val->vec.count]);
+			for (size_t i = left_val->vec.count; i < val->vec.count; i++) {
+				val->vec.elems[i] = val_copy(right_val->vec.elems[i - left_val->vec.count]);
 			}
 
+			*res = imm_from_val(val);
 			goto done;
 		}
-
-		if (equality(op, op_size, left_val, right_val, val)) {
-			goto done;
+		default:
+			break;
 		}
-	}
 
-	if (kind == FLAMINGO_VAL_KIND_MAP) {
+		break;
+	case FLAMINGO_VAL_KIND_MAP:
+		switch (op) {
 		// Map concatenation.
 		// TODO There's a small issue here: how to handle different values for the same key when adding? Should there be a preference to keep either the left or the right side? Is that too much of a "quirk" to be something I wanna do? Should this ability just be removed entirely?
 
-		if (strncmp(op, "+", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_MAP;
-
-			(*val)->map.count = left_val->map.count + right_val->map.count;
-
-			(*val)->map.keys = malloc((*val)->map.count * sizeof *(*val)->map.keys);
-			assert((*val)->map.keys != NULL);
+		case AST_OP_ADD: {
+			flamingo_val_t* const val = val_alloc(flamingo->pool);
+			val->kind = FLAMINGO_VAL_KIND_MAP;
 
-			(*val)->map.vals = malloc((*val)->map.count * sizeof *(*val)->map.vals);
-			assert((*val)->map.vals != NULL);
+			map_reserve(val, left_val->map.count + right_val->map.count);
 
-			// Copy all key-value pairs from the left vector.
+			// Copy all key-value pairs from the left map, and then from the right map.
 
 			for (size_t i = 0; i < left_val->map.count; i++) {
-				(*val)->map.keys[i] = val_copy(left_val->map.keys[i]);
-				(*val)->map.vals[i] = val_copy(left_val->map.vals[i]);
+				map_insert(val, val_copy(left_val->map.keys[i]), val_copy(left_val->map.vals[i]));
 			}
 
-			// Copy all key-value pairs from the right vector.
-
-			for (size_t i = left_val->map.count; i < (*val)->map.count; i++) {
-				(*val)->map.keys[i] = val_copy(right_val->map.keys[i - left_val->map.count]);
-				(*val)->map.vals[i] = val_copy(right_val->map.vals[i - left_val->map.count]);
+			for (size_t i = 0; i < right_val->map.count; i++) {
+				map_insert(val, val_copy(right_val->map.keys[i]), val_copy(right_val->map.vals[i]));
 			}
 
+			*res = imm_from_val(val);
 			goto done;
 		}
+		default:
+			break;
+		}
+
+		break;
+	default:
+		break;
+	}
+
+	// Vectors and maps are compared deeply.
+
+	if (kind == FLAMINGO_VAL_KIND_VEC || kind == FLAMINGO_VAL_KIND_MAP) {
+		if (op == AST_OP_EQ || op == AST_OP_NE) {
+			bool const eq = val_eq(left_val, right_val);
+			*res = imm_bool(op == AST_OP_EQ ? eq : !eq);
 
-		if (equality(op, op_size, left_val, right_val, val)) {
 			goto done;
 		}
 	}
@@ -314,12 +255,122 @@ static int parse_binary_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t**
 	// XXX We don't actually need to decref if there's an error, as the flamingo engine will anyway be entirely freed.
 	//     This is robust w.r.t. failures in imported flamingo engines, since we fail if the imported program fails (so the scope is freed instantly).
 
-	return error(flamingo, "unknown operator '%.*s' for type %s", (int) op_size, op, val_type_str(left_val));
+	return error(flamingo, "unknown operator '%.*s' for type %s", (int) node->binary_expr.op_size, flamingo->src + node->binary_expr.op_start, imm_type_str(left));
 
 done:
 
-	val_decref(left_val);
-	val_decref(right_val);
+	imm_free(left);
+	imm_free(right);
+
+	return 0;
+}
+
+// Operands are evaluated lazily: once the left operand has been evaluated, this checks if the operator even needs the right one.
+// '&&' and '||' short-circuit, so that e.g. 'cheap() && expensive()' only calls 'expensive' if 'cheap' returned true.
+// If the right operand isn't needed, this takes ownership of the left operand, sets the result (unless it's discarded), and returns true.
+// Otherwise, the left operand is left alone and both operands are passed on to 'binary_expr_eval' as usual.
+
+static bool binary_expr_short_circuit(ast_node_t const* node, imm_t left, imm_t* res) {
+	assert(node->kind == AST_KIND_BINARY_EXPR);
+
+	if (left.kind != FLAMINGO_VAL_KIND_BOOL) {
+		return false;
+	}
+
+	bool const l = imm_boolean(left);
+	ast_op_t const op = node->binary_expr.op;
+
+	bool const decided = (op == AST_OP_AND && !l) || (op == AST_OP_OR && l);
+
+	if (!decided) {
+		return false;
+	}
+
+	if (res != NULL) {
+		*res = imm_bool(l);
+	}
+
+	imm_free(left);
+	return true;
+}
+
+// Add an already evaluated right operand to a string, vector, or map in-place, like 'left + right' would without making a new value.
+// Returns false if the operands can't be added together like that, in which case neither is touched.
+// This doesn't take ownership of either operand.
+
+static bool binary_expr_append(flamingo_val_t* left, flamingo_val_t* right) {
+	if (left->kind != right->kind) {
+		return false;
+	}
+
+	switch (left->kind) {
+	case FLAMINGO_VAL_KIND_STR:
+		str_append(left, right);
+		return true;
+	case FLAMINGO_VAL_KIND_VEC:
+		val_detach(left);
+
+		for (size_t i = 0; i < right->vec.count; i++) {
+			vec_push_elem(left, val_copy(right->vec.elems[i]));
+		}
+
+		return true;
+	case FLAMINGO_VAL_KIND_MAP:
+		val_detach(left);
+
+		for (size_t i = 0; i < right->map.count; i++) {
+			map_insert(left, val_copy(right->map.keys[i]), val_copy(right->map.vals[i]));
+		}
+
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int parse_binary_expr_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res) {
+	assert(node->kind == AST_KIND_BINARY_EXPR);
+
+	// Get operands.
+
+	ast_node_t const* const left = ast_node(flamingo->ast, node->binary_expr.left);
+	ast_node_t const* const right = ast_node(flamingo->ast, node->binary_expr.right);
+
+	// Parse operands.
+	// These are evaluated to immediates too, so that nested arithmetic doesn't box any of its intermediate results.
+
+	imm_t left_imm;
+
+	if (parse_expr_imm(flamingo, left, &left_imm) != 0) {
+		return -1;
+	}
+
+	if (binary_expr_short_circuit(node, left_imm, res)) {
+		return 0;
+	}
+
+	imm_t right_imm;
+
+	if (parse_expr_imm(flamingo, right, &right_imm) != 0) {
+		return -1;
+	}
+
+	return binary_expr_eval(flamingo, node, left_imm, right_imm, res);
+}
+
+static int parse_binary_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	if (val == NULL) {
+		return parse_binary_expr_imm(flamingo, node, NULL);
+	}
+
+	imm_t res;
+
+	if (parse_binary_expr_imm(flamingo, node, &res) < 0) {
+		return -1;
+	}
+
+	assert(*val == NULL);
+	*val = imm_box(flamingo, res);
 
 	return 0;
 }
@@ -8,14 +8,13 @@
 #include "../common.h"
 #include "../env.h"
 
-static int parse_block(flamingo_t* flamingo, TSNode node, flamingo_scope_t** inner_scope) {
-	assert(strcmp(ts_node_type(node), "block") == 0);
+static int parse_block(flamingo_t* flamingo, ast_node_t const* node, flamingo_scope_t** inner_scope) {
+	assert(node->kind == AST_KIND_BLOCK);
 
 	env_push_scope(flamingo->env);
-	size_t const n = ts_node_named_child_count(node);
 
-	for (size_t i = 0; i < n; i++) {
-		TSNode const child = ts_node_named_child(node, i);
+	for (size_t i = 0; i < node->block.stmts.count; i++) {
+		ast_node_t const* const child = ast_list_node(flamingo->ast, node->block.stmts, i);
 
 		if (parse_statement(flamingo, child) < 0) {
 			return -1;
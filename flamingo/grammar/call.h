@@ -6,37 +6,20 @@
 
 #include "../call.h"
 #include "../common.h"
+#include "../stack.h"
 
 #include "expr.h"
 
-static int parse_call(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "call") == 0);
-	assert(ts_node_child_count(node) == 3 || ts_node_child_count(node) == 4);
+// Evaluate a call expression.
+// If it's in tail position, the call is deferred until the current function has returned when possible (see 'call_defer').
 
-	// Get callable expression.
-
-	TSNode const callable_node = ts_node_child_by_field_name(node, "callable", 8);
-	char const* const callable_type = ts_node_type(callable_node);
-
-	if (strcmp(callable_type, "expression") != 0) {
-		return error(flamingo, "expected identifier for callable name, got %s", callable_type);
-	}
-
-	// Get arguments.
-
-	TSNode const args = ts_node_child_by_field_name(node, "args", 4);
-	bool const has_args = !ts_node_is_null(args);
-
-	if (has_args) {
-		char const* const args_type = ts_node_type(args);
-
-		if (strcmp(args_type, "arg_list") != 0) {
-			return error(flamingo, "expected arg_list for parameters, got %s", args_type);
-		}
-	}
+static int call_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, bool tail) {
+	assert(node->kind == AST_KIND_CALL);
 
 	// Evaluate callable expression.
 
+	ast_node_t const* const callable_node = ast_node(flamingo->ast, node->call.callable);
+
 	flamingo_val_t* callable = NULL;
 	flamingo_val_t* accessed_val = NULL;
 
@@ -49,50 +32,49 @@ static int parse_call(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
 	}
 
 	// Evaluate arguments.
+	// They're kept in a frame on the evaluation stack rather than on the C stack, as there's no telling how many there are.
+
+	ast_list_t const args = node->call.args;
 
 	flamingo_arg_list_t arg_list = {
 		.count = 0,
+		.args = stack_push(flamingo, args.count * sizeof *arg_list.args),
 	};
 
-	if (has_args) {
-		arg_list.count = ts_node_named_child_count(args);
-		flamingo_val_t** const arg_vals = alloca(arg_list.count * sizeof *arg_vals);
-		arg_list.args = arg_vals;
-
-		for (size_t i = 0; i < arg_list.count; i++) {
-			// Get argument.
+	int rv = 0;
 
-			TSNode const arg = ts_node_named_child(args, i);
-			char const* const arg_type = ts_node_type(arg);
+	for (; arg_list.count < args.count; arg_list.count++) {
+		flamingo_val_t** const arg = &arg_list.args[arg_list.count];
 
-			if (strcmp(arg_type, "expression") != 0) {
-				return error(flamingo, "expected expression in argument list, got %s", arg_type);
-			}
-
-			// Evaluate argument expression.
-
-			flamingo_val_t* val = NULL;
-
-			if (parse_expr(flamingo, arg, &val, NULL) < 0) {
-				return -1;
-			}
-
-			arg_vals[i] = val;
+		if (parse_expr(flamingo, ast_list_node(flamingo->ast, args, arg_list.count), arg, NULL) < 0) {
+			rv = -1;
+			goto done;
 		}
 	}
 
 	// Actually call.
 
-	int const rv = call(flamingo, callable, accessed_val, val, &arg_list);
+	if (tail && call_can_defer(flamingo, callable)) {
+		call_defer(flamingo, callable, &arg_list);
+	}
+
+	else {
+		rv = call(flamingo, callable, accessed_val, val, &arg_list);
+	}
+
+done:
 
 	val_decref(callable);
 	val_decref(accessed_val);
 
-	if (has_args) {
-		for (size_t i = 0; i < arg_list.count; i++) {
-			val_decref(arg_list.args[i]);
-		}
+	for (size_t i = 0; i < arg_list.count; i++) {
+		val_decref(arg_list.args[i]);
 	}
 
+	stack_pop(flamingo, arg_list.args);
 	return rv;
 }
+
+static int parse_call(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	return call_expr(flamingo, node, val, false);
+}
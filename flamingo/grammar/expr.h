@@ -15,67 +15,69 @@
 #include "unary_expr.h"
 #include "vec.h"
 
-static int parse_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val, flamingo_val_t** accessed_val_ref) {
-	assert(strcmp(ts_node_type(node), "expression") == 0);
-	assert(ts_node_child_count(node) == 1);
-
-	TSNode const child = ts_node_child(node, 0);
-	char const* const type = ts_node_type(child);
+#include "../imm.h"
 
+static int parse_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, flamingo_val_t** accessed_val_ref) {
+	switch (node->kind) {
 	// 'val == NULL' means that we don't care about the result of the expression and can discard it.
 	// These types of expressions are dead-ends if we're discarding the value and they can't have side-effect either, so just don't parse them.
 
-	if (val != NULL && strcmp(type, "literal") == 0) {
-		return parse_literal(flamingo, child, val);
-	}
-
-	if (val != NULL && strcmp(type, "identifier") == 0) {
-		return parse_identifier(flamingo, child, val);
-	}
-
-	if (val != NULL && strcmp(type, "lambda") == 0) {
-		return parse_lambda(flamingo, child, val);
-	}
-
-	if (val != NULL && strcmp(type, "self") == 0) {
-		return parse_self(flamingo, child, val);
-	}
+	case AST_KIND_LITERAL:
+		return val == NULL ? 0 : parse_literal(flamingo, node, val);
+	case AST_KIND_IDENTIFIER:
+		return val == NULL ? 0 : parse_identifier(flamingo, node, val);
+	case AST_KIND_LAMBDA:
+		return val == NULL ? 0 : parse_lambda(flamingo, node, val);
+	case AST_KIND_SELF:
+		return val == NULL ? 0 : parse_self(flamingo, node, val);
 
 	// These expressions could have side-effects, so we need to parse them anyway, even if 'val != NULL'.
 	// A lot of these expressions don't directly produce side-effects, but could need to evaluate an expression which does.
-
-	if (strcmp(type, "vec") == 0) {
-		return parse_vec(flamingo, child, val);
-	}
-
-	if (strcmp(type, "map") == 0) {
-		return parse_map(flamingo, child, val);
-	}
-
-	if (strcmp(type, "call") == 0) {
-		return parse_call(flamingo, child, val);
-	}
-
-	if (strcmp(type, "parenthesized_expression") == 0) {
-		TSNode const grandchild = ts_node_child_by_field_name(child, "expression", 10);
-		return parse_expr(flamingo, grandchild, val, accessed_val_ref);
-	}
-
-	if (strcmp(type, "unary_expression") == 0) {
-		return parse_unary_expr(flamingo, child, val);
+	// Note that parenthesized expressions are collapsed into their inner expression when lowering.
+
+	case AST_KIND_VEC:
+		return parse_vec(flamingo, node, val);
+	case AST_KIND_MAP:
+		return parse_map(flamingo, node, val);
+	case AST_KIND_CALL:
+		return parse_call(flamingo, node, val);
+	case AST_KIND_UNARY_EXPR:
+		return parse_unary_expr(flamingo, node, val);
+	case AST_KIND_BINARY_EXPR:
+		return parse_binary_expr(flamingo, node, val);
+	case AST_KIND_ACCESS:
+		return parse_access(flamingo, node, val, accessed_val_ref);
+	case AST_KIND_INDEX:
+		return parse_index(flamingo, node, val, NULL, false);
+	case AST_KIND_INVALID:
+		return error(flamingo, "%s", ast_str(flamingo->ast, node->invalid.msg));
+	default:
+		return error(flamingo, "unknown expression kind: %d", node->kind);
 	}
+}
 
-	if (strcmp(type, "binary_expression") == 0) {
-		return parse_binary_expr(flamingo, child, val);
+// Like 'parse_expr', but evaluates the expression to an immediate (see 'imm.h').
+// This is what operands and conditions are evaluated with, as their values don't outlive the operation using them.
+
+static int parse_expr_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res) {
+	switch (node->kind) {
+	case AST_KIND_LITERAL:
+		return parse_literal_imm(flamingo, node, res);
+	case AST_KIND_IDENTIFIER:
+		return parse_identifier_imm(flamingo, node, res);
+	case AST_KIND_UNARY_EXPR:
+		return parse_unary_expr_imm(flamingo, node, res);
+	case AST_KIND_BINARY_EXPR:
+		return parse_binary_expr_imm(flamingo, node, res);
+	default: {
+		flamingo_val_t* val = NULL;
+
+		if (parse_expr(flamingo, node, &val, NULL) < 0) {
+			return -1;
+		}
+
+		*res = imm_from_val(val);
+		return 0;
 	}
-
-	if (strcmp(type, "access") == 0) {
-		return parse_access(flamingo, child, val, accessed_val_ref);
 	}
-
-	if (strcmp(type, "index") == 0) {
-		return parse_index(flamingo, child, val, NULL, false);
-	}
-
-	return error(flamingo, "unknown expression type: %s", type);
 }
@@ -7,38 +7,69 @@
 #include "../grammar/expr.h"
 #include "../val.h"
 
-static int parse_for_loop(flamingo_t* flamingo, TSNode node) {
-	// Get current variable name.
+// Get the elements a for loop iterates over.
 
-	TSNode const cur_var_name_node = ts_node_child_by_field_name(node, "cur_var_name", 12);
-	char const* const cur_var_name_type = ts_node_type(cur_var_name_node);
+static int for_loop_iterable(flamingo_t* flamingo, flamingo_val_t* iterator, size_t* count, flamingo_val_t*** elems) {
+	// This is sort of cheating but eh, see the TODO in 'parse_for_loop', this is fine for now.
 
-	if (strcmp(cur_var_name_type, "identifier") != 0) {
-		return error(flamingo, "expected identifier for current variable name, got %s", cur_var_name_type);
+	switch (iterator->kind) {
+	case FLAMINGO_VAL_KIND_VEC:
+		*count = iterator->vec.count;
+		*elems = iterator->vec.elems;
+		break;
+	case FLAMINGO_VAL_KIND_MAP:
+		*count = iterator->map.count;
+		*elems = iterator->map.keys;
+		break;
+	default:
+		return error(flamingo, "expected vector or map for iterable, got %s", val_type_str(iterator));
 	}
 
-	size_t const cur_var_name_start = ts_node_start_byte(cur_var_name_node);
-	size_t const cur_var_name_end = ts_node_end_byte(cur_var_name_node);
+	assert(*elems != NULL);
+	return 0;
+}
 
-	char const* const cur_var_name = flamingo->src + cur_var_name_start;
-	size_t const cur_var_name_size = cur_var_name_end - cur_var_name_start;
+// Get the element of an iterator to run the i'th iteration of a for loop over, or NULL if there's none left.
+// The body may modify the iterator in-place (e.g. pushing to it can move its elements, and clearing it frees them), so they're got again on each iteration.
+// Loops run for at most as many iterations as the iterator had elements when they started, and stop early if it shrinks.
 
-	// Get iterator.
+static flamingo_val_t* for_loop_elem(flamingo_t* flamingo, flamingo_val_t* iterator, size_t count, size_t i) {
+	size_t cur_count;
+	flamingo_val_t** elems;
 
-	TSNode const iterator_node = ts_node_child_by_field_name(node, "iterator", 8);
-	char const* const iterator_type = ts_node_type(iterator_node);
+	// The iterator was already checked when starting the loop, and values never change kind in-place.
 
-	if (strcmp(iterator_type, "expression") != 0) {
-		return error(flamingo, "expected expression for iterator, got %s", iterator_type);
+	int const rv = for_loop_iterable(flamingo, iterator, &cur_count, &elems);
+	assert(rv == 0);
+	(void) rv;
+
+	if (i >= count || i >= cur_count) {
+		return NULL;
 	}
 
+	return elems[i];
+}
+
+static int parse_for_loop(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_FOR_LOOP);
+
+	// Get current variable name.
+
+	ast_node_t const* const cur_var_name_node = ast_node(flamingo->ast, node->for_loop.cur_var_name);
+
+	char* const cur_var_name = symbol_of(flamingo, cur_var_name_node);
+	size_t const cur_var_name_size = cur_var_name_node->end - cur_var_name_node->start;
+
+	// Get iterator.
+
+	ast_node_t const* const iterator_node = ast_node(flamingo->ast, node->for_loop.iterator);
+
 	// Get for body.
 
-	TSNode const body_node = ts_node_child_by_field_name(node, "body", 4);
-	char const* const body_type = ts_node_type(body_node);
+	ast_node_t const* const body_node = ast_node(flamingo->ast, node->for_loop.body);
 
-	if (strcmp(body_type, "block") != 0) {
-		return error(flamingo, "expected block for body, got %s", body_type);
+	if (body_node->kind == AST_KIND_INVALID) {
+		return error(flamingo, "%s", ast_str(flamingo->ast, body_node->invalid.msg));
 	}
 
 	// Evaluate iterator.
@@ -50,35 +81,23 @@ static int parse_for_loop(flamingo_t* flamingo, TSNode node) {
 		return -1;
 	}
 
-	// Get iterator count.
-	// This is sort of cheating but eh, see above comment, this is fine for now.
-
 	size_t count;
-	flamingo_val_t** elems = NULL;
+	flamingo_val_t** elems;
 
-	switch (iterator->kind) {
-	case FLAMINGO_VAL_KIND_VEC:
-		count = iterator->vec.count;
-		elems = iterator->vec.elems;
-		break;
-	case FLAMINGO_VAL_KIND_MAP:
-		count = iterator->map.count;
-		elems = iterator->map.keys;
-		break;
-	default:
-		return error(flamingo, "expected vector or map for iterable, got %s", val_type_str(iterator));
+	if (for_loop_iterable(flamingo, iterator, &count, &elems) < 0) {
+		val_decref(iterator);
+		return -1;
 	}
 
-	assert(elems != NULL);
-
 	// Run for loop.
 
 	flamingo->in_loop++;
 	flamingo->breaking = false;
 	flamingo->continuing = false;
 
-	for (size_t i = 0; i < count; i++) {
-		flamingo_val_t* const elem = elems[i];
+	flamingo_val_t* elem;
+
+	for (size_t i = 0; (elem = for_loop_elem(flamingo, iterator, count, i)) != NULL; i++) {
 
 		// Create scope.
 
@@ -87,7 +106,7 @@ static int parse_for_loop(flamingo_t* flamingo, TSNode node) {
 		// Create current variable.
 		// Don't need to check if identifier is already in current scope as we're going to add a scope to the stack anyway (which will shadow any previous identifiers with the same name).
 
-		flamingo_var_t* const cur_var = scope_add_var(scope, cur_var_name, cur_var_name_size);
+		flamingo_var_t* const cur_var = scope_add_symbol_var(scope, cur_var_name, cur_var_name_size);
 		val_incref(elem);
 		cur_var->val = elem;
 
@@ -96,6 +115,7 @@ static int parse_for_loop(flamingo_t* flamingo, TSNode node) {
 		//      That way, the body can't shadow the current variable.
 
 		if (parse_block(flamingo, body_node, NULL) < 0) {
+			val_decref(iterator);
 			return -1;
 		}
 
@@ -11,82 +11,33 @@
 #include "params.h"
 #include "static.h"
 
-static int parse_function_declaration(flamingo_t* flamingo, TSNode node, flamingo_fn_kind_t kind) {
-	size_t const child_count = ts_node_child_count(node);
-	assert(child_count >= 4 || child_count <= 6);
-
-	char const* thing = "unknown";
-
-	switch (kind) {
-	case FLAMINGO_FN_KIND_FUNCTION:
-		thing = "function";
-		break;
-	case FLAMINGO_FN_KIND_CLASS:
-		thing = "class";
-		break;
-	case FLAMINGO_FN_KIND_EXTERN:
-		thing = "external prototype";
-		break;
-	default:
-		assert(false);
-	}
-
-	// Get qualifier list.
-
-	TSNode const qualifiers_node = ts_node_child_by_field_name(node, "qualifiers", 10);
-	bool const has_qualifiers = !ts_node_is_null(qualifiers_node);
-
-	if (has_qualifiers) {
-		char const* const qualifiers_type = ts_node_type(qualifiers_node);
-
-		if (strcmp(qualifiers_type, "qualifier_list") != 0) {
-			return error(flamingo, "expected qualifier_list for qualifiers, got %s", qualifiers_type);
-		}
-	}
+static int parse_function_declaration(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_FUNCTION_DECLARATION);
+	flamingo_fn_kind_t const kind = node->function_declaration.kind;
 
 	// Get function/class name.
+	// The name and qualifiers were already checked when lowering.
 
-	TSNode const name_node = ts_node_child_by_field_name(node, "name", 4);
-	char const* const name_type = ts_node_type(name_node);
-
-	if (strcmp(name_type, "identifier") != 0) {
-		return error(flamingo, "expected identifier for %s name, got %s", thing, name_type);
-	}
-
-	size_t const start = ts_node_start_byte(name_node);
-	size_t const end = ts_node_end_byte(name_node);
+	ast_node_t const* const name_node = ast_node(flamingo->ast, node->function_declaration.name);
 
-	char const* const name = flamingo->src + start;
-	size_t const size = end - start;
+	char* const name = symbol_of(flamingo, name_node);
+	size_t const size = name_node->end - name_node->start;
 
 	// Get function/class parameters.
 
-	TSNode const params = ts_node_child_by_field_name(node, "params", 6);
-	bool const has_params = !ts_node_is_null(params);
+	flamingo_node_t const params = node->function_declaration.params;
 
-	if (has_params) {
-		char const* const params_type = ts_node_type(params);
-
-		if (strcmp(params_type, "param_list") != 0) {
-			return error(flamingo, "expected param_list for parameters, got %s", params_type);
-		}
-
-		if (check_param_types(flamingo, params) < 0) {
-			return -1;
-		}
+	if (params != AST_NULL && check_param_types(flamingo, ast_node(flamingo->ast, params)) < 0) {
+		return -1;
 	}
 
 	// Get function/class body (only for non-prototypes).
 
-	TSNode body;
+	flamingo_node_t const body = node->function_declaration.body;
+	ast_node_t const* const body_node = ast_node(flamingo->ast, body);
 
-	if (kind != FLAMINGO_FN_KIND_EXTERN) {
-		body = ts_node_child_by_field_name(node, "body", 4);
-		char const* const body_type = ts_node_type(body);
-
-		if (strcmp(body_type, "block") != 0) {
-			return error(flamingo, "expected block for body, got %s", body_type);
-		}
+	if (kind != FLAMINGO_FN_KIND_EXTERN && body_node->kind == AST_KIND_INVALID) {
+		return error(flamingo, "%s", ast_str(flamingo->ast, body_node->invalid.msg));
 	}
 
 	// Check if identifier is already in current scope (shallow search) and error if it is.
@@ -102,49 +53,40 @@ static int parse_function_declaration(flamingo_t* flamingo, TSNode node, flaming
 
 	// Add function/class to scope.
 
-	flamingo_var_t* const var = scope_add_var(cur_scope, name, size);
-	var->is_static = check_is_static(flamingo, node);
+	flamingo_var_t* const var = scope_add_symbol_var(cur_scope, name, size);
+	var->is_static = node->function_declaration.is_static;
 
-	var_set_val(var, val_alloc());
+	var_set_val(var, val_alloc(flamingo->pool));
 
 	var->val->kind = FLAMINGO_VAL_KIND_FN;
 	var->val->owner = cur_scope;
 
 	var->val->fn.kind = kind;
 	var->val->fn.env = env_close_over(flamingo->env);
-	var->val->fn.params = NULL;
-
-	if (has_params) {
-		var->val->fn.params = malloc(sizeof params);
-		assert(var->val->fn.params != NULL);
-		memcpy(var->val->fn.params, &params, sizeof params);
-	}
+	var->val->fn.call_desc = node->function_declaration.call_desc;
 
 	// Assign body node.
 	// Prototypes by definition don't have bodies.
 
-	if (kind != FLAMINGO_FN_KIND_EXTERN) {
-		var->val->fn.body = malloc(sizeof body);
-		assert(var->val->fn.body != NULL);
-		memcpy(var->val->fn.body, &body, sizeof body);
-	}
+	var->val->fn.body = kind == FLAMINGO_FN_KIND_EXTERN ? AST_NULL : body;
 
 	// If class, create static environment and look for any static members.
 
 	if (kind == FLAMINGO_FN_KIND_CLASS) {
-		flamingo_scope_t* const scope = scope_alloc();
+		flamingo_scope_t* const scope = scope_alloc(flamingo->pool);
 
 		var->val->fn.scope = scope;
 		scope->owner = var->val;
 
-		if (find_static_members_in_class(flamingo, scope, body) < 0) {
+		if (find_static_members_in_class(flamingo, scope, body_node) < 0) {
 			return -1;
 		}
 	}
 
-	// Since I want 'flamingo.h' to be usable without importing all of Tree-sitter, 'var->val->fn.body' can't just be a 'TSNode'.
-	// Thus, since only this file knows about the size of 'TSNode', we must dynamically allocate this on the heap.
+	// Nodes are just indices into the AST, so we need to remember which AST (and source) they belong to.
 
+	var->val->fn.ast = flamingo->ast;
+	var->val->fn.consts = flamingo->consts;
 	var->val->fn.src = flamingo->src;
 	var->val->fn.src_size = flamingo->src_size;
 
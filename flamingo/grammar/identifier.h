@@ -5,26 +5,46 @@
 
 #include "../common.h"
 #include "../env.h"
+#include "../imm.h"
 #include "../val.h"
 
-static int parse_identifier(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "identifier") == 0);
-	assert(ts_node_child_count(node) == 0);
+static int identifier_find_var(flamingo_t* flamingo, ast_node_t const* node, flamingo_var_t** var) {
+	assert(node->kind == AST_KIND_IDENTIFIER);
 
-	size_t const start = ts_node_start_byte(node);
-	size_t const end = ts_node_end_byte(node);
+	char const* const identifier = symbol_of(flamingo, node);
+	size_t const size = node->end - node->start;
 
-	char const* const identifier = flamingo->src + start;
-	size_t const size = end - start;
+	*var = env_find_var_at(flamingo->env, node->identifier.depth, node->identifier.slot, identifier, size);
 
-	flamingo_var_t* const var = env_find_var(flamingo->env, identifier, size);
-
-	if (var == NULL) {
+	if (*var == NULL) {
 		return error(flamingo, "could not find identifier: %.*s", (int) size, identifier);
 	}
 
+	return 0;
+}
+
+static int parse_identifier(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	flamingo_var_t* var;
+
+	if (identifier_find_var(flamingo, node, &var) < 0) {
+		return -1;
+	}
+
 	*val = var->val;
 	val_incref(*val);
 
 	return 0;
 }
+
+// Read a variable as an immediate, which doesn't touch its value's reference count if it's a none, boolean, or integer.
+
+static int parse_identifier_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res) {
+	flamingo_var_t* var;
+
+	if (identifier_find_var(flamingo, node, &var) < 0) {
+		return -1;
+	}
+
+	*res = imm_read_val(var->val);
+	return 0;
+}
@@ -6,18 +6,17 @@
 #include "../common.h"
 
 #include "../env.h"
+#include "../module.h"
 
 #include <errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-static int import(flamingo_t* flamingo, char* path) {
-	// TODO This is really relative to the caller, not the current file.
-	// Should it be relative to the current file though?
-	// If we do it like that, then a.b.c wouldn't be able to import a.b for example.
-	// Maybe we should do it relative to the first file that was parsed, and then relative to the import path when importing non-relatively.
+// Load a module which isn't in the registry yet and run it.
 
+static int import_load(flamingo_t* flamingo, flamingo_module_t* module, char* path) {
 	int rv = 0;
+	uint64_t const load_start = module_now();
 
 	// Read file.
 
@@ -37,37 +36,63 @@ static int import(flamingo_t* flamingo, char* path) {
 		goto err_fopen;
 	}
 
+	// The module holds onto its source, as its program doesn't have its own copy.
+
 	char* const src = malloc(src_size);
 	assert(src != NULL);
 
+	module->src = src;
+
 	if (fread(src, 1, src_size, f) != src_size) {
 		rv = error(flamingo, "failed to import '%s': fread: %s", path, strerror(errno));
 		goto err_fread;
 	}
 
-	// Allocate space for a new flamingo engine and its source on the current instance.
+	// Parse the module, or load it from its cache if we're using one.
 
-	flamingo->import_count++;
+	char* cache = NULL;
 
-	flamingo->imported_flamingos = realloc(flamingo->imported_flamingos, flamingo->import_count * sizeof *flamingo->imported_flamingos);
-	assert(flamingo->imported_flamingos != NULL);
+	if (flamingo->cache) {
+		cache = cache_path(module->path, flamingo->cache_dir);
+	}
 
-	flamingo->imported_srcs = realloc(flamingo->imported_srcs, flamingo->import_count * sizeof *flamingo->imported_srcs);
-	assert(flamingo->imported_srcs != NULL);
+	flamingo_program_t* const program = program_alloc(src, src_size, false, cache);
+	free(cache);
 
-	flamingo->imported_srcs[flamingo->import_count - 1] = src;
-	flamingo_t* const imported_flamingo = &flamingo->imported_flamingos[flamingo->import_count - 1];
+	if (program == NULL) {
+		rv = error(flamingo, "failed to import '%s': failed to parse source", path);
+		goto err_program_alloc;
+	}
+
+	module->stats.cached = program_cached(program);
 
 	// Create new flamingo engine.
 
-	if (flamingo_create(imported_flamingo, flamingo->progname, src, src_size) < 0) {
-		rv = error(flamingo, "failed to import '%s': flamingo_create: %s", path, strerror(errno));
+	flamingo_t* const imported_flamingo = &module->flamingo;
+
+	rv = flamingo_create_from_program(imported_flamingo, flamingo->progname, program);
+	program_decref(program);
+
+	if (rv < 0) {
+		rv = error(flamingo, "failed to import '%s': flamingo_create: %s", path, flamingo_err(imported_flamingo));
 		goto err_flamingo_create;
 	}
 
 	flamingo_register_external_fn_cb(imported_flamingo, flamingo->external_fn_cb, flamingo->external_fn_cb_data);
 	flamingo_register_class_decl_cb(imported_flamingo, flamingo->class_decl_cb, flamingo->class_decl_cb_data);
 	flamingo_register_class_inst_cb(imported_flamingo, flamingo->class_inst_cb, flamingo->class_inst_cb_data);
+	flamingo_set_engine(imported_flamingo, flamingo->engine);
+	flamingo_set_max_depth(imported_flamingo, flamingo->max_depth);
+	flamingo_set_cache(imported_flamingo, flamingo->cache, flamingo->cache_dir);
+
+	// Modules the imported module imports itself go in the same registry.
+
+	imported_flamingo->modules = flamingo->modules;
+	imported_flamingo->inherited_modules = true;
+
+	// The import itself might be nested in calls, which count towards the depth the imported program can go.
+
+	imported_flamingo->depth = flamingo->depth;
 
 	// Set the scope stack for the imported flamingo instance to be the same as ours.
 
@@ -78,19 +103,29 @@ static int import(flamingo_t* flamingo, char* path) {
 
 	// Run the imported program.
 
+	flamingo_scope_t* const scope = env_cur_scope(flamingo->env);
+	size_t const first = scope->vars_size;
+
+	uint64_t const run_start = module_now();
+	module->stats.load_ns = run_start - load_start;
+
 	if (flamingo_run(imported_flamingo) < 0) {
 		rv = error(flamingo, "failed to import '%s': flamingo_run: %s", path, flamingo_err(imported_flamingo));
 		goto err_flamingo_run;
 	}
 
-	// Don't forget to copy back the scope stack, as after a few reallocs the pointers might be different!
+	module->stats.run_ns = module_now() - run_start;
+
+	// The imported instance ran in our environment, so its top-level declarations are already in our current scope.
+	// Remember them for the next time the module is imported.
 
-	assert(flamingo->env->scope_stack_size == imported_flamingo->env->scope_stack_size);
-	flamingo->env = imported_flamingo->env;
+	assert(imported_flamingo->env == flamingo->env);
+	module_export(module, scope, first);
 
 err_flamingo_run:
 err_flamingo_inherit_scope_stack:
 err_flamingo_create:
+err_program_alloc:
 err_fread:
 
 	fclose(f);
@@ -101,107 +136,65 @@ err_stat:
 	return rv;
 }
 
-static int parse_import_path(flamingo_t* flamingo, TSNode node, char** path_ref, size_t* path_len_ref) {
-	assert(strcmp(ts_node_type(node), "import_path") == 0);
-	assert(ts_node_child_count(node) == 1 || ts_node_child_count(node) == 3);
+static int import(flamingo_t* flamingo, char* path) {
+	// TODO This is really relative to the caller, not the current file.
+	// Should it be relative to the current file though?
+	// If we do it like that, then a.b.c wouldn't be able to import a.b for example.
+	// Maybe we should do it relative to the first file that was parsed, and then relative to the import path when importing non-relatively.
 
-	// Get current path component (bit).
+	// Modules are keyed by their canonical path, so that a module imported through different paths is still only loaded once.
 
-	TSNode const bit_node = ts_node_child_by_field_name(node, "bit", 3);
-	char const* const bit_type = ts_node_type(bit_node);
+	char* const canonical = realpath(path, NULL);
 
-	if (strcmp(bit_type, "identifier") != 0) {
-		return error(flamingo, "expected identifier for bit, got %s", bit_type);
+	if (canonical == NULL) {
+		return error(flamingo, "failed to import '%s': realpath: %s", path, strerror(errno));
 	}
 
-	// Get the rest of the path.
-
-	TSNode const rest_node = ts_node_child_by_field_name(node, "rest", 4);
-	bool const has_rest = !ts_node_is_null(rest_node);
+	flamingo_module_t* module = module_find(flamingo->modules, canonical);
 
-	if (has_rest) {
-		char const* const rest_type = ts_node_type(rest_node);
+	if (module != NULL) {
+		free(canonical);
+		module->stats.imports++;
 
-		if (strcmp(rest_type, "import_path") != 0) {
-			return error(flamingo, "expected import_path for rest, got %s", rest_type);
+		switch (module->state) {
+		case MODULE_LOADING:
+			return error(flamingo, "failed to import '%s': circular import", path);
+		case MODULE_FAILED:
+			return error(flamingo, "failed to import '%s': it already failed to load", path);
+		case MODULE_LOADED:
+			return module_bind(flamingo, module);
 		}
 	}
 
-	// Get the actual path component and add it to our path accumulator.
+	// First time this module is imported, so actually load it.
 
-	size_t const start = ts_node_start_byte(bit_node);
-	size_t const end = ts_node_end_byte(bit_node);
+	module = module_add(flamingo, canonical);
+	module->stats.imports = 1;
 
-	char const* const bit = flamingo->src + start;
-	size_t const size = end - start;
-
-	*path_ref = realloc(*path_ref, *path_len_ref + size + 1);
-
-	if (*path_ref == NULL) {
-		free(*path_ref);
-		return error(flamingo, "failed to allocate memory for import path");
-	}
-
-	memcpy(*path_ref + *path_len_ref, bit, size);
-	*path_len_ref += size + 1;
-	(*path_ref)[*path_len_ref - 1] = '/';
-
-	// Recursively parse the rest of the path.
-
-	if (has_rest && parse_import_path(flamingo, rest_node, path_ref, path_len_ref) < 0) {
+	if (import_load(flamingo, module, path) < 0) {
+		module->state = MODULE_FAILED;
 		return -1;
 	}
 
+	module->state = MODULE_LOADED;
 	return 0;
 }
 
-static int parse_import(flamingo_t* flamingo, TSNode node) {
-	assert(strcmp(ts_node_type(node), "import") == 0);
-
-	size_t const child_count = ts_node_child_count(node);
-	assert(child_count == 2 || child_count == 3);
+static int parse_import(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_IMPORT);
 
 	// Is the import relative to the current file?
 	// If so, it means we need to follow the import file relative to the current one.
 	// Otherwise, we'll have to iterate through the import paths to find it.
 
-	TSNode const relative_node = ts_node_child_by_field_name(node, "relative", 8);
-	bool const is_relative = !ts_node_is_null(relative_node);
-
-	// Get the path of the import.
+	bool const is_relative = node->import.is_relative;
 
-	TSNode const path_node = ts_node_child_by_field_name(node, "path", 4);
-	char const* const path_type = ts_node_type(path_node);
+	// The import path was already turned into an actual string path we can use when lowering.
 
-	if (strcmp(path_type, "import_path") != 0) {
-		return error(flamingo, "expected import_path for path, got %s", path_type);
-	}
-
-	// Parse the import path into an actual string path we can use.
-
-	char* path = NULL;
-	size_t path_len = 0;
-
-	if (parse_import_path(flamingo, path_node, &path, &path_len) < 0) {
-		free(path);
-		return -1;
-	}
+	char* import_path = strdup(ast_str(flamingo->ast, node->import.path));
+	assert(import_path != NULL);
 
-	for (size_t i = 0; i < path_len; i++) {
-		if (path[i] == '\0') {
-			free(path);
-			return error(flamingo, "one of the import path components contains a null byte somehow");
-		}
-	}
-
-	char* import_path = NULL;
-	int rv = asprintf(&import_path, "%.*s.fl", (int) path_len - 1, path);
-	free(path);
-
-	if (rv < 0 || import_path == NULL) {
-		assert(rv < 0 && import_path == NULL);
-		return error(flamingo, "failed to allocate memory for import path");
-	}
+	int rv;
 
 	// If is a global import, go through the import paths until we find the file.
 
@@ -8,54 +8,60 @@
 
 #include "../common.h"
 
-static int parse_index(flamingo_t* flamingo, TSNode node, flamingo_val_t** val, flamingo_val_t*** slot, bool lhs) {
-	assert(strcmp(ts_node_type(node), "index") == 0);
+// Where an indexed element is, so it can be assigned to.
+// This holds a reference to the indexed vector or map and the position of the element in it, rather than a pointer to the element itself, as the storage of the container could move in between indexing it and assigning to it (e.g. if the value being assigned is evaluated to a copy of the container, after which it has to be detached again).
 
-	int rv = 0;
-	flamingo_val_t* indexed_val = NULL;
-	flamingo_val_t* index_val = NULL;
-
-	// Get indexed expression.
+struct index_slot_t {
+	flamingo_val_t* container;
+	size_t pos;
+};
 
-	TSNode const indexed_node = ts_node_child_by_field_name(node, "indexed", 7);
-	char const* const indexed_type = ts_node_type(indexed_node);
+// Get a pointer to the element of a slot, detaching its container so that it can be written to.
+// Vectors can be shrunk in-place in between indexing them and assigning to them (e.g. by popping from them in the value being assigned), in which case the element might not be there anymore and NULL is returned.
 
-	if (strcmp(indexed_type, "expression") != 0) {
-		return error(flamingo, "expected expression for indexed, got %s", indexed_type);
-	}
-
-	// Get index expression.
+static flamingo_val_t** index_slot_get(index_slot_t* slot) {
+	flamingo_val_t* const container = slot->container;
+	val_detach(container);
 
-	TSNode const index_node = ts_node_child_by_field_name(node, "index", 5);
-	char const* const index_type = ts_node_type(index_node);
+	if (container->kind == FLAMINGO_VAL_KIND_VEC) {
+		if (slot->pos >= container->vec.count) {
+			return NULL;
+		}
 
-	if (strcmp(index_type, "expression") != 0) {
-		return error(flamingo, "expected expression for index, got %s", index_type);
+		return &container->vec.elems[slot->pos];
 	}
 
-	// Evaluate indexed expression.
-	// Make sure it is indexable in the first place.
+	assert(container->kind == FLAMINGO_VAL_KIND_MAP);
+	assert(slot->pos < container->map.count);
 
-	if (parse_expr(flamingo, indexed_node, &indexed_val, NULL) < 0) {
-		rv = -1;
-		goto cleanup;
-	}
+	return &container->map.vals[slot->pos];
+}
+
+// Make sure an already evaluated value is indexable in the first place.
 
+static int index_check_indexed(flamingo_t* flamingo, flamingo_val_t* indexed_val) {
 	bool const is_vec = indexed_val->kind == FLAMINGO_VAL_KIND_VEC;
 	bool const is_map = indexed_val->kind == FLAMINGO_VAL_KIND_MAP;
 
 	if (!is_vec && !is_map) {
-		rv = error(flamingo, "can only index vectors and maps, got %s", val_type_str(indexed_val));
-		goto cleanup;
+		return error(flamingo, "can only index vectors and maps, got %s", val_type_str(indexed_val));
 	}
 
-	// Evaluate index expression.
-	// Make sure it can be used as an index if indexing a vector.
+	return 0;
+}
 
-	if (parse_expr(flamingo, index_node, &index_val, NULL) < 0) {
-		rv = -1;
-		goto cleanup;
-	}
+// Index an already evaluated (and checked) value with an already evaluated index.
+// This takes ownership of both the indexed value and the index, and if a slot is requested, the reference to the indexed value is moved to it.
+
+static int index_eval(flamingo_t* flamingo, flamingo_val_t* indexed_val, flamingo_val_t* index_val, flamingo_val_t** val, index_slot_t* slot, bool lhs) {
+	int rv = 0;
+
+	bool const is_vec = indexed_val->kind == FLAMINGO_VAL_KIND_VEC;
+	bool const is_map = indexed_val->kind == FLAMINGO_VAL_KIND_MAP;
+
+	assert(is_vec || is_map);
+
+	// Make sure the index can be used as an index if indexing a vector.
 
 	if (is_vec && index_val->kind != FLAMINGO_VAL_KIND_INT) {
 		rv = error(flamingo, "can only use integers as indices, got %s", val_type_str(index_val));
@@ -73,7 +79,7 @@ static int parse_index(flamingo_t* flamingo, TSNode node, flamingo_val_t** val,
 	}
 
 	if (slot != NULL) {
-		*slot = NULL;
+		slot->container = NULL;
 	}
 
 	// Do the indexing operation per indexed type.
@@ -95,76 +101,59 @@ static int parse_index(flamingo_t* flamingo, TSNode node, flamingo_val_t** val,
 
 		// Actually index vector.
 
-		flamingo_val_t** const target_slot = &indexed_elems[index >= 0 ? (size_t) index : (size_t) (indexed_count + index)];
+		size_t const pos = index >= 0 ? (size_t) index : (size_t) (indexed_count + index);
 
 		if (val != NULL) {
-			*val = *target_slot;
+			*val = indexed_elems[pos];
 			val_incref(*val);
 		}
 
 		if (slot != NULL) {
-			*slot = target_slot;
+			slot->container = val_incref(indexed_val);
+			slot->pos = pos;
 		}
 
 		goto cleanup;
 	}
 
 	else if (is_map) {
-		size_t indexed_count = indexed_val->map.count;
-		flamingo_val_t** const indexed_keys = indexed_val->map.keys;
-		flamingo_val_t** const indexed_vals = indexed_val->map.vals;
-
 		// Look for key.
 
-		for (size_t i = 0; i < indexed_count; i++) {
-			flamingo_val_t* const key = indexed_keys[i];
-
-			if (val_eq(key, index_val)) {
-				if (val != NULL) {
-					*val = indexed_vals[i];
-					val_incref(*val);
-				}
+		flamingo_val_t** const found_slot = map_find(indexed_val, index_val);
 
-				if (slot != NULL) {
-					*slot = &indexed_vals[i];
-				}
+		if (found_slot != NULL) {
+			if (val != NULL) {
+				*val = *found_slot;
+				val_incref(*val);
+			}
 
-				goto cleanup;
+			if (slot != NULL) {
+				slot->container = val_incref(indexed_val);
+				slot->pos = found_slot - indexed_val->map.vals;
 			}
+
+			goto cleanup;
 		}
 
 		// No key found.
 		// Create a new value.
 
 		if (val != NULL) {
-			*val = val_alloc();
+			*val = val_alloc(flamingo->pool);
 		}
 
 		// Add that new entry to the map if we're on the LHS.
+		// If a new value was created above, that's the one which goes in the map; otherwise we still need a new none to put there.
 
 		if (lhs) {
-			indexed_count = ++indexed_val->map.count;
-
-			indexed_val->map.keys = realloc(indexed_val->map.keys, indexed_count * sizeof *indexed_val->map.keys);
-			assert(indexed_val->map.keys != NULL);
-
-			indexed_val->map.vals = realloc(indexed_val->map.vals, indexed_count * sizeof *indexed_val->map.vals);
-			assert(indexed_val->map.vals != NULL);
-
-			indexed_val->map.keys[indexed_count - 1] = index_val;
-
-			// If val was created (new NONE), use it. Otherwise we need a new NONE.
-			// But wait, if val was created above, we can use it.
-			// If val was NOT requested (val==NULL), we still need to put something in the map.
-
-			flamingo_val_t* const new_val = val != NULL ? *val : val_alloc();
-			indexed_val->map.vals[indexed_count - 1] = new_val;
+			flamingo_val_t* const new_val = val != NULL ? val_incref(*val) : val_alloc(flamingo->pool);
 
-			val_incref(index_val);
-			val_incref(new_val);
+			val_detach(indexed_val);
+			map_insert(indexed_val, val_incref(index_val), new_val);
 
 			if (slot != NULL) {
-				*slot = &indexed_val->map.vals[indexed_count - 1];
+				slot->container = val_incref(indexed_val);
+				slot->pos = indexed_val->map.count - 1;
 			}
 		}
 
@@ -180,3 +169,36 @@ cleanup:
 
 	return rv;
 }
+
+static int parse_index(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val, index_slot_t* slot, bool lhs) {
+	assert(node->kind == AST_KIND_INDEX);
+
+	flamingo_val_t* indexed_val = NULL;
+	flamingo_val_t* index_val = NULL;
+
+	// Get indexed and index expressions.
+
+	ast_node_t const* const indexed_node = ast_node(flamingo->ast, node->index.indexed);
+	ast_node_t const* const index_node = ast_node(flamingo->ast, node->index.index);
+
+	// Evaluate indexed expression.
+	// Make sure it is indexable in the first place.
+
+	if (parse_expr(flamingo, indexed_node, &indexed_val, NULL) < 0) {
+		return -1;
+	}
+
+	if (index_check_indexed(flamingo, indexed_val) < 0) {
+		val_decref(indexed_val);
+		return -1;
+	}
+
+	// Evaluate index expression.
+
+	if (parse_expr(flamingo, index_node, &index_val, NULL) < 0) {
+		val_decref(indexed_val);
+		return -1;
+	}
+
+	return index_eval(flamingo, indexed_val, index_val, val, slot, lhs);
+}
@@ -4,97 +4,79 @@
 #pragma once
 
 #include "../common.h"
+#include "../imm.h"
 #include "../val.h"
 
-static int parse_literal(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "literal") == 0);
-	assert(ts_node_child_count(node) == 1);
+static int parse_literal_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res) {
+	assert(node->kind == AST_KIND_LITERAL);
 
-	// Don't need to do anything if we're not going to assign it to a value.
+	// Literals were already decoded when lowering.
 
-	if (val == NULL) {
+	switch (node->literal.kind) {
+	case AST_LITERAL_NONE:
+		*res = imm_none();
 		return 0;
-	}
-
-	assert(*val == NULL);
-	*val = val_alloc();
-
-	TSNode const child = ts_node_child(node, 0);
-	char const* const type = ts_node_type(child);
-
-	if (strcmp(type, "none") == 0) {
-		// 'val_alloc' creates a none value for us by default.
+	case AST_LITERAL_BOOL:
+		*res = imm_bool(node->literal.boolean);
 		return 0;
-	}
-
-	if (strcmp(type, "bool") == 0) {
-		(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-		(*val)->boolean.boolean = *(flamingo->src + ts_node_start_byte(child)) == 't';
-
+	case AST_LITERAL_INT:
+		*res = imm_int(node->literal.integer);
 		return 0;
-	}
+	case AST_LITERAL_STR: {
+		// Strings share the value of their constant, which is only created the first time one of its literals is evaluated by this instance.
 
-	// XXX For now, just ints.
-	// Maybe in the future floats will be supported to, in which case there won't be a single "number" node type.
+		ast_const_t const* const constant = &flamingo->ast->consts[node->literal.str.constant];
+		flamingo_const_cache_t* const cache = &flamingo->consts[node->literal.str.constant];
 
-	if (strcmp(type, "number") == 0) {
-		size_t const start = ts_node_start_byte(child);
-		size_t const end = ts_node_end_byte(child);
+		if (cache->val == NULL) {
+			flamingo_val_t* const val = val_alloc(flamingo->pool);
+			val->kind = FLAMINGO_VAL_KIND_STR;
 
-		char const* const number = flamingo->src + start;
-		size_t const size = end - start;
-		assert(size > 0);
+			val->str.size = constant->size;
+			val->str.str = malloc(val->str.size);
 
-		// TODO Should I keep this negative check? Technically, number literals can't have minus signs, and it's only a unary operator.
+			assert(val->str.str != NULL);
+			memcpy(val->str.str, flamingo->src + constant->start, val->str.size);
 
-		bool negative = false;
-
-		if (number[0] == '-') {
-			assert(size > 1); // Can't be just a minus sign.
-			negative = true;
+			cache->val = val;
 		}
 
-		int64_t integer = 0;
-
-		for (size_t i = 0; i < size; i++) {
-			if (number[i] == '_') {
-				continue;
-			}
-
-			if (number[i] < '0' || number[i] > '9') {
-				return error(flamingo, "number literals can only contain decimal digits (got '%c')", number[i]);
-			}
+		*res = imm_from_val(val_incref(cache->val));
+		return 0;
+	}
+	}
 
-			integer *= 10;
-			integer += number[i] - '0';
-		}
+	return error(flamingo, "unknown literal kind: %d", node->literal.kind);
+}
 
-		(*val)->kind = FLAMINGO_VAL_KIND_INT;
-		(*val)->integer.integer = negative ? -integer : integer;
+static int parse_literal(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	// Don't need to do anything if we're not going to assign it to a value.
 
+	if (val == NULL) {
 		return 0;
 	}
 
-	if (strcmp(type, "string") == 0) {
-		(*val)->kind = FLAMINGO_VAL_KIND_STR;
+	imm_t res;
 
-		size_t const start = ts_node_start_byte(child);
-		size_t const end = ts_node_end_byte(child);
+	if (parse_literal_imm(flamingo, node, &res) < 0) {
+		return -1;
+	}
 
-		// XXX remove one from each side as we don't want the quotes
+	assert(*val == NULL);
+	*val = imm_box(flamingo, res);
 
-		(*val)->str.size = end - start - 2;
-		(*val)->str.str = malloc((*val)->str.size);
+	return 0;
+}
 
-		assert((*val)->str.str != NULL);
-		memcpy((*val)->str.str, flamingo->src + start + 1, (*val)->str.size);
+// Drop the references the instance holds to the values of its program's constants, and free its constant cache.
 
-		return 0;
-	}
-
-	if (strcmp(type, "number") == 0) {
-		return error(flamingo, "number literals are not yet supported");
+static void literal_free_consts(flamingo_t* flamingo) {
+	for (size_t i = 0; i < flamingo->ast->const_count; i++) {
+		if (flamingo->consts[i].val != NULL) {
+			val_decref(flamingo->consts[i].val);
+		}
 	}
 
-	return error(flamingo, "unknown literal type: %s", type);
+	free(flamingo->consts);
+	flamingo->consts = NULL;
 }
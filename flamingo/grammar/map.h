@@ -5,59 +5,36 @@
 
 #include "expr.h"
 
-static int parse_map(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "map") == 0);
+static int parse_map(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	assert(node->kind == AST_KIND_MAP);
 
-	size_t const n = ts_node_child_count(node);
+	// Even if the map is going to be discarded, it still has to be built to check for duplicate keys.
 
-	size_t count = 0;
-	flamingo_val_t** keys = NULL;
-	flamingo_val_t** vals = NULL;
+	flamingo_val_t* const map = val_alloc(flamingo->pool);
 
-	for (size_t i = 0; i < n; i++) {
-		TSNode const child = ts_node_child(node, i);
-		char const* const child_type = ts_node_type(child);
+	map->kind = FLAMINGO_VAL_KIND_MAP;
+	map_reserve(map, node->map.items.count / 2);
 
-		if (strcmp(child_type, "map_item") != 0) {
-			continue;
-		}
-
-		TSNode const key_node = ts_node_child_by_field_name(child, "key", 3);
-		TSNode const val_node = ts_node_child_by_field_name(child, "value", 5);
-
-		assert(strcmp(ts_node_type(key_node), "expression") == 0);
-		assert(strcmp(ts_node_type(val_node), "expression") == 0);
-
-		// Make room for a new key-value pair.
-
-		count++;
-
-		keys = realloc(keys, count * sizeof *keys);
-		assert(keys != NULL);
-
-		vals = realloc(vals, count * sizeof *vals);
-		assert(vals != NULL);
+	for (size_t i = 0; i < node->map.items.count; i += 2) {
+		ast_node_t const* const key_node = ast_list_node(flamingo->ast, node->map.items, i);
+		ast_node_t const* const val_node = ast_list_node(flamingo->ast, node->map.items, i + 1);
 
 		// Parse key expression.
 
 		flamingo_val_t* k = NULL;
 
 		if (parse_expr(flamingo, key_node, &k, NULL) < 0) {
-			free(keys);
-			free(vals);
-
+			val_decref(map);
 			return -1;
 		}
 
 		// Make sure key doesn't already exist in map.
 
-		for (size_t j = 0; j < count - 1; j++) {
-			if (val_eq(keys[j], k)) {
-				free(keys);
-				free(vals);
+		if (map_find(map, k) != NULL) {
+			val_decref(k);
+			val_decref(map);
 
-				return error(flamingo, "duplicate key in map");
-			}
+			return error(flamingo, "duplicate key in map");
 		}
 
 		// Parse value expression.
@@ -65,35 +42,22 @@ static int parse_map(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
 		flamingo_val_t* v = NULL;
 
 		if (parse_expr(flamingo, val_node, &v, NULL) < 0) {
-			free(keys);
-			free(vals);
+			val_decref(k);
+			val_decref(map);
 
 			return -1;
 		}
 
-		keys[count - 1] = k;
-		vals[count - 1] = v;
+		map_insert(map, k, v);
 	}
 
 	if (val == NULL) {
-		for (size_t i = 0; i < count; i++) {
-			val_decref(keys[i]);
-			val_decref(vals[i]);
-		}
-
-		free(keys);
-		free(vals);
-
+		val_decref(map);
 		return 0;
 	}
 
 	assert(*val == NULL);
-	*val = val_alloc();
-
-	(*val)->kind = FLAMINGO_VAL_KIND_MAP;
-	(*val)->map.count = count;
-	(*val)->map.keys = keys;
-	(*val)->map.vals = vals;
+	*val = map;
 
 	return 0;
 }
@@ -5,17 +5,13 @@
 
 #include "../common.h"
 
-static inline int check_param_types(flamingo_t* flamingo, TSNode params) {
-	size_t const n = ts_node_named_child_count(params);
+static inline int check_param_types(flamingo_t* flamingo, ast_node_t const* params) {
+	// Anything which wasn't a param was already caught when lowering.
 
-	for (size_t i = 0; i < n; i++) {
-		TSNode const child = ts_node_named_child(params, i);
-		char const* const child_type = ts_node_type(child);
-
-		if (strcmp(child_type, "param") != 0) {
-			return error(flamingo, "expected param in parameter list, got %s", child_type);
-		}
+	if (params->kind == AST_KIND_INVALID) {
+		return error(flamingo, "%s", ast_str(flamingo->ast, params->invalid.msg));
 	}
 
+	assert(params->kind == AST_KIND_PARAM_LIST);
 	return 0;
 }
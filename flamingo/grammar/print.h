@@ -9,15 +9,10 @@
 #include "../repr.h"
 #include "../val.h"
 
-static int parse_print(flamingo_t* flamingo, TSNode node) {
-	assert(ts_node_child_count(node) == 2);
+static int parse_print(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_PRINT);
 
-	TSNode const msg_node = ts_node_child_by_field_name(node, "msg", 3);
-	char const* const type = ts_node_type(msg_node);
-
-	if (strcmp(ts_node_type(msg_node), "expression") != 0) {
-		return error(flamingo, "expected expression for message, got %s", type);
-	}
+	ast_node_t const* const msg_node = ast_node(flamingo->ast, node->print.msg);
 
 	flamingo_val_t* val = NULL;
 
@@ -3,14 +3,18 @@
 
 #pragma once
 
+#include "call.h"
 #include "expr.h"
 
 #include "../common.h"
 #include "../env.h"
 #include "../val.h"
 
-static int parse_return(flamingo_t* flamingo, TSNode node) {
-	assert(ts_node_child_count(node) == 1 || ts_node_child_count(node) == 2);
+// Check that we can return from here, and set the return value straight away if there's no return value expression to evaluate.
+// Returns 1 if there's still a return value expression to evaluate, 0 if not, and -1 on error.
+
+static int return_begin(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_RETURN);
 
 	// Don't allow returns in top level scopes.
 	// Maybe in the future this could serve as an exit kind of thing, but I think I want an explicit 'exit' statement.
@@ -23,22 +27,12 @@ static int parse_return(flamingo_t* flamingo, TSNode node) {
 
 	// Get return value.
 
-	TSNode const rv_node = ts_node_child_by_field_name(node, "rv", 2);
-	bool const has_rv = !ts_node_is_null(rv_node);
-
-	if (has_rv) {
-		if (in_class) {
-			return error(flamingo, "return statement can't take a return value when inside a class scope");
-		}
-
-		char const* const type = ts_node_type(rv_node);
+	bool const has_rv = node->return_.rv != AST_NULL;
 
-		if (strcmp(ts_node_type(rv_node), "expression") != 0) {
-			return error(flamingo, "expected expression for return value, got %s", type);
-		}
+	if (has_rv && in_class) {
+		return error(flamingo, "return statement can't take a return value when inside a class scope");
 	}
 
-	// Parse the return value expression if there is one (none value otherwise).
 	// State of the current function return value should always be clean before this.
 
 	assert(flamingo->cur_fn_rv == NULL);
@@ -48,15 +42,40 @@ static int parse_return(flamingo_t* flamingo, TSNode node) {
 		return 0;
 	}
 
-	if (has_rv) {
-		if (parse_expr(flamingo, rv_node, &flamingo->cur_fn_rv, NULL) < 0) {
+	// Return value is a none value if there is no return value expression.
+
+	if (!has_rv) {
+		flamingo->cur_fn_rv = val_alloc(flamingo->pool);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int parse_return(flamingo_t* flamingo, ast_node_t const* node) {
+	int const rv = return_begin(flamingo, node);
+
+	if (rv <= 0) {
+		return rv;
+	}
+
+	// Parse the return value expression.
+	// This is done into a temporary rather than straight into the current function's return value, as the expression may itself call functions, which set and reset it.
+	// A call in tail position is deferred until the current function has returned if it can be, in which case there's no return value yet.
+
+	ast_node_t const* const rv_node = ast_node(flamingo->ast, node->return_.rv);
+	flamingo_val_t* val = NULL;
+
+	if (rv_node->kind == AST_KIND_CALL) {
+		if (call_expr(flamingo, rv_node, &val, true) < 0) {
 			return -1;
 		}
 	}
 
-	else {
-		flamingo->cur_fn_rv = val_alloc();
+	else if (parse_expr(flamingo, rv_node, &val, NULL) < 0) {
+		return -1;
 	}
 
+	flamingo->cur_fn_rv = flamingo->tail_callable != NULL ? CALL_DEFERRED_RV : val;
 	return 0;
 }
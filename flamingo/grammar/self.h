@@ -7,11 +7,10 @@
 #include "../env.h"
 #include "../val.h"
 
-static int parse_self(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "self") == 0);
-	assert(ts_node_named_child_count(node) == 2);
+static int parse_self(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	assert(node->kind == AST_KIND_SELF);
 
-	flamingo_var_t* const var = env_find_var(flamingo->env, "self", 4);
+	flamingo_var_t* const var = env_find_var_at(flamingo->env, node->identifier.depth, node->identifier.slot, symbol_of(flamingo, node), 4);
 
 	if (var == NULL) {
 		return error(flamingo, "could not find self - are you in a class instance's scope?");
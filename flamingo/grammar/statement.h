@@ -18,12 +18,12 @@
 
 #include "../common.h"
 
-static int parse_statement(flamingo_t* flamingo, TSNode node) {
+static int parse_statement(flamingo_t* flamingo, ast_node_t const* node) {
 	// We should skip this statement if returning, continuing, or breaking.
 
 	bool const is_in_function_and_returning =
-		flamingo->cur_fn_body != NULL && // In function?
-		flamingo->cur_fn_rv != NULL;     // Returning?
+		flamingo->cur_fn_body != AST_NULL && // In function?
+		flamingo->cur_fn_rv != NULL;         // Returning?
 
 	bool const is_in_loop_and_breaking_or_continuing =
 		flamingo->in_loop && (flamingo->breaking || flamingo->continuing);
@@ -32,85 +32,36 @@ static int parse_statement(flamingo_t* flamingo, TSNode node) {
 		return 0;
 	}
 
-	// Line insensitive statements, which are only wrapped by a hidden node.
-
-	char const* const type = ts_node_type(node);
-
-	if (strcmp(type, "\n") == 0 || strcmp(type, ";") == 0) {
-		return 0;
-	}
-
-	if (strcmp(type, "comment") == 0 || strcmp(type, "doc_comment") == 0) {
-		return 0;
-	}
-
-	if (strcmp(type, "block") == 0) {
+	switch (node->kind) {
+	case AST_KIND_BLOCK:
 		return parse_block(flamingo, node, NULL);
-	}
-
-	if (strcmp(type, "function_declaration") == 0) {
-		return parse_function_declaration(flamingo, node, FLAMINGO_FN_KIND_FUNCTION);
-	}
-
-	if (strcmp(type, "class_declaration") == 0) {
-		return parse_function_declaration(flamingo, node, FLAMINGO_FN_KIND_CLASS);
-	}
-
-	if (strcmp(type, "if_chain") == 0) {
+	case AST_KIND_FUNCTION_DECLARATION:
+		return parse_function_declaration(flamingo, node);
+	case AST_KIND_IF_CHAIN:
 		return parse_if_chain(flamingo, node);
-	}
-
-	if (strcmp(type, "for_loop") == 0) {
+	case AST_KIND_FOR_LOOP:
 		return parse_for_loop(flamingo, node);
-	}
-
-	if (strcmp(type, "break") == 0) {
+	case AST_KIND_BREAK:
 		return parse_break(flamingo);
-	}
-
-	if (strcmp(type, "continue") == 0) {
+	case AST_KIND_CONTINUE:
 		return parse_continue(flamingo);
+	case AST_KIND_PRINT:
+		return parse_print(flamingo, node);
+	case AST_KIND_RETURN:
+		return parse_return(flamingo, node);
+	case AST_KIND_ASSERT:
+		return parse_assert(flamingo, node);
+	case AST_KIND_VAR_DECL:
+		return parse_var_decl(flamingo, node);
+	case AST_KIND_ASSIGNMENT:
+		return parse_assignment(flamingo, node);
+	case AST_KIND_EXPR_STATEMENT:
+		return parse_expr(flamingo, ast_node(flamingo->ast, node->expr_statement.expr), NULL, NULL);
+	case AST_KIND_IMPORT:
+		return parse_import(flamingo, node);
+	case AST_KIND_INVALID:
+		return error(flamingo, "%s", ast_str(flamingo->ast, node->invalid.msg));
+	default:
+		return error(flamingo, "unknown statement kind: %d", node->kind);
 	}
-
-	// All the line sensitive statements (which are wrapped by an explicit 'statement' node).
-
-	assert(strcmp(type, "statement") == 0);
-	assert(ts_node_child_count(node) == 1);
-
-	TSNode const child = ts_node_child(node, 0);
-	char const* const child_type = ts_node_type(child);
-
-	if (strcmp(child_type, "print") == 0) {
-		return parse_print(flamingo, child);
-	}
-
-	if (strcmp(child_type, "return") == 0) {
-		return parse_return(flamingo, child);
-	}
-
-	if (strcmp(child_type, "assert") == 0) {
-		return parse_assert(flamingo, child);
-	}
-
-	if (strcmp(child_type, "var_decl") == 0) {
-		return parse_var_decl(flamingo, child);
-	}
-
-	if (strcmp(child_type, "assignment") == 0) {
-		return parse_assignment(flamingo, child);
-	}
-
-	if (strcmp(child_type, "proto") == 0) {
-		return parse_function_declaration(flamingo, child, FLAMINGO_FN_KIND_EXTERN);
-	}
-
-	if (strcmp(child_type, "expression") == 0) {
-		return parse_expr(flamingo, child, NULL, NULL);
-	}
-
-	if (strcmp(child_type, "import") == 0) {
-		return parse_import(flamingo, child);
-	}
-
-	return error(flamingo, "unknown statement type: %s", child_type);
 }
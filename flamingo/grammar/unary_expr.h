@@ -6,83 +6,85 @@
 #include "expr.h"
 
 #include "../common.h"
+#include "../imm.h"
 #include "../val.h"
 
-static int parse_unary_expr(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "unary_expression") == 0);
-	assert(ts_node_named_child_count(node) == 2);
+// Apply a unary operator to an already evaluated operand.
+// This takes ownership of the operand.
 
-	// Get operand.
+static int unary_expr_eval(flamingo_t* flamingo, ast_node_t const* node, imm_t operand, imm_t* res) {
+	assert(node->kind == AST_KIND_UNARY_EXPR);
 
-	TSNode const operand = ts_node_child_by_field_name(node, "operand", 7);
-	char const* const operand_type = ts_node_type(operand);
+	// We can stop here if we discard the result, as we've already evaluated our operand expressions (which we need to do as they might modify state).
 
-	if (strcmp(operand_type, "expression") != 0) {
-		return error(flamingo, "expected expression for operand, got %s", operand_type);
+	if (res == NULL) {
+		goto done;
 	}
 
-	// Get operator.
-	// XXX Calling this all 'op_*' because clang-format thinks 'operator' is the C++ keyword and so is annoying with it.
+	// Do the math.
+
+	switch (node->unary_expr.op) {
+	case AST_OP_NEG:
+		if (operand.kind == FLAMINGO_VAL_KIND_INT) {
+			*res = imm_int(-imm_integer(operand));
+			goto done;
+		}
 
-	TSNode const op_node = ts_node_child_by_field_name(node, "operator", 8);
-	char const* const op_type = ts_node_type(op_node);
+		break;
+	case AST_OP_NOT:
+		if (operand.kind == FLAMINGO_VAL_KIND_BOOL) {
+			*res = imm_bool(!imm_boolean(operand));
+			goto done;
+		}
 
-	if (strcmp(op_type, "unary_operator") != 0) {
-		return error(flamingo, "expected unary_operator, got %s", op_type);
+		break;
+	default:
+		break;
 	}
 
-	size_t const start = ts_node_start_byte(op_node);
-	size_t const end = ts_node_end_byte(op_node);
+	// XXX We don't actually need to decref if there's an error, as the flamingo engine will anyway be entirely freed.
+	//     This is robust w.r.t. failures in imported flamingo engines, since we fail if the imported program fails (so the scope is freed instantly).
 
-	char const* const op = flamingo->src + start;
-	size_t const op_size = end - start;
+	return error(flamingo, "unknown operator '%.*s' for type %s", (int) node->unary_expr.op_size, flamingo->src + node->unary_expr.op_start, imm_type_str(operand));
 
-	// Parse operands.
+done:
 
-	flamingo_val_t* operand_val = NULL;
+	imm_free(operand);
 
-	if (parse_expr(flamingo, operand, &operand_val, NULL) != 0) {
-		return -1;
-	}
+	return 0;
+}
 
-	flamingo_val_kind_t const kind = operand_val->kind;
+static int parse_unary_expr_imm(flamingo_t* flamingo, ast_node_t const* node, imm_t* res) {
+	assert(node->kind == AST_KIND_UNARY_EXPR);
 
-	// Allocate our value.
-	// We can stop here if we discard the result, as we've already evaluated our operand expressions (which we need to do as they might modify state).
+	// Get operand.
 
-	if (val == NULL) {
-		goto done;
-	}
+	ast_node_t const* const operand = ast_node(flamingo->ast, node->unary_expr.operand);
 
-	assert(*val == NULL);
-	*val = val_alloc();
+	// Parse operands.
 
-	// Do the math.
+	imm_t operand_imm;
 
-	if (kind == FLAMINGO_VAL_KIND_INT) {
-		if (strncmp(op, "-", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_INT;
-			(*val)->integer.integer = -operand_val->integer.integer;
-			goto done;
-		}
+	if (parse_expr_imm(flamingo, operand, &operand_imm) != 0) {
+		return -1;
 	}
 
-	if (kind == FLAMINGO_VAL_KIND_BOOL) {
-		if (strncmp(op, "!", op_size) == 0) {
-			(*val)->kind = FLAMINGO_VAL_KIND_BOOL;
-			(*val)->boolean.boolean = !operand_val->boolean.boolean;
-			goto done;
-		}
-	}
+	return unary_expr_eval(flamingo, node, operand_imm, res);
+}
 
-	// XXX We don't actually need to decref if there's an error, as the flamingo engine will anyway be entirely freed.
-	//     This is robust w.r.t. failures in imported flamingo engines, since we fail if the imported program fails (so the scope is freed instantly).
+static int parse_unary_expr(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	if (val == NULL) {
+		return parse_unary_expr_imm(flamingo, node, NULL);
+	}
 
-	return error(flamingo, "unknown operator '%.*s' for type %s", (int) op_size, op, val_type_str(operand_val));
+	imm_t res;
 
-done:
+	if (parse_unary_expr_imm(flamingo, node, &res) < 0) {
+		return -1;
+	}
 
-	val_decref(operand_val);
+	assert(*val == NULL);
+	*val = imm_box(flamingo, res);
 
 	return 0;
 }
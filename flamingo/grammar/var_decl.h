@@ -10,50 +10,18 @@
 #include "../scope.h"
 #include "static.h"
 
-static int parse_var_decl(flamingo_t* flamingo, TSNode node) {
-	size_t const child_count = ts_node_named_child_count(node);
-	assert(child_count >= 1 && child_count <= 3);
+// Add the declared variable to the current scope, without setting its value yet.
 
-	// Get variable name.
-
-	TSNode const name_node = ts_node_child_by_field_name(node, "name", 4);
-	char const* const name_type = ts_node_type(name_node);
-
-	if (strcmp(name_type, "identifier") != 0) {
-		return error(flamingo, "expected identifier for name, got %s", name_type);
-	}
-
-	size_t const start = ts_node_start_byte(name_node);
-	size_t const end = ts_node_end_byte(name_node);
-
-	char const* const name = flamingo->src + start;
-	size_t const name_size = end - start;
-
-	// Get type if there is one.
-
-	TSNode const type_node = ts_node_child_by_field_name(node, "type", 4);
-	bool const has_type = !ts_node_is_null(type_node);
-
-	if (has_type) {
-		char const* const type_type = ts_node_type(type_node);
+static int var_decl_add(flamingo_t* flamingo, ast_node_t const* node, flamingo_var_t** var) {
+	assert(node->kind == AST_KIND_VAR_DECL);
 
-		if (strcmp(type_type, "type") != 0) {
-			return error(flamingo, "expected type for type, got %s", type_type);
-		}
-	}
-
-	// Get initial value if there is one.
-
-	TSNode const initial_node = ts_node_child_by_field_name(node, "initial", 7);
-	bool const has_initial = !ts_node_is_null(initial_node);
+	// Get variable name.
+	// Its type and the type of the type were already checked when lowering.
 
-	if (has_initial) {
-		char const* const initial_type = ts_node_type(initial_node);
+	ast_node_t const* const name_node = ast_node(flamingo->ast, node->var_decl.name);
 
-		if (strcmp(initial_type, "expression") != 0) {
-			return error(flamingo, "expected expression for initial value, got %s", initial_type);
-		}
-	}
+	char* const name = symbol_of(flamingo, name_node);
+	size_t const name_size = name_node->end - name_node->start;
 
 	// Check if identifier is already in current scope (shallow search) and error if it is.
 	// If its in a previous one, that's alright, we'll just shadow it.
@@ -67,23 +35,45 @@ static int parse_var_decl(flamingo_t* flamingo, TSNode node) {
 
 	// Now, we can add our variable to the scope.
 
-	flamingo_var_t* const var = scope_add_var(cur_scope, name, name_size);
-	var->is_static = check_is_static(flamingo, node);
+	*var = scope_add_symbol_var(cur_scope, name, name_size);
+	(*var)->is_static = node->var_decl.is_static;
 
-	// And parse the initial expression if there is one to the variable's value.
+	return 0;
+}
 
-	if (has_initial) {
-		if (parse_expr(flamingo, initial_node, &var->val, NULL) < 0) {
-			return -1;
-		}
+// Set the value of a variable added by 'var_decl_add' to its evaluated initial value, or NULL if it has none.
+// This takes ownership of the initial value.
+
+static void var_decl_init(flamingo_t* flamingo, flamingo_var_t* var, flamingo_val_t* initial) {
+	if (initial != NULL) {
+		var->val = initial;
 	}
 
 	else {
-		var->val = val_alloc();
+		var->val = val_alloc(flamingo->pool);
 		var->val->kind = FLAMINGO_VAL_KIND_NONE;
 	}
 
-	var->val->owner = cur_scope;
+	var->val->owner = env_cur_scope(flamingo->env);
+}
+
+static int parse_var_decl(flamingo_t* flamingo, ast_node_t const* node) {
+	flamingo_var_t* var;
+
+	if (var_decl_add(flamingo, node, &var) < 0) {
+		return -1;
+	}
+
+	// And parse the initial expression if there is one to the variable's value.
+
+	flamingo_val_t* initial = NULL;
+
+	if (node->var_decl.initial != AST_NULL) {
+		if (parse_expr(flamingo, ast_node(flamingo->ast, node->var_decl.initial), &initial, NULL) < 0) {
+			return -1;
+		}
+	}
 
+	var_decl_init(flamingo, var, initial);
 	return 0;
 }
@@ -5,21 +5,14 @@
 
 #include "expr.h"
 
-static int parse_vec(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
-	assert(strcmp(ts_node_type(node), "vec") == 0);
-
-	size_t const n = ts_node_child_count(node);
+static int parse_vec(flamingo_t* flamingo, ast_node_t const* node, flamingo_val_t** val) {
+	assert(node->kind == AST_KIND_VEC);
 
 	size_t elem_count = 0;
 	flamingo_val_t** elems = NULL;
 
-	for (size_t i = 0; i < n; i++) {
-		TSNode const child = ts_node_child(node, i);
-		char const* const child_type = ts_node_type(child);
-
-		if (strcmp(child_type, "expression") != 0) {
-			continue;
-		}
+	for (size_t i = 0; i < node->vec.elems.count; i++) {
+		ast_node_t const* const child = ast_list_node(flamingo->ast, node->vec.elems, i);
 
 		elems = realloc(elems, ++elem_count * sizeof *elems);
 		assert(elems != NULL);
@@ -44,10 +37,11 @@ static int parse_vec(flamingo_t* flamingo, TSNode node, flamingo_val_t** val) {
 	}
 
 	assert(*val == NULL);
-	*val = val_alloc();
+	*val = val_alloc(flamingo->pool);
 
 	(*val)->kind = FLAMINGO_VAL_KIND_VEC;
 	(*val)->vec.count = elem_count;
+	(*val)->vec.capacity = elem_count;
 	(*val)->vec.elems = elems;
 
 	return 0;
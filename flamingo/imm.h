@@ -0,0 +1,114 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Immediates.
+ *
+ * Evaluating expressions produces a lot of short-lived nones, booleans, and integers: every intermediate result of 'a * b + c', the condition of every if statement, &c.
+ * Making each of these a value with a reference count would mean allocating and freeing them over and over again only to read them once.
+ * An immediate instead holds a none, boolean, or integer directly, or else a reference to a boxed value ({@link flamingo_val_t}) for every other kind.
+ *
+ * Scopes, vectors, maps, and argument lists all hold value pointers, as that's what hosts see and may even modify in-place, so an immediate is only boxed into an actual value once it has to be stored in one of these.
+ */
+
+#pragma once
+
+#include "common.h"
+#include "val.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct imm_t {
+	// If this is NULL, the immediate holds its none, boolean, or integer itself.
+	// Otherwise, the immediate owns a reference to this value, and only its kind is copied over.
+
+	flamingo_val_t* boxed;
+
+	flamingo_val_kind_t kind;
+
+	union {
+		bool boolean;
+		int64_t integer;
+	};
+};
+
+static inline imm_t imm_none(void) {
+	return (imm_t) {.kind = FLAMINGO_VAL_KIND_NONE};
+}
+
+static inline imm_t imm_bool(bool boolean) {
+	return (imm_t) {.kind = FLAMINGO_VAL_KIND_BOOL, .boolean = boolean};
+}
+
+static inline imm_t imm_int(int64_t integer) {
+	return (imm_t) {.kind = FLAMINGO_VAL_KIND_INT, .integer = integer};
+}
+
+// Wrap a value into an immediate.
+// This takes ownership of the value.
+
+static inline imm_t imm_from_val(flamingo_val_t* val) {
+	return (imm_t) {.boxed = val, .kind = val->kind};
+}
+
+// Read a value into an immediate, copying it if it can be unboxed and referencing it otherwise.
+// This doesn't take ownership of the value.
+
+static inline imm_t imm_read_val(flamingo_val_t* val) {
+	switch (val->kind) {
+	case FLAMINGO_VAL_KIND_NONE:
+		return imm_none();
+	case FLAMINGO_VAL_KIND_BOOL:
+		return imm_bool(val->boolean.boolean);
+	case FLAMINGO_VAL_KIND_INT:
+		return imm_int(val->integer.integer);
+	default:
+		return imm_from_val(val_incref(val));
+	}
+}
+
+static inline bool imm_boolean(imm_t imm) {
+	return imm.boxed == NULL ? imm.boolean : imm.boxed->boolean.boolean;
+}
+
+static inline int64_t imm_integer(imm_t imm) {
+	return imm.boxed == NULL ? imm.integer : imm.boxed->integer.integer;
+}
+
+static inline char const* imm_type_str(imm_t imm) {
+	if (imm.boxed != NULL) {
+		return val_type_str(imm.boxed);
+	}
+
+	flamingo_val_t const unboxed = {.kind = imm.kind};
+	return val_type_str(&unboxed);
+}
+
+// Box an immediate into a value, which is only allocated if the immediate doesn't already hold one.
+// This takes ownership of the immediate, and gives ownership of the value to the caller.
+
+static flamingo_val_t* imm_box(flamingo_t* flamingo, imm_t imm) {
+	if (imm.boxed != NULL) {
+		return imm.boxed;
+	}
+
+	flamingo_val_t* const val = val_alloc(flamingo->pool);
+	val->kind = imm.kind;
+
+	if (imm.kind == FLAMINGO_VAL_KIND_BOOL) {
+		val->boolean.boolean = imm.boolean;
+	}
+
+	else if (imm.kind == FLAMINGO_VAL_KIND_INT) {
+		val->integer.integer = imm.integer;
+	}
+
+	return val;
+}
+
+static inline void imm_free(imm_t imm) {
+	if (imm.boxed != NULL) {
+		val_decref(imm.boxed);
+	}
+}
@@ -0,0 +1,1409 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Lowering pass.
+ *
+ * This runs once when the flamingo instance is created, and turns the Tree-sitter tree into the flat array of typed nodes described in 'ast.h'.
+ * It is the only place in the interpreter which still uses Tree-sitter's node API.
+ *
+ * Anything which doesn't have the shape we expect is lowered to an {@link AST_KIND_INVALID} node carrying the error message, so that errors are raised at the same point during execution as they would've been by walking the Tree-sitter tree directly.
+ */
+
+#pragma once
+
+#include "ast.h"
+#include "common.h"
+#include "scope.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Expressions and statements are lowered recursively, and so are they executed, so a deeply nested program (e.g. a generated one) could overflow the C stack.
+// Past this many levels of nesting, they're lowered to an invalid node instead.
+
+#define LOWER_MAX_NESTING 1000
+
+typedef struct {
+	char const* src;
+	flamingo_ast_t* ast;
+
+	size_t nesting;
+	size_t max_nesting; // Deepest nesting reached since the start of the current callable's body.
+
+	size_t node_capacity;
+	size_t list_capacity;
+	size_t const_capacity;
+	size_t call_desc_capacity;
+	size_t str_capacity;
+
+	// Hash index of the string constants, used to intern them.
+	// Buckets hold the index of the constant plus one, zero meaning the bucket is empty.
+
+	size_t const_index_capacity;
+	uint32_t* const_index;
+
+	// Tree cursors which children are iterated over with (see 'lower_children_t').
+	// Cursors are kept around once allocated, as creating one allocates the stack it keeps its path in.
+
+	size_t cursor_count;
+	size_t cursor_capacity;
+	TSTreeCursor* cursors;
+} lower_t;
+
+static flamingo_node_t lower_expr_inner(lower_t* lower, TSNode node);
+static flamingo_node_t lower_statement(lower_t* lower, TSNode node);
+
+static flamingo_node_t lower_alloc(lower_t* lower, ast_kind_t kind, TSNode ts_node) {
+	flamingo_ast_t* const ast = lower->ast;
+
+	if (ast->node_count == lower->node_capacity) {
+		lower->node_capacity = lower->node_capacity == 0 ? 64 : lower->node_capacity * 2;
+
+		ast->nodes = realloc(ast->nodes, lower->node_capacity * sizeof *ast->nodes);
+		assert(ast->nodes != NULL);
+	}
+
+	flamingo_node_t const id = ast->node_count++;
+	ast_node_t* const node = &ast->nodes[id];
+
+	memset(node, 0, sizeof *node);
+	node->kind = kind;
+
+	if (!ts_node_is_null(ts_node)) {
+		node->start = ts_node_start_byte(ts_node);
+		node->end = ts_node_end_byte(ts_node);
+	}
+
+	return id;
+}
+
+// Nodes may be reallocated as children are lowered, so only ever get a pointer to a node once its children have all been lowered.
+
+static ast_node_t* lower_node(lower_t* lower, flamingo_node_t id) {
+	return &lower->ast->nodes[id];
+}
+
+// Add a string to the AST's string table, returning its offset in it.
+
+static uint32_t lower_str(lower_t* lower, char const* str, size_t size) {
+	flamingo_ast_t* const ast = lower->ast;
+
+	if (ast->str_size + size + 1 > lower->str_capacity) {
+		while (ast->str_size + size + 1 > lower->str_capacity) {
+			lower->str_capacity = lower->str_capacity == 0 ? 256 : lower->str_capacity * 2;
+		}
+
+		ast->strs = realloc(ast->strs, lower->str_capacity);
+		assert(ast->strs != NULL);
+	}
+
+	uint32_t const offset = ast->str_size;
+
+	memcpy(ast->strs + offset, str, size);
+	ast->strs[offset + size] = '\0';
+	ast->str_size += size + 1;
+
+	return offset;
+}
+
+__attribute__((format(printf, 3, 4))) static flamingo_node_t lower_invalid(lower_t* lower, TSNode ts_node, char const* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+
+	char* msg = NULL;
+	int const rv = vasprintf(&msg, fmt, args);
+	assert(rv >= 0 && msg != NULL);
+
+	va_end(args);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_INVALID, ts_node);
+	lower_node(lower, id)->invalid.msg = lower_str(lower, msg, strlen(msg));
+
+	free(msg);
+
+	return id;
+}
+
+static char const* lower_type_str(TSNode node) {
+	return ts_node_is_null(node) ? "nothing" : ts_node_type(node);
+}
+
+// Nodes are told apart by their symbol rather than their type string, using the symbol and field IDs generated into 'parser.c'.
+// These are only the same as the ones Tree-sitter gives back for nodes as long as no symbol is aliased to another in the grammar (see 'lower_source_file').
+
+static bool lower_is(TSNode node, TSSymbol symbol) {
+	return !ts_node_is_null(node) && ts_node_symbol(node) == symbol;
+}
+
+// String literals are interned, so that all the literals with the same contents share a constant.
+
+static void lower_const_index_insert(lower_t* lower, uint32_t constant) {
+	ast_const_t const* const c = &lower->ast->consts[constant];
+	size_t const mask = lower->const_index_capacity - 1;
+
+	for (size_t bucket = scope_hash(lower->src + c->start, c->size) & mask;; bucket = (bucket + 1) & mask) {
+		if (lower->const_index[bucket] == 0) {
+			lower->const_index[bucket] = constant + 1;
+			return;
+		}
+	}
+}
+
+// Returns the index of the constant with the given contents, adding it if there isn't one yet.
+
+static uint32_t lower_intern(lower_t* lower, uint32_t start, uint32_t size) {
+	flamingo_ast_t* const ast = lower->ast;
+	char const* const str = lower->src + start;
+
+	if (lower->const_index != NULL) {
+		size_t const mask = lower->const_index_capacity - 1;
+
+		for (size_t bucket = scope_hash(str, size) & mask; lower->const_index[bucket] != 0; bucket = (bucket + 1) & mask) {
+			uint32_t const constant = lower->const_index[bucket] - 1;
+			ast_const_t const* const c = &ast->consts[constant];
+
+			if (c->size == size && memcmp(lower->src + c->start, str, size) == 0) {
+				return constant;
+			}
+		}
+	}
+
+	// Not seen yet, so add a new constant.
+
+	if (ast->const_count == lower->const_capacity) {
+		lower->const_capacity = lower->const_capacity == 0 ? 16 : lower->const_capacity * 2;
+
+		ast->consts = realloc(ast->consts, lower->const_capacity * sizeof *ast->consts);
+		assert(ast->consts != NULL);
+	}
+
+	uint32_t const constant = ast->const_count++;
+
+	ast->consts[constant] = (ast_const_t) {
+		.start = start,
+		.size = size,
+	};
+
+	// Keep the load factor of the index under a half, rebuilding it when it grows.
+
+	if (ast->const_count * 2 > lower->const_index_capacity) {
+		free(lower->const_index);
+
+		lower->const_index_capacity = lower->const_index_capacity == 0 ? 32 : lower->const_index_capacity * 2;
+		lower->const_index = calloc(lower->const_index_capacity, sizeof *lower->const_index);
+		assert(lower->const_index != NULL);
+
+		for (uint32_t i = 0; i < ast->const_count; i++) {
+			lower_const_index_insert(lower, i);
+		}
+	}
+
+	else {
+		lower_const_index_insert(lower, constant);
+	}
+
+	return constant;
+}
+
+// Lists are built up in a temporary buffer while their elements are being lowered (which may themselves add lists), and only then copied contiguously to the AST.
+
+typedef struct {
+	size_t count;
+	size_t capacity;
+	flamingo_node_t* ids;
+} lower_buf_t;
+
+static void lower_buf_push(lower_buf_t* buf, flamingo_node_t id) {
+	if (buf->count == buf->capacity) {
+		buf->capacity = buf->capacity == 0 ? 8 : buf->capacity * 2;
+
+		buf->ids = realloc(buf->ids, buf->capacity * sizeof *buf->ids);
+		assert(buf->ids != NULL);
+	}
+
+	buf->ids[buf->count++] = id;
+}
+
+static ast_list_t lower_buf_commit(lower_t* lower, lower_buf_t* buf) {
+	flamingo_ast_t* const ast = lower->ast;
+
+	ast_list_t const list = {
+		.first = ast->list_size,
+		.count = buf->count,
+	};
+
+	if (ast->list_size + buf->count > lower->list_capacity) {
+		while (ast->list_size + buf->count > lower->list_capacity) {
+			lower->list_capacity = lower->list_capacity == 0 ? 64 : lower->list_capacity * 2;
+		}
+
+		ast->lists = realloc(ast->lists, lower->list_capacity * sizeof *ast->lists);
+		assert(ast->lists != NULL);
+	}
+
+	if (buf->count > 0) {
+		memcpy(ast->lists + ast->list_size, buf->ids, buf->count * sizeof *buf->ids);
+	}
+
+	ast->list_size += buf->count;
+	free(buf->ids);
+
+	return list;
+}
+
+// Children are iterated over with a tree cursor, as getting a child by its index walks the siblings before it every time, which makes going through all the children of a long node (e.g. a big source file or map literal) quadratic.
+// Children of nested nodes are iterated over while the iteration over their parent is still ongoing, so each iteration takes the next cursor from a stack of them.
+
+typedef struct {
+	size_t cursor;
+	bool named;
+	bool started;
+} lower_children_t;
+
+static lower_children_t lower_children(lower_t* lower, TSNode node, bool named) {
+	if (lower->cursor_count == lower->cursor_capacity) {
+		lower->cursors = realloc(lower->cursors, ++lower->cursor_capacity * sizeof *lower->cursors);
+		assert(lower->cursors != NULL);
+
+		lower->cursors[lower->cursor_count] = ts_tree_cursor_new(node);
+	}
+
+	else {
+		ts_tree_cursor_reset(&lower->cursors[lower->cursor_count], node);
+	}
+
+	return (lower_children_t) {
+		.cursor = lower->cursor_count++,
+		.named = named,
+	};
+}
+
+// Go to the next child (the first one the first time around), skipping anonymous ones if only named children are wanted.
+
+static bool lower_next_child(lower_t* lower, lower_children_t* children, TSNode* child) {
+	TSTreeCursor* const cursor = &lower->cursors[children->cursor];
+
+	do {
+		bool const moved = children->started ? ts_tree_cursor_goto_next_sibling(cursor) : ts_tree_cursor_goto_first_child(cursor);
+		children->started = true;
+
+		if (!moved) {
+			return false;
+		}
+
+		*child = ts_tree_cursor_current_node(cursor);
+	} while (children->named && !ts_node_is_named(*child));
+
+	return true;
+}
+
+static TSFieldId lower_child_field(lower_t* lower, lower_children_t* children) {
+	return ts_tree_cursor_current_field_id(&lower->cursors[children->cursor]);
+}
+
+static void lower_children_end(lower_t* lower, lower_children_t* children) {
+	assert(children->cursor == lower->cursor_count - 1);
+	lower->cursor_count--;
+}
+
+// Identifiers (and 'self') are interned like string literals, so each name is only made into a symbol once at runtime (see 'symbol.h').
+
+static flamingo_node_t lower_identifier(lower_t* lower, ast_kind_t kind, TSNode node) {
+	flamingo_node_t const id = lower_alloc(lower, kind, node);
+	ast_node_t* const identifier = lower_node(lower, id);
+
+	identifier->identifier.symbol = lower_intern(lower, identifier->start, identifier->end - identifier->start);
+	return id;
+}
+
+// Lower the expression in the given field, which must be wrapped in an 'expression' node.
+
+static flamingo_node_t lower_expr_field(lower_t* lower, TSNode node, TSFieldId field, char const* what) {
+	TSNode const child = ts_node_child_by_field_id(node, field);
+
+	if (!lower_is(child, sym_expression)) {
+		return lower_invalid(lower, node, "expected expression for %s, got %s", what, lower_type_str(child));
+	}
+
+	return lower_expr_inner(lower, child);
+}
+
+// Same as 'lower_expr_field', but the field is optional.
+
+static flamingo_node_t lower_opt_expr_field(lower_t* lower, TSNode node, TSFieldId field, char const* what) {
+	TSNode const child = ts_node_child_by_field_id(node, field);
+
+	if (ts_node_is_null(child)) {
+		return AST_NULL;
+	}
+
+	return lower_expr_field(lower, node, field, what);
+}
+
+static bool lower_is_static(lower_t* lower, TSNode node) {
+	TSNode const qualifiers = ts_node_child_by_field_id(node, field_qualifiers);
+
+	if (ts_node_is_null(qualifiers)) {
+		return false;
+	}
+
+	lower_children_t children = lower_children(lower, qualifiers, false);
+	TSNode qualifier;
+
+	while (lower_next_child(lower, &children, &qualifier)) {
+		size_t const start = ts_node_start_byte(qualifier);
+		size_t const end = ts_node_end_byte(qualifier);
+
+		char const* const qualifier_name = lower->src + start;
+		size_t const size = end - start;
+
+		if (strncmp(qualifier_name, "static", size) == 0) {
+			lower_children_end(lower, &children);
+			return true;
+		}
+	}
+
+	lower_children_end(lower, &children);
+	return false;
+}
+
+static flamingo_node_t lower_param_list(lower_t* lower, TSNode node) {
+	lower_buf_t buf = {0};
+
+	lower_children_t children = lower_children(lower, node, true);
+	TSNode child;
+
+	while (lower_next_child(lower, &children, &child)) {
+		if (!lower_is(child, sym_param)) {
+			lower_children_end(lower, &children);
+			free(buf.ids);
+
+			return lower_invalid(lower, node, "expected param in parameter list, got %s", lower_type_str(child));
+		}
+
+		TSNode const ident = ts_node_child_by_field_id(child, field_ident);
+		TSNode const type = ts_node_child_by_field_id(child, field_type);
+
+		assert(lower_is(ident, sym_identifier));
+		assert(ts_node_is_null(type) || lower_is(type, sym_type));
+
+		flamingo_node_t const ident_id = lower_identifier(lower, AST_KIND_IDENTIFIER, ident);
+		flamingo_node_t const type_id = ts_node_is_null(type) ? AST_NULL : lower_alloc(lower, AST_KIND_NULL, type);
+
+		flamingo_node_t const param_id = lower_alloc(lower, AST_KIND_PARAM, child);
+		ast_node_t* const param = lower_node(lower, param_id);
+
+		param->param.ident = ident_id;
+		param->param.type = type_id;
+
+		lower_buf_push(&buf, param_id);
+	}
+
+	lower_children_end(lower, &children);
+
+	ast_list_t const params = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_PARAM_LIST, node);
+	lower_node(lower, id)->param_list.params = params;
+
+	return id;
+}
+
+// Start lowering the body of a function, class, or lambda, returning what to pass to 'lower_body_end' once it's lowered.
+
+static size_t lower_body_begin(lower_t* lower) {
+	size_t const outer_max_nesting = lower->max_nesting;
+	lower->max_nesting = lower->nesting;
+
+	return outer_max_nesting;
+}
+
+// Finish lowering a body, returning how many levels deep it went.
+
+static uint32_t lower_body_end(lower_t* lower, size_t outer_max_nesting) {
+	uint32_t const nesting = lower->max_nesting - lower->nesting;
+
+	if (outer_max_nesting > lower->max_nesting) {
+		lower->max_nesting = outer_max_nesting;
+	}
+
+	return nesting;
+}
+
+// Make the call descriptor of a function, class, or lambda from its already lowered parameter list, returning its index.
+
+static uint32_t lower_call_desc(lower_t* lower, flamingo_node_t params, bool expr_body, uint32_t nesting) {
+	flamingo_ast_t* const ast = lower->ast;
+	lower_buf_t buf = {0};
+
+	// Invalid parameter lists are only errored on when declaring the callable, so it never gets called.
+
+	if (params != AST_NULL && ast->nodes[params].kind == AST_KIND_PARAM_LIST) {
+		ast_list_t const list = ast->nodes[params].param_list.params;
+
+		for (size_t i = 0; i < list.count; i++) {
+			lower_buf_push(&buf, ast->nodes[ast->lists[list.first + i]].param.ident);
+		}
+	}
+
+	ast_list_t const idents = lower_buf_commit(lower, &buf);
+
+	if (ast->call_desc_count == lower->call_desc_capacity) {
+		lower->call_desc_capacity = lower->call_desc_capacity == 0 ? 16 : lower->call_desc_capacity * 2;
+
+		ast->call_descs = realloc(ast->call_descs, lower->call_desc_capacity * sizeof *ast->call_descs);
+		assert(ast->call_descs != NULL);
+	}
+
+	ast->call_descs[ast->call_desc_count] = (ast_call_desc_t) {
+		.params = idents,
+		.expr_body = expr_body,
+		.nesting = nesting,
+	};
+
+	return ast->call_desc_count++;
+}
+
+// Lower the optional parameter list in the 'params' field.
+
+static flamingo_node_t lower_params_field(lower_t* lower, TSNode node, char const* what) {
+	TSNode const params = ts_node_child_by_field_id(node, field_params);
+
+	if (ts_node_is_null(params)) {
+		return AST_NULL;
+	}
+
+	if (!lower_is(params, sym_param_list)) {
+		return lower_invalid(lower, node, "expected param_list for %s, got %s", what, lower_type_str(params));
+	}
+
+	return lower_param_list(lower, params);
+}
+
+static flamingo_node_t lower_block(lower_t* lower, TSNode node) {
+	lower_buf_t buf = {0};
+
+	lower_children_t children = lower_children(lower, node, true);
+	TSNode child;
+
+	while (lower_next_child(lower, &children, &child)) {
+		flamingo_node_t const stmt = lower_statement(lower, child);
+
+		if (stmt != AST_NULL) {
+			lower_buf_push(&buf, stmt);
+		}
+	}
+
+	lower_children_end(lower, &children);
+
+	ast_list_t const stmts = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_BLOCK, node);
+	lower_node(lower, id)->block.stmts = stmts;
+
+	return id;
+}
+
+// Lower the block in the given field.
+
+static flamingo_node_t lower_block_field(lower_t* lower, TSNode node, TSFieldId field, char const* what) {
+	TSNode const child = ts_node_child_by_field_id(node, field);
+
+	if (!lower_is(child, sym_block)) {
+		return lower_invalid(lower, node, "expected block for %s, got %s", what, lower_type_str(child));
+	}
+
+	return lower_block(lower, child);
+}
+
+static flamingo_node_t lower_literal(lower_t* lower, TSNode node) {
+	assert(ts_node_child_count(node) == 1);
+
+	TSNode const child = ts_node_child(node, 0);
+	TSSymbol const symbol = ts_node_symbol(child);
+
+	size_t const start = ts_node_start_byte(child);
+	size_t const end = ts_node_end_byte(child);
+
+	ast_literal_kind_t kind;
+	bool boolean = false;
+	int64_t integer = 0;
+
+	if (symbol == sym_none) {
+		kind = AST_LITERAL_NONE;
+	}
+
+	else if (symbol == sym_bool) {
+		kind = AST_LITERAL_BOOL;
+		boolean = lower->src[start] == 't';
+	}
+
+	// XXX For now, just ints.
+	// Maybe in the future floats will be supported to, in which case there won't be a single "number" node type.
+
+	else if (symbol == sym_number) {
+		kind = AST_LITERAL_INT;
+
+		char const* const number = lower->src + start;
+		size_t const size = end - start;
+		assert(size > 0);
+
+		// TODO Should I keep this negative check? Technically, number literals can't have minus signs, and it's only a unary operator.
+
+		bool negative = false;
+
+		if (number[0] == '-') {
+			assert(size > 1); // Can't be just a minus sign.
+			negative = true;
+		}
+
+		for (size_t i = 0; i < size; i++) {
+			if (number[i] == '_') {
+				continue;
+			}
+
+			if (number[i] < '0' || number[i] > '9') {
+				return lower_invalid(lower, node, "number literals can only contain decimal digits (got '%c')", number[i]);
+			}
+
+			integer *= 10;
+			integer += number[i] - '0';
+		}
+
+		if (negative) {
+			integer = -integer;
+		}
+	}
+
+	else if (symbol == sym_string) {
+		kind = AST_LITERAL_STR;
+	}
+
+	else {
+		return lower_invalid(lower, node, "unknown literal type: %s", ts_node_type(child));
+	}
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_LITERAL, node);
+	ast_node_t* const literal = lower_node(lower, id);
+
+	literal->literal.kind = kind;
+
+	switch (kind) {
+	case AST_LITERAL_BOOL:
+		literal->literal.boolean = boolean;
+		break;
+	case AST_LITERAL_INT:
+		literal->literal.integer = integer;
+		break;
+	case AST_LITERAL_STR:
+		// XXX remove one from each side as we don't want the quotes
+
+		literal->literal.str.start = start + 1;
+		literal->literal.str.size = end - start - 2;
+		literal->literal.str.constant = lower_intern(lower, literal->literal.str.start, literal->literal.str.size);
+
+		break;
+	case AST_LITERAL_NONE:
+		break;
+	}
+
+	return id;
+}
+
+static flamingo_node_t lower_lambda(lower_t* lower, TSNode node) {
+	flamingo_node_t const params = lower_params_field(lower, node, "anonymous function parameters");
+
+	// Get body (block or expression).
+
+	TSNode const body = ts_node_child_by_field_id(node, field_body);
+	flamingo_node_t body_id;
+
+	size_t const outer_max_nesting = lower_body_begin(lower);
+
+	if (lower_is(body, sym_block)) {
+		body_id = lower_block(lower, body);
+	}
+
+	else if (lower_is(body, sym_expression)) {
+		body_id = lower_expr_inner(lower, body);
+	}
+
+	else {
+		lower_body_end(lower, outer_max_nesting);
+		return lower_invalid(lower, node, "expected block or expression for anonymous function body, got %s", lower_type_str(body));
+	}
+
+	uint32_t const nesting = lower_body_end(lower, outer_max_nesting);
+	uint32_t const call_desc = lower_call_desc(lower, params, !lower_is(body, sym_block), nesting);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_LAMBDA, node);
+	ast_node_t* const lambda = lower_node(lower, id);
+
+	lambda->lambda.params = params;
+	lambda->lambda.body = body_id;
+	lambda->lambda.call_desc = call_desc;
+
+	return id;
+}
+
+static flamingo_node_t lower_vec(lower_t* lower, TSNode node) {
+	lower_buf_t buf = {0};
+
+	lower_children_t children = lower_children(lower, node, false);
+	TSNode child;
+
+	while (lower_next_child(lower, &children, &child)) {
+		if (!lower_is(child, sym_expression)) {
+			continue;
+		}
+
+		lower_buf_push(&buf, lower_expr_inner(lower, child));
+	}
+
+	lower_children_end(lower, &children);
+
+	ast_list_t const elems = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_VEC, node);
+	lower_node(lower, id)->vec.elems = elems;
+
+	return id;
+}
+
+static flamingo_node_t lower_map(lower_t* lower, TSNode node) {
+	lower_buf_t buf = {0};
+
+	lower_children_t children = lower_children(lower, node, false);
+	TSNode child;
+
+	while (lower_next_child(lower, &children, &child)) {
+		if (!lower_is(child, sym_map_item)) {
+			continue;
+		}
+
+		TSNode const key_node = ts_node_child_by_field_id(child, field_key);
+		TSNode const val_node = ts_node_child_by_field_id(child, field_value);
+
+		assert(lower_is(key_node, sym_expression));
+		assert(lower_is(val_node, sym_expression));
+
+		lower_buf_push(&buf, lower_expr_inner(lower, key_node));
+		lower_buf_push(&buf, lower_expr_inner(lower, val_node));
+	}
+
+	lower_children_end(lower, &children);
+
+	ast_list_t const items = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_MAP, node);
+	lower_node(lower, id)->map.items = items;
+
+	return id;
+}
+
+static flamingo_node_t lower_call(lower_t* lower, TSNode node) {
+	// Get callable expression.
+
+	TSNode const callable_node = ts_node_child_by_field_id(node, field_callable);
+
+	if (!lower_is(callable_node, sym_expression)) {
+		return lower_invalid(lower, node, "expected identifier for callable name, got %s", lower_type_str(callable_node));
+	}
+
+	flamingo_node_t const callable = lower_expr_inner(lower, callable_node);
+
+	// Get arguments.
+
+	TSNode const args = ts_node_child_by_field_id(node, field_args);
+	lower_buf_t buf = {0};
+
+	if (!ts_node_is_null(args)) {
+		if (!lower_is(args, sym_arg_list)) {
+			return lower_invalid(lower, node, "expected arg_list for parameters, got %s", lower_type_str(args));
+		}
+
+		lower_children_t children = lower_children(lower, args, true);
+		TSNode arg;
+
+		while (lower_next_child(lower, &children, &arg)) {
+			if (!lower_is(arg, sym_expression)) {
+				lower_children_end(lower, &children);
+				free(buf.ids);
+
+				return lower_invalid(lower, node, "expected expression in argument list, got %s", lower_type_str(arg));
+			}
+
+			lower_buf_push(&buf, lower_expr_inner(lower, arg));
+		}
+
+		lower_children_end(lower, &children);
+	}
+
+	ast_list_t const arg_list = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_CALL, node);
+	ast_node_t* const call = lower_node(lower, id);
+
+	call->call.callable = callable;
+	call->call.args = arg_list;
+
+	return id;
+}
+
+// Operators are matched exactly, as one operator can be a prefix of another (e.g. '*' and '**').
+
+typedef struct {
+	char const* str;
+	ast_op_t op;
+} lower_op_t;
+
+static lower_op_t const lower_unary_ops[] = {
+	{"-", AST_OP_NEG},
+	{"!", AST_OP_NOT},
+};
+
+static lower_op_t const lower_binary_ops[] = {
+	{"+", AST_OP_ADD},
+	{"-", AST_OP_SUB},
+	{"*", AST_OP_MUL},
+	{"/", AST_OP_DIV},
+	{"%", AST_OP_MOD},
+	{"**", AST_OP_POW},
+	{"==", AST_OP_EQ},
+	{"!=", AST_OP_NE},
+	{"<", AST_OP_LT},
+	{"<=", AST_OP_LE},
+	{">", AST_OP_GT},
+	{">=", AST_OP_GE},
+	{"&&", AST_OP_AND},
+	{"||", AST_OP_OR},
+	{"^^", AST_OP_XOR},
+};
+
+static ast_op_t lower_op(lower_t* lower, TSNode op_node, lower_op_t const* ops, size_t op_count) {
+	char const* const op = lower->src + ts_node_start_byte(op_node);
+	size_t const size = ts_node_end_byte(op_node) - ts_node_start_byte(op_node);
+
+	for (size_t i = 0; i < op_count; i++) {
+		if (strlen(ops[i].str) == size && memcmp(ops[i].str, op, size) == 0) {
+			return ops[i].op;
+		}
+	}
+
+	return AST_OP_UNKNOWN;
+}
+
+static flamingo_node_t lower_unary_expr(lower_t* lower, TSNode node) {
+	flamingo_node_t const operand = lower_expr_field(lower, node, field_operand, "operand");
+
+	// Get operator.
+	// XXX Calling this all 'op_*' because clang-format thinks 'operator' is the C++ keyword and so is annoying with it.
+
+	TSNode const op_node = ts_node_child_by_field_id(node, field_operator);
+
+	if (!lower_is(op_node, sym_unary_operator)) {
+		return lower_invalid(lower, node, "expected unary_operator, got %s", lower_type_str(op_node));
+	}
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_UNARY_EXPR, node);
+	ast_node_t* const unary_expr = lower_node(lower, id);
+
+	unary_expr->unary_expr.operand = operand;
+	unary_expr->unary_expr.op = lower_op(lower, op_node, lower_unary_ops, sizeof lower_unary_ops / sizeof *lower_unary_ops);
+	unary_expr->unary_expr.op_start = ts_node_start_byte(op_node);
+	unary_expr->unary_expr.op_size = ts_node_end_byte(op_node) - ts_node_start_byte(op_node);
+
+	return id;
+}
+
+static flamingo_node_t lower_binary_expr(lower_t* lower, TSNode node) {
+	flamingo_node_t const left = lower_expr_field(lower, node, field_left, "left operand");
+	flamingo_node_t const right = lower_expr_field(lower, node, field_right, "right operand");
+
+	TSNode const op_node = ts_node_child_by_field_id(node, field_operator);
+
+	if (ts_node_is_null(op_node)) {
+		return lower_invalid(lower, node, "expected operator, got nothing");
+	}
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_BINARY_EXPR, node);
+	ast_node_t* const binary_expr = lower_node(lower, id);
+
+	binary_expr->binary_expr.left = left;
+	binary_expr->binary_expr.right = right;
+	binary_expr->binary_expr.op = lower_op(lower, op_node, lower_binary_ops, sizeof lower_binary_ops / sizeof *lower_binary_ops);
+	binary_expr->binary_expr.op_start = ts_node_start_byte(op_node);
+	binary_expr->binary_expr.op_size = ts_node_end_byte(op_node) - ts_node_start_byte(op_node);
+
+	return id;
+}
+
+static flamingo_node_t lower_access(lower_t* lower, TSNode node) {
+	flamingo_node_t const accessed = lower_expr_field(lower, node, field_accessed, "accessed");
+
+	TSNode const accessor_node = ts_node_child_by_field_id(node, field_accessor);
+
+	if (!lower_is(accessor_node, sym_identifier)) {
+		return lower_invalid(lower, node, "expected identifier for accessor, got %s", lower_type_str(accessor_node));
+	}
+
+	flamingo_node_t const accessor = lower_identifier(lower, AST_KIND_IDENTIFIER, accessor_node);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_ACCESS, node);
+	ast_node_t* const access = lower_node(lower, id);
+
+	access->access.accessed = accessed;
+	access->access.accessor = accessor;
+
+	return id;
+}
+
+static flamingo_node_t lower_index(lower_t* lower, TSNode node) {
+	flamingo_node_t const indexed = lower_expr_field(lower, node, field_indexed, "indexed");
+	flamingo_node_t const index = lower_expr_field(lower, node, field_index, "index");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_INDEX, node);
+	ast_node_t* const index_node = lower_node(lower, id);
+
+	index_node->index.indexed = indexed;
+	index_node->index.index = index;
+
+	return id;
+}
+
+// Lower the contents of an 'expression' node.
+// The 'expression' node itself (and any parentheses) doesn't survive lowering.
+
+static flamingo_node_t lower_expr_kind(lower_t* lower, TSNode node) {
+	assert(lower_is(node, sym_expression));
+	assert(ts_node_child_count(node) == 1);
+
+	TSNode const child = ts_node_child(node, 0);
+
+	switch (ts_node_symbol(child)) {
+	case sym_literal:
+		return lower_literal(lower, child);
+	case sym_identifier:
+		return lower_identifier(lower, AST_KIND_IDENTIFIER, child);
+	case sym_lambda:
+		return lower_lambda(lower, child);
+	case sym_vec:
+		return lower_vec(lower, child);
+	case sym_map:
+		return lower_map(lower, child);
+	case sym_call:
+		return lower_call(lower, child);
+	case sym_parenthesized_expression:
+		return lower_expr_inner(lower, ts_node_child_by_field_id(child, field_expression));
+	case sym_unary_expression:
+		return lower_unary_expr(lower, child);
+	case sym_binary_expression:
+		return lower_binary_expr(lower, child);
+	case sym_access:
+		return lower_access(lower, child);
+	case sym_index:
+		return lower_index(lower, child);
+	default:
+		return lower_invalid(lower, child, "unknown expression type: %s", ts_node_type(child));
+	}
+}
+
+static flamingo_node_t lower_expr_inner(lower_t* lower, TSNode node) {
+	if (lower->nesting == LOWER_MAX_NESTING) {
+		return lower_invalid(lower, node, "expression nested more than %d levels deep", LOWER_MAX_NESTING);
+	}
+
+	lower->nesting++;
+
+	if (lower->nesting > lower->max_nesting) {
+		lower->max_nesting = lower->nesting;
+	}
+
+	flamingo_node_t const id = lower_expr_kind(lower, node);
+	lower->nesting--;
+
+	return id;
+}
+
+static flamingo_node_t lower_function_declaration(lower_t* lower, TSNode node, flamingo_fn_kind_t kind) {
+	char const* thing = "unknown";
+
+	switch (kind) {
+	case FLAMINGO_FN_KIND_FUNCTION:
+		thing = "function";
+		break;
+	case FLAMINGO_FN_KIND_CLASS:
+		thing = "class";
+		break;
+	case FLAMINGO_FN_KIND_EXTERN:
+		thing = "external prototype";
+		break;
+	default:
+		assert(false);
+	}
+
+	// Get qualifier list.
+
+	TSNode const qualifiers_node = ts_node_child_by_field_id(node, field_qualifiers);
+
+	if (!ts_node_is_null(qualifiers_node) && !lower_is(qualifiers_node, sym_qualifier_list)) {
+		return lower_invalid(lower, node, "expected qualifier_list for qualifiers, got %s", lower_type_str(qualifiers_node));
+	}
+
+	// Get function/class name.
+
+	TSNode const name_node = ts_node_child_by_field_id(node, field_name);
+
+	if (!lower_is(name_node, sym_identifier)) {
+		return lower_invalid(lower, node, "expected identifier for %s name, got %s", thing, lower_type_str(name_node));
+	}
+
+	flamingo_node_t const name = lower_identifier(lower, AST_KIND_IDENTIFIER, name_node);
+
+	// Get function/class parameters.
+
+	flamingo_node_t const params = lower_params_field(lower, node, "parameters");
+
+	// Get function/class body (only for non-prototypes).
+
+	flamingo_node_t body = AST_NULL;
+	size_t const outer_max_nesting = lower_body_begin(lower);
+
+	if (kind != FLAMINGO_FN_KIND_EXTERN) {
+		body = lower_block_field(lower, node, field_body, "body");
+	}
+
+	uint32_t const nesting = lower_body_end(lower, outer_max_nesting);
+	uint32_t const call_desc = lower_call_desc(lower, params, false, nesting);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_FUNCTION_DECLARATION, node);
+	ast_node_t* const decl = lower_node(lower, id);
+
+	decl->function_declaration.kind = kind;
+	decl->function_declaration.is_static = lower_is_static(lower, node);
+	decl->function_declaration.name = name;
+	decl->function_declaration.params = params;
+	decl->function_declaration.body = body;
+	decl->function_declaration.call_desc = call_desc;
+
+	return id;
+}
+
+static flamingo_node_t lower_if_chain(lower_t* lower, TSNode node) {
+	lower_buf_t buf = {0};
+
+	lower_buf_push(&buf, lower_expr_field(lower, node, field_condition, "if condition"));
+	lower_buf_push(&buf, lower_block_field(lower, node, field_body, "if body"));
+
+	// Get elif conditions and their respective bodies, which are always right after them.
+
+	lower_children_t children = lower_children(lower, node, true);
+	TSNode child;
+
+	while (lower_next_child(lower, &children, &child)) {
+		if (lower_child_field(lower, &children) != field_elif_condition) {
+			continue;
+		}
+
+		// We now know that child was an elif condition.
+		// Go to the next named node, which should be the body of this elif statement.
+
+		TSNode elif_body_node;
+
+		if (!lower_next_child(lower, &children, &elif_body_node)) {
+			elif_body_node = (TSNode) {0};
+		}
+
+		if (!lower_is(child, sym_expression)) {
+			lower_buf_push(&buf, lower_invalid(lower, child, "expected expression for elif condition, got %s", lower_type_str(child)));
+		}
+
+		else {
+			lower_buf_push(&buf, lower_expr_inner(lower, child));
+		}
+
+		if (!lower_is(elif_body_node, sym_block)) {
+			lower_buf_push(&buf, lower_invalid(lower, child, "expected block for elif body, got %s", lower_type_str(elif_body_node)));
+		}
+
+		else {
+			lower_buf_push(&buf, lower_block(lower, elif_body_node));
+		}
+	}
+
+	lower_children_end(lower, &children);
+
+	// Get else body.
+
+	TSNode const else_body_node = ts_node_child_by_field_id(node, field_else_body);
+	flamingo_node_t else_body = AST_NULL;
+
+	if (!ts_node_is_null(else_body_node)) {
+		else_body = lower_block_field(lower, node, field_else_body, "else body");
+	}
+
+	ast_list_t const branches = lower_buf_commit(lower, &buf);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_IF_CHAIN, node);
+	ast_node_t* const if_chain = lower_node(lower, id);
+
+	if_chain->if_chain.branches = branches;
+	if_chain->if_chain.else_body = else_body;
+
+	return id;
+}
+
+static flamingo_node_t lower_for_loop(lower_t* lower, TSNode node) {
+	TSNode const cur_var_name_node = ts_node_child_by_field_id(node, field_cur_var_name);
+
+	if (!lower_is(cur_var_name_node, sym_identifier)) {
+		return lower_invalid(lower, node, "expected identifier for current variable name, got %s", lower_type_str(cur_var_name_node));
+	}
+
+	flamingo_node_t const cur_var_name = lower_identifier(lower, AST_KIND_IDENTIFIER, cur_var_name_node);
+	flamingo_node_t const iterator = lower_expr_field(lower, node, field_iterator, "iterator");
+	flamingo_node_t const body = lower_block_field(lower, node, field_body, "body");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_FOR_LOOP, node);
+	ast_node_t* const for_loop = lower_node(lower, id);
+
+	for_loop->for_loop.cur_var_name = cur_var_name;
+	for_loop->for_loop.iterator = iterator;
+	for_loop->for_loop.body = body;
+
+	return id;
+}
+
+static flamingo_node_t lower_print(lower_t* lower, TSNode node) {
+	flamingo_node_t const msg = lower_expr_field(lower, node, field_msg, "message");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_PRINT, node);
+	lower_node(lower, id)->print.msg = msg;
+
+	return id;
+}
+
+static flamingo_node_t lower_return(lower_t* lower, TSNode node) {
+	flamingo_node_t const rv = lower_opt_expr_field(lower, node, field_rv, "return value");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_RETURN, node);
+	lower_node(lower, id)->return_.rv = rv;
+
+	return id;
+}
+
+static flamingo_node_t lower_assert(lower_t* lower, TSNode node) {
+	TSNode const test_node = ts_node_child_by_field_id(node, field_test);
+
+	flamingo_node_t const test = lower_expr_field(lower, node, field_test, "test");
+	flamingo_node_t const msg = lower_opt_expr_field(lower, node, field_msg, "message");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_ASSERT, node);
+	ast_node_t* const assert_ = lower_node(lower, id);
+
+	assert_->assert_.test = test;
+	assert_->assert_.msg = msg;
+
+	if (!ts_node_is_null(test_node)) {
+		assert_->assert_.test_start = ts_node_start_byte(test_node);
+		assert_->assert_.test_end = ts_node_end_byte(test_node);
+	}
+
+	return id;
+}
+
+static flamingo_node_t lower_var_decl(lower_t* lower, TSNode node) {
+	TSNode const name_node = ts_node_child_by_field_id(node, field_name);
+
+	if (!lower_is(name_node, sym_identifier)) {
+		return lower_invalid(lower, node, "expected identifier for name, got %s", lower_type_str(name_node));
+	}
+
+	flamingo_node_t const name = lower_identifier(lower, AST_KIND_IDENTIFIER, name_node);
+
+	// Get type if there is one.
+
+	TSNode const type_node = ts_node_child_by_field_id(node, field_type);
+	flamingo_node_t type = AST_NULL;
+
+	if (!ts_node_is_null(type_node)) {
+		if (!lower_is(type_node, sym_type)) {
+			return lower_invalid(lower, node, "expected type for type, got %s", lower_type_str(type_node));
+		}
+
+		type = lower_alloc(lower, AST_KIND_NULL, type_node);
+	}
+
+	// Get initial value if there is one.
+
+	flamingo_node_t const initial = lower_opt_expr_field(lower, node, field_initial, "initial value");
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_VAR_DECL, node);
+	ast_node_t* const var_decl = lower_node(lower, id);
+
+	var_decl->var_decl.is_static = lower_is_static(lower, node);
+	var_decl->var_decl.name = name;
+	var_decl->var_decl.type = type;
+	var_decl->var_decl.initial = initial;
+
+	return id;
+}
+
+static flamingo_node_t lower_assignment(lower_t* lower, TSNode node) {
+	flamingo_node_t const right = lower_expr_field(lower, node, field_right, "name");
+
+	// Get LHS identifier, access, or index.
+
+	TSNode const left_node = ts_node_child_by_field_id(node, field_left);
+	flamingo_node_t left;
+
+	if (lower_is(left_node, sym_identifier)) {
+		left = lower_identifier(lower, AST_KIND_IDENTIFIER, left_node);
+	}
+
+	else if (lower_is(left_node, sym_access)) {
+		left = lower_access(lower, left_node);
+	}
+
+	else if (lower_is(left_node, sym_index)) {
+		left = lower_index(lower, left_node);
+	}
+
+	else {
+		return lower_invalid(lower, node, "expected identifier, access, or index for name, got %s", lower_type_str(left_node));
+	}
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_ASSIGNMENT, node);
+	ast_node_t* const assignment = lower_node(lower, id);
+
+	assignment->assignment.left = left;
+	assignment->assignment.right = right;
+
+	// Check if the RHS adds something to the variable being assigned to.
+
+	ast_node_t const* const right_node = lower_node(lower, right);
+
+	if (lower_node(lower, left)->kind == AST_KIND_IDENTIFIER && right_node->kind == AST_KIND_BINARY_EXPR && right_node->binary_expr.op == AST_OP_ADD) {
+		ast_node_t const* const left_node = lower_node(lower, left);
+		ast_node_t const* const operand_node = lower_node(lower, right_node->binary_expr.left);
+
+		size_t const size = left_node->end - left_node->start;
+
+		assignment->assignment.self_add =
+			operand_node->kind == AST_KIND_IDENTIFIER &&
+			operand_node->end - operand_node->start == size &&
+			memcmp(lower->src + operand_node->start, lower->src + left_node->start, size) == 0;
+	}
+
+	return id;
+}
+
+// Turn an import path (e.g. 'a.b.c') into a path relative to the importing file (e.g. "a/b/c.fl").
+
+static flamingo_node_t lower_import(lower_t* lower, TSNode node) {
+	TSNode const relative_node = ts_node_child_by_field_id(node, field_relative);
+	TSNode path_node = ts_node_child_by_field_id(node, field_path);
+
+	if (!lower_is(path_node, sym_import_path)) {
+		return lower_invalid(lower, node, "expected import_path for path, got %s", lower_type_str(path_node));
+	}
+
+	char* path = NULL;
+	size_t path_len = 0;
+
+	while (!ts_node_is_null(path_node)) {
+		// Get current path component (bit).
+
+		TSNode const bit_node = ts_node_child_by_field_id(path_node, field_bit);
+
+		if (!lower_is(bit_node, sym_identifier)) {
+			free(path);
+			return lower_invalid(lower, node, "expected identifier for bit, got %s", lower_type_str(bit_node));
+		}
+
+		size_t const start = ts_node_start_byte(bit_node);
+		size_t const end = ts_node_end_byte(bit_node);
+
+		char const* const bit = lower->src + start;
+		size_t const size = end - start;
+
+		if (memchr(bit, '\0', size) != NULL) {
+			free(path);
+			return lower_invalid(lower, node, "one of the import path components contains a null byte somehow");
+		}
+
+		// Add it to our path accumulator, separated by slashes.
+
+		path = realloc(path, path_len + size + 1);
+		assert(path != NULL);
+
+		memcpy(path + path_len, bit, size);
+		path_len += size + 1;
+		path[path_len - 1] = '/';
+
+		// Get the rest of the path.
+
+		path_node = ts_node_child_by_field_id(path_node, field_rest);
+
+		if (!ts_node_is_null(path_node) && !lower_is(path_node, sym_import_path)) {
+			free(path);
+			return lower_invalid(lower, node, "expected import_path for rest, got %s", lower_type_str(path_node));
+		}
+	}
+
+	char* import_path = NULL;
+	int const rv = asprintf(&import_path, "%.*s.fl", (int) path_len - 1, path);
+	free(path);
+	assert(rv >= 0 && import_path != NULL);
+
+	uint32_t const str = lower_str(lower, import_path, rv);
+	free(import_path);
+
+	flamingo_node_t const id = lower_alloc(lower, AST_KIND_IMPORT, node);
+	ast_node_t* const import = lower_node(lower, id);
+
+	import->import.is_relative = !ts_node_is_null(relative_node);
+	import->import.path = str;
+
+	return id;
+}
+
+// Returns 'AST_NULL' for anything which doesn't need to be executed at all (e.g. comments).
+
+static flamingo_node_t lower_statement_kind(lower_t* lower, TSNode node) {
+	// Line insensitive statements, which are only wrapped by a hidden node.
+
+	switch (ts_node_symbol(node)) {
+	case anon_sym_LF:
+	case anon_sym_SEMI:
+	case sym_comment:
+	case sym_doc_comment:
+		return AST_NULL;
+	case sym_block:
+		return lower_block(lower, node);
+	case sym_function_declaration:
+		return lower_function_declaration(lower, node, FLAMINGO_FN_KIND_FUNCTION);
+	case sym_class_declaration:
+		return lower_function_declaration(lower, node, FLAMINGO_FN_KIND_CLASS);
+	case sym_if_chain:
+		return lower_if_chain(lower, node);
+	case sym_for_loop:
+		return lower_for_loop(lower, node);
+	case sym_break:
+		return lower_alloc(lower, AST_KIND_BREAK, node);
+	case sym_continue:
+		return lower_alloc(lower, AST_KIND_CONTINUE, node);
+	case sym_statement:
+		break;
+	default:
+		return lower_invalid(lower, node, "unknown statement type: %s", ts_node_type(node));
+	}
+
+	// All the line sensitive statements (which are wrapped by an explicit 'statement' node).
+
+	if (ts_node_child_count(node) != 1) {
+		return lower_invalid(lower, node, "unknown statement type: %s", ts_node_type(node));
+	}
+
+	TSNode const child = ts_node_child(node, 0);
+
+	switch (ts_node_symbol(child)) {
+	case sym_print:
+		return lower_print(lower, child);
+	case sym_return:
+		return lower_return(lower, child);
+	case sym_assert:
+		return lower_assert(lower, child);
+	case sym_var_decl:
+		return lower_var_decl(lower, child);
+	case sym_assignment:
+		return lower_assignment(lower, child);
+	case sym_proto:
+		return lower_function_declaration(lower, child, FLAMINGO_FN_KIND_EXTERN);
+	case sym_expression: {
+		flamingo_node_t const expr = lower_expr_inner(lower, child);
+
+		flamingo_node_t const id = lower_alloc(lower, AST_KIND_EXPR_STATEMENT, child);
+		lower_node(lower, id)->expr_statement.expr = expr;
+
+		return id;
+	}
+	case sym_import:
+		return lower_import(lower, child);
+	default:
+		return lower_invalid(lower, child, "unknown statement type: %s", ts_node_type(child));
+	}
+}
+
+static flamingo_node_t lower_statement(lower_t* lower, TSNode node) {
+	if (lower->nesting == LOWER_MAX_NESTING) {
+		return lower_invalid(lower, node, "statement nested more than %d levels deep", LOWER_MAX_NESTING);
+	}
+
+	lower->nesting++;
+
+	if (lower->nesting > lower->max_nesting) {
+		lower->max_nesting = lower->nesting;
+	}
+
+	flamingo_node_t const id = lower_statement_kind(lower, node);
+	lower->nesting--;
+
+	return id;
+}
+
+static flamingo_ast_t* lower_source_file(char const* src, TSNode root) {
+	assert(ts_node_symbol(root) == sym_source_file);
+
+	// Make sure no symbol in the grammar is aliased to another, as nodes are compared against symbols straight from 'parser.c' (see 'lower_is').
+
+	for (TSSymbol symbol = 0; symbol < SYMBOL_COUNT; symbol++) {
+		assert(ts_symbol_map[symbol] == symbol);
+	}
+
+	flamingo_ast_t* const ast = calloc(1, sizeof *ast);
+	assert(ast != NULL);
+
+	lower_t lower = {
+		.src = src,
+		.ast = ast,
+	};
+
+	// Reserve the null node and the descriptor of callables without parameters.
+
+	lower_alloc(&lower, AST_KIND_NULL, (TSNode) {0});
+	lower_call_desc(&lower, AST_NULL, false, 0);
+
+	// Unlike blocks, we go through all the children of the source file, not just the named ones.
+
+	lower_buf_t buf = {0};
+
+	lower_children_t children = lower_children(&lower, root, false);
+	TSNode child;
+
+	while (lower_next_child(&lower, &children, &child)) {
+		flamingo_node_t const stmt = lower_statement(&lower, child);
+
+		if (stmt != AST_NULL) {
+			lower_buf_push(&buf, stmt);
+		}
+	}
+
+	lower_children_end(&lower, &children);
+
+	ast_list_t const stmts = lower_buf_commit(&lower, &buf);
+
+	ast->root = lower_alloc(&lower, AST_KIND_SOURCE_FILE, root);
+	lower_node(&lower, ast->root)->block.stmts = stmts;
+
+	free(lower.const_index);
+
+	for (size_t i = 0; i < lower.cursor_capacity; i++) {
+		ts_tree_cursor_delete(&lower.cursors[i]);
+	}
+
+	free(lower.cursors);
+
+	return ast;
+}
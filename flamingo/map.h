@@ -0,0 +1,183 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Maps.
+ *
+ * A map's entries live in two parallel arrays of keys and values, kept in insertion order, which is the order for loops and 'repr' walk them in.
+ * Both arrays grow geometrically, so inserting an entry is amortized O(1).
+ *
+ * Small maps are searched linearly with {@link val_eq}.
+ * Once a map has more than {@link MAP_INDEX_THRESHOLD} entries, it also keeps an open-addressing hash index of its entries, keyed by {@link val_hash}.
+ * Keys are hashed as they're inserted, so vector and map keys are snapshotted when inserted (see {@link map_key_snapshot}) for their hash to stay the same even if what they were inserted from is then modified in-place.
+ *
+ * A map which shares its entries with its copies (see {@link val_detach}) must be detached before inserting into it.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define MAP_INDEX_THRESHOLD 8
+
+static void map_index_insert(flamingo_val_t* map, size_t i) {
+	size_t const mask = map->map.index_capacity - 1;
+
+	// Linear probing.
+	// Like with scopes, entries are indexed in insertion order, so if a key is somehow in the map twice, the first entry is the one which will be found.
+
+	for (size_t bucket = val_hash(map->map.keys[i]) & mask;; bucket = (bucket + 1) & mask) {
+		if (map->map.index[bucket] == 0) {
+			map->map.index[bucket] = i + 1;
+			return;
+		}
+	}
+}
+
+static void map_index_rebuild(flamingo_val_t* map) {
+	// Keep the load factor under a half.
+
+	size_t capacity = 16;
+
+	while (capacity < map->map.count * 2) {
+		capacity *= 2;
+	}
+
+	free(map->map.index);
+
+	map->map.index_capacity = capacity;
+	map->map.index = calloc(capacity, sizeof *map->map.index);
+	assert(map->map.index != NULL);
+
+	for (size_t i = 0; i < map->map.count; i++) {
+		map_index_insert(map, i);
+	}
+}
+
+static void map_reserve(flamingo_val_t* map, size_t capacity) {
+	assert(map->map.shared == NULL); // Must be detached first.
+
+	if (capacity <= map->map.capacity) {
+		return;
+	}
+
+	map->map.capacity = capacity;
+
+	map->map.keys = realloc(map->map.keys, capacity * sizeof *map->map.keys);
+	assert(map->map.keys != NULL);
+
+	map->map.vals = realloc(map->map.vals, capacity * sizeof *map->map.vals);
+	assert(map->map.vals != NULL);
+}
+
+static flamingo_val_t** map_find(flamingo_val_t* map, flamingo_val_t* key) {
+	assert(map->kind == FLAMINGO_VAL_KIND_MAP);
+
+	if (map->map.index != NULL) {
+		size_t const mask = map->map.index_capacity - 1;
+
+		for (size_t bucket = val_hash(key) & mask; map->map.index[bucket] != 0; bucket = (bucket + 1) & mask) {
+			size_t const i = map->map.index[bucket] - 1;
+
+			if (val_eq(map->map.keys[i], key)) {
+				return &map->map.vals[i];
+			}
+		}
+
+		return NULL;
+	}
+
+	for (size_t i = 0; i < map->map.count; i++) {
+		if (val_eq(map->map.keys[i], key)) {
+			return &map->map.vals[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Take a snapshot of a key to insert into a map, taking ownership of the reference to it.
+// Vectors and maps are the only values which can be modified in-place while referenced elsewhere, so they're copied, along with any vector or map within them.
+// This is cheap, as copies share their elements with the original until either is modified (see 'val_detach').
+
+static bool map_key_is_container(flamingo_val_t const* key) {
+	return key->kind == FLAMINGO_VAL_KIND_VEC || key->kind == FLAMINGO_VAL_KIND_MAP;
+}
+
+static flamingo_val_t* map_key_snapshot(flamingo_val_t* key) {
+	if (!map_key_is_container(key)) {
+		return key;
+	}
+
+	bool const is_vec = key->kind == FLAMINGO_VAL_KIND_VEC;
+
+	flamingo_val_t* const snapshot = val_copy(key);
+	val_decref(key);
+
+	// Elements only need to be copied themselves if they're containers too.
+
+	size_t const count = is_vec ? snapshot->vec.count : snapshot->map.count;
+	bool nested = false;
+
+	for (size_t i = 0; i < count && !nested; i++) {
+		if (is_vec) {
+			nested = map_key_is_container(snapshot->vec.elems[i]);
+		}
+
+		else {
+			nested = map_key_is_container(snapshot->map.keys[i]) || map_key_is_container(snapshot->map.vals[i]);
+		}
+	}
+
+	if (!nested) {
+		return snapshot;
+	}
+
+	// Snapshots are equal to what they're taken of, so a map's index is still valid once its entries are replaced by theirs.
+
+	val_detach(snapshot);
+
+	for (size_t i = 0; i < count; i++) {
+		if (is_vec) {
+			snapshot->vec.elems[i] = map_key_snapshot(snapshot->vec.elems[i]);
+		}
+
+		else {
+			snapshot->map.keys[i] = map_key_snapshot(snapshot->map.keys[i]);
+			snapshot->map.vals[i] = map_key_snapshot(snapshot->map.vals[i]);
+		}
+	}
+
+	return snapshot;
+}
+
+static flamingo_val_t** map_insert(flamingo_val_t* map, flamingo_val_t* key, flamingo_val_t* val) {
+	assert(map->kind == FLAMINGO_VAL_KIND_MAP);
+	assert(map->map.shared == NULL); // Must be detached first.
+
+	if (map->map.count == map->map.capacity) {
+		map_reserve(map, map->map.capacity == 0 ? 4 : map->map.capacity * 2);
+	}
+
+	size_t const i = map->map.count++;
+
+	map->map.keys[i] = map_key_snapshot(key);
+	map->map.vals[i] = val;
+
+	// Index the entry if the map is large enough to have an index.
+
+	if (map->map.count > MAP_INDEX_THRESHOLD) {
+		if (map->map.count * 2 > map->map.index_capacity) {
+			map_index_rebuild(map);
+		}
+
+		else {
+			map_index_insert(map, i);
+		}
+	}
+
+	return &map->map.vals[i];
+}
@@ -0,0 +1,187 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Module registry.
+ *
+ * Importing a module runs it in the environment of the importer, so that whatever it declares at its top level ends up in the scope of the import statement.
+ * Rather than loading and running a module again each time it's imported (e.g. by two modules which both use it, or in a function called over and over), the runtime keeps a registry of the modules it imported, keyed by the canonical path of their source.
+ * The first import of a module loads and runs it, and remembers the variables it declared.
+ * Every later import only declares those same variables in its own scope, bound to the values they had once the module finished running.
+ * A module which only has side effects (e.g. assigning to a variable of the importer) thus only has them once.
+ *
+ * The registry belongs to the instance created by the host, and is shared with every module imported into it, directly or not (see {@link flamingo_t#modules}).
+ * Modules are only freed along with it, as values they created can be referred to from anywhere in the runtime.
+ */
+
+#pragma once
+
+#include "common.h"
+#include "scope.h"
+#include "val.h"
+#include "var.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+	MODULE_LOADING,
+	MODULE_LOADED,
+	MODULE_FAILED,
+} module_state_t;
+
+struct flamingo_module_t {
+	char* path; // Canonical path of the module's source.
+	size_t path_hash;
+
+	module_state_t state;
+
+	char* src;
+	flamingo_t flamingo;
+
+	// Variables the module declared at its top level, which hold a reference to their values.
+
+	size_t export_count;
+	flamingo_var_t* exports;
+
+	flamingo_module_stats_t stats;
+};
+
+struct flamingo_modules_t {
+	size_t count;
+	flamingo_module_t** modules;
+};
+
+static uint64_t module_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static flamingo_module_t* module_find(flamingo_modules_t* modules, char const* path) {
+	if (modules == NULL) {
+		return NULL;
+	}
+
+	size_t const path_size = strlen(path);
+	size_t const hash = scope_hash(path, path_size);
+
+	for (size_t i = 0; i < modules->count; i++) {
+		flamingo_module_t* const module = modules->modules[i];
+
+		if (module->path_hash == hash && strcmp(module->path, path) == 0) {
+			return module;
+		}
+	}
+
+	return NULL;
+}
+
+// Add a module which is about to be loaded to the runtime's registry, which takes ownership of its path.
+
+static flamingo_module_t* module_add(flamingo_t* flamingo, char* path) {
+	if (flamingo->modules == NULL) {
+		flamingo->modules = calloc(1, sizeof *flamingo->modules);
+		assert(flamingo->modules != NULL);
+	}
+
+	flamingo_modules_t* const modules = flamingo->modules;
+
+	modules->modules = realloc(modules->modules, (modules->count + 1) * sizeof *modules->modules);
+	assert(modules->modules != NULL);
+
+	// The module's instance isn't consistent until it's created, so it's fine to destroy it if loading fails before then.
+
+	flamingo_module_t* const module = calloc(1, sizeof *module);
+	assert(module != NULL);
+
+	module->path = path;
+	module->path_hash = scope_hash(path, strlen(path));
+	module->state = MODULE_LOADING;
+
+	module->stats.path = path;
+
+	modules->modules[modules->count++] = module;
+	return module;
+}
+
+// Remember the variables a module declared in the scope it was first imported into, from the given index on.
+
+static void module_export(flamingo_module_t* module, flamingo_scope_t* scope, size_t first) {
+	assert(module->exports == NULL);
+	assert(first <= scope->vars_size);
+
+	module->export_count = scope->vars_size - first;
+
+	if (module->export_count == 0) {
+		return;
+	}
+
+	module->exports = malloc(module->export_count * sizeof *module->exports);
+	assert(module->exports != NULL);
+
+	for (size_t i = 0; i < module->export_count; i++) {
+		flamingo_var_t* const export = &module->exports[i];
+
+		*export = scope->vars[first + i];
+		val_incref(export->val);
+	}
+}
+
+// Declare the variables of an already loaded module in the current scope.
+// A module imported again in a scope it was already imported into has already declared them there, which is fine, but any other variable with the same name is redeclaring it.
+
+static int module_bind(flamingo_t* flamingo, flamingo_module_t* module) {
+	assert(module->state == MODULE_LOADED);
+	flamingo_scope_t* const scope = env_cur_scope(flamingo->env);
+
+	for (size_t i = 0; i < module->export_count; i++) {
+		flamingo_var_t const* const export = &module->exports[i];
+		flamingo_var_t* const prev_var = scope_shallow_find_var(scope, export->key, export->key_size);
+
+		if (prev_var != NULL) {
+			if (prev_var->val == export->val) {
+				continue;
+			}
+
+			return error(flamingo, "the %s '%.*s' has already been declared in this scope", val_role_str(prev_var->val), (int) export->key_size, export->key);
+		}
+
+		flamingo_var_t* const var = scope_add_symbol_var(scope, export->key, export->key_size);
+		var->is_static = export->is_static;
+
+		var_set_val(var, val_incref(export->val));
+	}
+
+	return 0;
+}
+
+// Free every module in the registry, in the reverse order they were added in, as a module's exports may be keyed by symbols from the pool of a module loaded before it.
+
+static void modules_free(flamingo_modules_t* modules) {
+	if (modules == NULL) {
+		return;
+	}
+
+	for (size_t i = modules->count; i-- > 0;) {
+		flamingo_module_t* const module = modules->modules[i];
+
+		for (size_t j = 0; j < module->export_count; j++) {
+			val_decref(module->exports[j].val);
+		}
+
+		free(module->exports);
+
+		flamingo_destroy(&module->flamingo);
+
+		free(module->src);
+		free(module->path);
+		free(module);
+	}
+
+	free(modules->modules);
+	free(modules);
+}
@@ -0,0 +1,244 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Allocation pools.
+ *
+ * Running a program allocates and frees values, scopes, and environments constantly: every temporary an expression produces is a new value, and every block entry or call pushes a new scope.
+ * Instead of going to malloc for each of these, each flamingo instance has a pool which carves them out of large slabs.
+ * Blocks are sorted into power-of-two size classes, each with its own free list, so a freed block is reused by the next allocation of the same class.
+ * The variable arrays of scopes and the scope stacks of environments, which grow and shrink as scripts run, come from the same size classes.
+ * Anything larger than the largest size class goes straight to malloc.
+ *
+ * Values, scopes, and environments remember the pool they were allocated from, so they can be freed from anywhere (e.g. a value created by an imported module, or one the host holds onto).
+ * Objects with no pool (e.g. values made with {@link flamingo_val_make_int} and friends) are just allocated with malloc.
+ * For the same reason, a pool outlives its instance until its last block is freed.
+ *
+ * Slabs hide use-after-frees and overflows from tools like AddressSanitizer, so define FLAMINGO_NO_POOL when building to allocate every block with malloc instead.
+ * This is the default when building with AddressSanitizer (which is what 'build.sh' does), unless FLAMINGO_FORCE_POOL is defined to test the slabs themselves.
+ * The allocation counters are kept either way, so the two can be compared.
+ */
+
+#pragma once
+
+#if defined(__SANITIZE_ADDRESS__)
+# define POOL_ASAN 1
+#elif defined(__has_feature)
+# if __has_feature(address_sanitizer)
+#  define POOL_ASAN 1
+# endif
+#endif
+
+#if defined(POOL_ASAN) && !defined(FLAMINGO_FORCE_POOL) && !defined(FLAMINGO_NO_POOL)
+# define FLAMINGO_NO_POOL
+#endif
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_MIN_BLOCK_SIZE 16
+#define POOL_CLASS_COUNT 8 // So the largest size class is 2 KiB.
+#define POOL_SLAB_SIZE (64 * 1024)
+
+typedef struct pool_block_t pool_block_t;
+typedef struct pool_slab_t pool_slab_t;
+
+// Free blocks are linked together through their first bytes.
+
+struct pool_block_t {
+	pool_block_t* next;
+};
+
+struct pool_slab_t {
+	pool_slab_t* next;
+	max_align_t data[];
+};
+
+struct flamingo_pool_t {
+	// Set once the instance which owns the pool is destroyed, after which the pool is freed as soon as it has no more live blocks.
+
+	bool orphaned;
+	size_t live;
+
+	pool_block_t* free_lists[POOL_CLASS_COUNT];
+
+	// Slabs are never given back until the pool is freed, and new blocks are carved out of the most recent one.
+
+	pool_slab_t* slabs;
+	char* bump;
+	size_t bump_left;
+
+	flamingo_alloc_stats_t stats;
+
+	// Symbols interned into the pool (see 'symbol.h'), in an open-addressing hash table.
+
+	size_t symbol_count;
+	size_t symbol_capacity;
+	symbol_t** symbols;
+};
+
+static flamingo_pool_t* pool_alloc(void) {
+	flamingo_pool_t* const pool = calloc(1, sizeof *pool);
+	assert(pool != NULL);
+
+	return pool;
+}
+
+static void pool_free(flamingo_pool_t* pool) {
+	pool_slab_t* next;
+
+	for (pool_slab_t* slab = pool->slabs; slab != NULL; slab = next) {
+		next = slab->next;
+		free(slab);
+	}
+
+	symbol_table_free(pool);
+	free(pool);
+}
+
+static void pool_release(flamingo_pool_t* pool) {
+	pool->orphaned = true;
+
+	if (pool->live == 0) {
+		pool_free(pool);
+	}
+}
+
+#if !defined(FLAMINGO_NO_POOL)
+// Size classes go 16, 32, 64, &c.
+// Returns POOL_CLASS_COUNT if the size is too large for any of them.
+
+static size_t pool_class(size_t size) {
+	size_t class = 0;
+
+	for (size_t class_size = POOL_MIN_BLOCK_SIZE; class_size < size && class < POOL_CLASS_COUNT; class_size *= 2) {
+		class++;
+	}
+
+	return class;
+}
+#endif
+
+static void* pool_alloc_block(flamingo_pool_t* pool, size_t size) {
+	if (pool == NULL) {
+		void* const block = malloc(size);
+		assert(block != NULL);
+
+		return block;
+	}
+
+	pool->stats.allocs++;
+	pool->live++;
+
+#if defined(FLAMINGO_NO_POOL)
+	pool->stats.mallocs++;
+
+	void* const block = malloc(size);
+	assert(block != NULL);
+
+	return block;
+#else
+	size_t const class = pool_class(size);
+
+	if (class == POOL_CLASS_COUNT) {
+		pool->stats.mallocs++;
+
+		void* const block = malloc(size);
+		assert(block != NULL);
+
+		return block;
+	}
+
+	// Reuse a freed block of the same size class if there is one.
+
+	pool_block_t* const block = pool->free_lists[class];
+
+	if (block != NULL) {
+		pool->free_lists[class] = block->next;
+		return block;
+	}
+
+	// Otherwise, carve a new one out of the current slab, starting a new slab if it's full.
+	// Whatever is left of the previous slab is simply wasted.
+
+	size_t const class_size = (size_t) POOL_MIN_BLOCK_SIZE << class;
+
+	if (pool->bump_left < class_size) {
+		pool->stats.mallocs++;
+
+		pool_slab_t* const slab = malloc(sizeof *slab + POOL_SLAB_SIZE);
+		assert(slab != NULL);
+
+		slab->next = pool->slabs;
+		pool->slabs = slab;
+
+		pool->bump = (char*) slab->data;
+		pool->bump_left = POOL_SLAB_SIZE;
+	}
+
+	void* const carved = pool->bump;
+
+	pool->bump += class_size;
+	pool->bump_left -= class_size;
+
+	return carved;
+#endif
+}
+
+static void pool_free_block(flamingo_pool_t* pool, void* ptr, size_t size) {
+	if (ptr == NULL) {
+		return;
+	}
+
+	if (pool == NULL) {
+		free(ptr);
+		return;
+	}
+
+#if defined(FLAMINGO_NO_POOL)
+	free(ptr);
+#else
+	size_t const class = pool_class(size);
+
+	if (class == POOL_CLASS_COUNT) {
+		free(ptr);
+	}
+
+	else {
+		pool_block_t* const block = ptr;
+
+		block->next = pool->free_lists[class];
+		pool->free_lists[class] = block;
+	}
+#endif
+
+	assert(pool->live > 0);
+	pool->live--;
+
+	if (pool->orphaned && pool->live == 0) {
+		pool_free(pool);
+	}
+}
+
+static void* pool_realloc_block(flamingo_pool_t* pool, void* ptr, size_t old_size, size_t size) {
+	if (ptr == NULL) {
+		return pool_alloc_block(pool, size);
+	}
+
+#if !defined(FLAMINGO_NO_POOL)
+	// Blocks of the same size class are already big enough.
+
+	if (pool != NULL && pool_class(size) < POOL_CLASS_COUNT && pool_class(size) == pool_class(old_size)) {
+		return ptr;
+	}
+#endif
+
+	void* const block = pool_alloc_block(pool, size);
+	memcpy(block, ptr, old_size < size ? old_size : size);
+	pool_free_block(pool, ptr, old_size);
+
+	return block;
+}
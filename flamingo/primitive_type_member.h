@@ -35,7 +35,6 @@ static void primitive_type_member_free(flamingo_t* flamingo) {
 		for (size_t i = 0; i < count; i++) {
 			flamingo_var_t* const var = &vars[i];
 			val_decref(var->val);
-			free(var->key);
 		}
 
 		if (vars != NULL) {
@@ -75,16 +74,14 @@ static int primitive_type_member_add(flamingo_t* flamingo, flamingo_val_kind_t t
 
 	var->val = NULL;
 	var->key_size = key_size;
-	var->key = malloc(key_size);
-	assert(var->key != NULL);
-	memcpy(var->key, key, key_size);
+	var->key = symbol_intern(flamingo->pool, key, key_size);
 
 	flamingo->primitive_type_members[type].count = count;
 	flamingo->primitive_type_members[type].vars = vars;
 
 	// Finally, create the actual value.
 
-	flamingo_val_t* const val = val_alloc();
+	flamingo_val_t* const val = val_alloc(flamingo->pool);
 	var_set_val(var, val);
 
 	val->kind = FLAMINGO_VAL_KIND_FN;
@@ -111,6 +108,12 @@ static int primitive_type_member_std(flamingo_t* flamingo) {
 	ADD(FLAMINGO_VAL_KIND_VEC, "len", vec_len);
 	ADD(FLAMINGO_VAL_KIND_VEC, "map", vec_map);
 	ADD(FLAMINGO_VAL_KIND_VEC, "where", vec_where);
+	ADD(FLAMINGO_VAL_KIND_VEC, "push", vec_push);
+	ADD(FLAMINGO_VAL_KIND_VEC, "pop", vec_pop);
+	ADD(FLAMINGO_VAL_KIND_VEC, "insert", vec_insert);
+	ADD(FLAMINGO_VAL_KIND_VEC, "remove", vec_remove);
+	ADD(FLAMINGO_VAL_KIND_VEC, "reserve", vec_reserve);
+	ADD(FLAMINGO_VAL_KIND_VEC, "clear", vec_clear);
 
 	return 0;
 }
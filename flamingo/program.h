@@ -0,0 +1,146 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Programs.
+ *
+ * Parsing a source, lowering it, and resolving its identifiers gives the same AST every time, so this is done once into a program which any number of instances can run.
+ * A program is never modified once created, except for its reference count and the bytecode the VM compiles from its AST as it goes, which are both only ever changed atomically.
+ * This means instances on different threads can share a program without any locking.
+ *
+ * Whatever an instance caches about a program at runtime is tied to its pool, so each instance keeps its own (see 'flamingo_const_cache_t').
+ *
+ * Programs can also be loaded from, and saved to, a cache of their AST, so that their source doesn't have to be parsed at all (see 'cache.h').
+ */
+
+#pragma once
+
+#include "ast.h"
+#include "cache.h"
+#include "common.h"
+#include "lower.h"
+#include "resolve.h"
+#include "vm.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct flamingo_program_t {
+	atomic_size_t ref_count;
+
+	// Whether the program has its own copy of the source, which is only the case for programs created by 'flamingo_program_create'.
+
+	bool owns_src;
+	char* src;
+	size_t src_size;
+
+	flamingo_ast_t* ast;
+
+	// If the AST was loaded from a cache, the mapping of the cache file its arrays point into (see 'cache.h').
+
+	void* map;
+	size_t map_size;
+};
+
+static flamingo_ast_t* program_parse(char const* src, size_t src_size) {
+	TSParser* const parser = ts_parser_new();
+
+	if (parser == NULL) {
+		return NULL;
+	}
+
+	ts_parser_set_language(parser, tree_sitter_flamingo());
+	TSTree* const tree = ts_parser_parse_string(parser, NULL, src, src_size);
+
+	if (tree == NULL) {
+		ts_parser_delete(parser);
+		return NULL;
+	}
+
+	// TODO make sure tree is coherent
+	//      I don't know if Tree-sitter has a simple way to check AST-coherency itself but otherwise just go down the tree and look for any MISSING or UNEXPECTED nodes
+
+	// Lower the tree into our own AST.
+	// Once that's done, we don't need anything from Tree-sitter anymore.
+
+	flamingo_ast_t* const ast = lower_source_file(src, ts_tree_root_node(tree));
+
+	ts_tree_delete(tree);
+	ts_parser_delete(parser);
+
+	// Bind identifiers to where their variables will be, so they don't have to be looked up by name.
+
+	resolve(ast, src);
+
+	return ast;
+}
+
+// Create a new program from a source, loading its AST from the cache at 'cache_path' if it's up to date, or parsing it and writing the cache otherwise.
+// No cache is used if 'cache_path' is NULL.
+// If the program doesn't own the source, the caller has to keep it around for as long as the program is.
+
+static flamingo_program_t* program_alloc(char* src, size_t src_size, bool owns_src, char const* cache_path) {
+	flamingo_program_t* const program = calloc(1, sizeof *program);
+	assert(program != NULL);
+
+	atomic_init(&program->ref_count, 1);
+
+	program->owns_src = owns_src;
+	program->src = src;
+	program->src_size = src_size;
+
+	if (cache_path != NULL) {
+		program->ast = cache_load(cache_path, src, src_size, &program->map, &program->map_size);
+
+		if (program->ast != NULL) {
+			return program;
+		}
+	}
+
+	program->ast = program_parse(src, src_size);
+
+	if (program->ast == NULL) {
+		free(program);
+		return NULL;
+	}
+
+	if (cache_path != NULL) {
+		cache_store(cache_path, program->ast, src, src_size);
+	}
+
+	return program;
+}
+
+static bool program_cached(flamingo_program_t* program) {
+	return program->map != NULL;
+}
+
+static flamingo_program_t* program_incref(flamingo_program_t* program) {
+	atomic_fetch_add(&program->ref_count, 1);
+	return program;
+}
+
+static void program_decref(flamingo_program_t* program) {
+	if (atomic_fetch_sub(&program->ref_count, 1) > 1) {
+		return;
+	}
+
+	// That was the last reference, so free the AST and any bytecode compiled from it.
+
+	vm_free_code(program->ast);
+
+	if (program->map != NULL) {
+		cache_unmap(program->ast, program->map, program->map_size);
+	}
+
+	else {
+		ast_free(program->ast);
+	}
+
+	if (program->owns_src) {
+		free(program->src);
+	}
+
+	free(program);
+}
@@ -5,9 +5,12 @@
 
 #include "../common.h"
 #include "../val.h"
+#include "../vec.h"
 
 #include "../grammar/call.h"
 
+#include <inttypes.h>
+
 static inline int vec_len(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
 	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
 
@@ -35,15 +38,20 @@ static inline int vec_map(flamingo_t* flamingo, flamingo_val_t* self, flamingo_a
 	}
 
 	// Actually map the vector.
+	// The function may modify the vector in-place (e.g. by pushing to it, which can move its elements), so get each element from it again once the previous one is mapped.
+	// Like for loops, this stops early if it shrinks (see 'for_loop_elem').
+
+	size_t const count = self->vec.count;
+	val_incref(self);
 
-	flamingo_val_t* const vec = val_alloc();
+	flamingo_val_t* const vec = val_alloc(flamingo->pool);
 	vec->kind = FLAMINGO_VAL_KIND_VEC;
-	vec->vec.count = self->vec.count;
-	vec->vec.elems = calloc(vec->vec.count, sizeof *vec->vec.elems);
+	vec->vec.capacity = count;
+	vec->vec.elems = calloc(count, sizeof *vec->vec.elems);
 	assert(vec->vec.elems != NULL);
 
-	for (size_t i = 0; i < vec->vec.count; i++) {
-		flamingo_val_t* const elem = self->vec.elems[i];
+	for (size_t i = 0; i < count && i < self->vec.count; i++) {
+		flamingo_val_t* const elem = val_incref(self->vec.elems[i]);
 		flamingo_val_t* const args[] = {elem};
 
 		flamingo_arg_list_t arg_list = {
@@ -51,12 +59,19 @@ static inline int vec_map(flamingo_t* flamingo, flamingo_val_t* self, flamingo_a
 			.args = (void*) args,
 		};
 
-		if (call(flamingo, fn, NULL, &vec->vec.elems[i], &arg_list) < 0) {
+		int const res = call(flamingo, fn, NULL, &vec->vec.elems[i], &arg_list);
+		val_decref(elem);
+
+		if (res < 0) {
+			val_decref(self);
 			val_free(vec);
 			return -1;
 		}
+
+		vec->vec.count++;
 	}
 
+	val_decref(self);
 	*rv = vec;
 
 	return 0;
@@ -78,14 +93,16 @@ static inline int vec_where(flamingo_t* flamingo, flamingo_val_t* self, flamingo
 	}
 
 	// Actually filter the vector.
+	// Like with 'vec.map', the function may modify the vector in-place.
+
+	size_t const count = self->vec.count;
+	val_incref(self);
 
-	flamingo_val_t* const vec = val_alloc();
+	flamingo_val_t* const vec = val_alloc(flamingo->pool);
 	vec->kind = FLAMINGO_VAL_KIND_VEC;
-	vec->vec.count = 0;
-	vec->vec.elems = NULL;
 
-	for (size_t i = 0; i < self->vec.count; i++) {
-		flamingo_val_t* const elem = self->vec.elems[i];
+	for (size_t i = 0; i < count && i < self->vec.count; i++) {
+		flamingo_val_t* const elem = val_incref(self->vec.elems[i]);
 		flamingo_val_t* const args[] = {elem};
 
 		flamingo_arg_list_t arg_list = {
@@ -96,29 +113,172 @@ static inline int vec_where(flamingo_t* flamingo, flamingo_val_t* self, flamingo
 		flamingo_val_t* keep = NULL;
 
 		if (call(flamingo, fn, NULL, &keep, &arg_list) < 0) {
+			val_decref(elem);
+			val_decref(self);
 			val_free(vec);
 			return -1;
 		}
 
 		if (keep->kind != FLAMINGO_VAL_KIND_BOOL) {
+			int const res = error(flamingo, "'vec.where' expected 'fn' to return a boolean, got a %s", val_type_str(keep));
+
+			val_decref(elem);
+			val_decref(self);
 			val_free(keep);
 			val_free(vec);
-			return error(flamingo, "'vec.where' expected 'fn' to return a boolean, got a %s", val_type_str(keep));
+
+			return res;
 		}
 
-		if (!keep->boolean.boolean) {
-			val_free(keep);
-			continue;
+		if (keep->boolean.boolean) {
+			vec_push_elem(vec, val_copy(elem));
 		}
 
 		val_free(keep);
-
-		vec->vec.elems = realloc(vec->vec.elems, ++vec->vec.count * sizeof *vec->vec.elems);
-		assert(vec->vec.elems != NULL);
-		vec->vec.elems[vec->vec.count - 1] = val_copy(elem);
+		val_decref(elem);
 	}
 
+	val_decref(self);
 	*rv = vec;
 
 	return 0;
 }
+
+// Members which modify the vector do so in-place, so the change is seen through every reference to it.
+// The vector has to be detached from its copies first though.
+
+static inline int vec_push(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 1) {
+		return error(flamingo, "'vec.push' expected 1 argument, got %zu", args->count);
+	}
+
+	val_detach(self);
+	vec_push_elem(self, val_incref(args->args[0]));
+
+	return 0;
+}
+
+static inline int vec_pop(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 0) {
+		return error(flamingo, "'vec.pop' expected 0 arguments, got %zu", args->count);
+	}
+
+	if (self->vec.count == 0) {
+		return error(flamingo, "'vec.pop' can't pop from an empty vector");
+	}
+
+	val_detach(self);
+	*rv = vec_remove_elem(self, self->vec.count - 1);
+
+	return 0;
+}
+
+// Get the position an index argument refers to, counting from the end if it's negative like when indexing.
+// If 'end' is set, the index may also refer to the position just past the last element.
+
+static int vec_pos_arg(flamingo_t* flamingo, char const* name, flamingo_val_t* self, flamingo_val_t* arg, bool end, size_t* pos) {
+	if (arg->kind != FLAMINGO_VAL_KIND_INT) {
+		return error(flamingo, "'vec.%s' expected 'index' argument to be an integer, got a %s", name, val_type_str(arg));
+	}
+
+	int64_t const index = arg->integer.integer;
+	size_t const count = self->vec.count + end;
+
+	if (
+		(index >= 0 && (size_t) index >= count) ||
+		(index < 0 && (size_t) -index > self->vec.count)
+	) {
+		return error(flamingo, "'vec.%s' index %" PRId64 " is out of bounds for vector of size %zu", name, index, self->vec.count);
+	}
+
+	*pos = index >= 0 ? (size_t) index : (size_t) (self->vec.count + index);
+	return 0;
+}
+
+static inline int vec_insert(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 2) {
+		return error(flamingo, "'vec.insert' expected 2 arguments, got %zu", args->count);
+	}
+
+	size_t pos;
+
+	if (vec_pos_arg(flamingo, "insert", self, args->args[0], true, &pos) < 0) {
+		return -1;
+	}
+
+	val_detach(self);
+	vec_insert_elem(self, pos, val_incref(args->args[1]));
+
+	return 0;
+}
+
+static inline int vec_remove(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 1) {
+		return error(flamingo, "'vec.remove' expected 1 argument, got %zu", args->count);
+	}
+
+	size_t pos;
+
+	if (vec_pos_arg(flamingo, "remove", self, args->args[0], false, &pos) < 0) {
+		return -1;
+	}
+
+	val_detach(self);
+	*rv = vec_remove_elem(self, pos);
+
+	return 0;
+}
+
+static inline int vec_reserve(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 1) {
+		return error(flamingo, "'vec.reserve' expected 1 argument, got %zu", args->count);
+	}
+
+	flamingo_val_t* const capacity = args->args[0];
+
+	if (capacity->kind != FLAMINGO_VAL_KIND_INT) {
+		return error(flamingo, "'vec.reserve' expected 'capacity' argument to be an integer, got a %s", val_type_str(capacity));
+	}
+
+	if (capacity->integer.integer < 0) {
+		return error(flamingo, "'vec.reserve' expected 'capacity' argument to be non-negative, got %" PRId64, capacity->integer.integer);
+	}
+
+	val_detach(self);
+
+	if (!vec_reserve_elems(self, capacity->integer.integer)) {
+		return error(flamingo, "'vec.reserve' failed to allocate room for %" PRId64 " elements", capacity->integer.integer);
+	}
+
+	return 0;
+}
+
+static inline int vec_clear(flamingo_t* flamingo, flamingo_val_t* self, flamingo_arg_list_t* args, flamingo_val_t** rv) {
+	assert(self->kind == FLAMINGO_VAL_KIND_VEC);
+
+	if (args->count != 0) {
+		return error(flamingo, "'vec.clear' expected 0 arguments, got %zu", args->count);
+	}
+
+	val_detach(self);
+
+	// The capacity is kept, so the vector can be filled up again without growing.
+
+	for (size_t i = 0; i < self->vec.count; i++) {
+		val_decref(self->vec.elems[i]);
+	}
+
+	self->vec.count = 0;
+
+	return 0;
+}
@@ -0,0 +1,385 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Identifier resolution.
+ *
+ * After lowering, every identifier which is read or assigned to is bound to the address its variable will be at when it's evaluated: how many scopes up from the current one it is (its depth), and its index in that scope's variables (its slot).
+ * This works because scopes are pushed lexically (blocks, loop iterations, and calls, which push a parameter scope on top of the environment the callable closed over), and because variables are only ever appended to scopes in the order they are declared in.
+ * At runtime, {@link env_find_var_at} then just has to check that the variable at that address has the right name, instead of searching every scope for it.
+ *
+ * Within a function, we know exactly which of an enclosing scope's declarations have run by the time an identifier is evaluated.
+ * Once we cross into the scopes a function closed over, we don't, because the function could be called at any point, so all of their declarations are considered (the runtime name check takes care of those which haven't run yet).
+ *
+ * Some identifiers can't be bound and are left to be looked up by name:
+ *
+ * - Names which aren't declared anywhere in the source (e.g. names coming from the module which imported this one).
+ * - Names which would have to be looked up past a scope something was imported into, as we don't know what an import declares.
+ * - Names in static members of classes which refer to something outside of them, as static members are also evaluated in the class' static scope, which is shaped differently from the instance scope.
+ */
+
+#pragma once
+
+#include "ast.h"
+#include "common.h"
+
+typedef struct {
+	char const* str;
+	size_t size;
+} resolve_name_t;
+
+typedef struct resolve_scope_t resolve_scope_t;
+
+struct resolve_scope_t {
+	resolve_scope_t* parent;
+	uint32_t level; // Number of scopes below this one.
+
+	// Set on the parameter scope of callables, i.e. the first scope which doesn't exist when the callable is declared.
+
+	bool boundary;
+
+	// Names declared in the scope in order of declaration, and how many of them have been declared by the point we're at.
+
+	size_t name_count;
+	resolve_name_t* names;
+	size_t declared;
+
+	// Whether there's an import anywhere in the scope, and whether there was one before the point we're at.
+
+	bool has_import;
+	bool imported;
+};
+
+typedef struct {
+	flamingo_ast_t* ast;
+	char const* src;
+
+	resolve_scope_t* scope;
+
+	// Level of the outermost scope identifiers may be bound to.
+
+	uint32_t barrier;
+} resolve_t;
+
+static void resolve_expr(resolve_t* r, flamingo_node_t id);
+static void resolve_stmts(resolve_t* r, ast_list_t stmts, bool is_class);
+
+static ast_node_t* resolve_node(resolve_t* r, flamingo_node_t id) {
+	assert(id < r->ast->node_count);
+	return &r->ast->nodes[id];
+}
+
+static void resolve_push(resolve_t* r, resolve_scope_t* scope, bool boundary) {
+	*scope = (resolve_scope_t) {
+		.parent = r->scope,
+		.level = r->scope == NULL ? 0 : r->scope->level + 1,
+		.boundary = boundary,
+	};
+
+	r->scope = scope;
+}
+
+static void resolve_pop(resolve_t* r) {
+	resolve_scope_t* const scope = r->scope;
+
+	r->scope = scope->parent;
+	free(scope->names);
+}
+
+static void resolve_add_name(resolve_scope_t* scope, char const* str, size_t size) {
+	scope->names = realloc(scope->names, (scope->name_count + 1) * sizeof *scope->names);
+	assert(scope->names != NULL);
+
+	scope->names[scope->name_count++] = (resolve_name_t) {
+		.str = str,
+		.size = size,
+	};
+}
+
+static void resolve_add_name_node(resolve_t* r, flamingo_node_t id) {
+	ast_node_t const* const node = resolve_node(r, id);
+	resolve_add_name(r->scope, r->src + node->start, node->end - node->start);
+}
+
+static void resolve_identifier(resolve_t* r, flamingo_node_t id, char const* name, size_t size) {
+	ast_node_t* const node = resolve_node(r, id);
+	bool closed_over = false;
+	uint32_t depth = 0;
+
+	for (resolve_scope_t* scope = r->scope; scope != NULL && scope->level >= r->barrier; scope = scope->parent, depth++) {
+		size_t const count = closed_over ? scope->name_count : scope->declared;
+
+		// Like 'scope_shallow_find_var', take the first variable with that name.
+
+		for (size_t i = 0; i < count; i++) {
+			resolve_name_t const* const candidate = &scope->names[i];
+
+			if (candidate->size == size && memcmp(candidate->str, name, size) == 0) {
+				node->identifier.depth = depth;
+				node->identifier.slot = i;
+
+				return;
+			}
+		}
+
+		if (closed_over ? scope->has_import : scope->imported) {
+			return;
+		}
+
+		if (scope->boundary) {
+			closed_over = true;
+		}
+	}
+}
+
+static void resolve_list(resolve_t* r, ast_list_t list) {
+	for (size_t i = 0; i < list.count; i++) {
+		resolve_expr(r, r->ast->lists[list.first + i]);
+	}
+}
+
+static void resolve_callable(resolve_t* r, flamingo_node_t params, flamingo_node_t body, bool is_class) {
+	resolve_scope_t scope;
+	resolve_push(r, &scope, true);
+
+	// Parameters are all declared at once when the callable is called.
+
+	ast_node_t const* const params_node = resolve_node(r, params);
+
+	if (params_node->kind == AST_KIND_PARAM_LIST) {
+		for (size_t i = 0; i < params_node->param_list.params.count; i++) {
+			ast_node_t const* const param = ast_list_node(r->ast, params_node->param_list.params, i);
+			resolve_add_name_node(r, param->param.ident);
+		}
+	}
+
+	scope.declared = scope.name_count;
+
+	// The body is either a block, which gets its own scope, or an expression.
+
+	ast_node_t const* const body_node = resolve_node(r, body);
+
+	if (body_node->kind == AST_KIND_BLOCK) {
+		resolve_scope_t body_scope;
+		resolve_push(r, &body_scope, false);
+
+		resolve_stmts(r, body_node->block.stmts, is_class);
+		resolve_pop(r);
+	}
+
+	else {
+		resolve_expr(r, body);
+	}
+
+	resolve_pop(r);
+}
+
+static void resolve_expr(resolve_t* r, flamingo_node_t id) {
+	ast_node_t const* const node = resolve_node(r, id);
+
+	switch (node->kind) {
+	case AST_KIND_IDENTIFIER:
+		resolve_identifier(r, id, r->src + node->start, node->end - node->start);
+		break;
+	case AST_KIND_SELF:
+		resolve_identifier(r, id, "self", 4);
+		break;
+	case AST_KIND_LAMBDA:
+		resolve_callable(r, node->lambda.params, node->lambda.body, false);
+		break;
+	case AST_KIND_VEC:
+		resolve_list(r, node->vec.elems);
+		break;
+	case AST_KIND_MAP:
+		resolve_list(r, node->map.items);
+		break;
+	case AST_KIND_CALL:
+		resolve_expr(r, node->call.callable);
+		resolve_list(r, node->call.args);
+		break;
+	case AST_KIND_UNARY_EXPR:
+		resolve_expr(r, node->unary_expr.operand);
+		break;
+	case AST_KIND_BINARY_EXPR:
+		resolve_expr(r, node->binary_expr.left);
+		resolve_expr(r, node->binary_expr.right);
+		break;
+	case AST_KIND_ACCESS:
+		// The accessor is a member name, not a variable.
+
+		resolve_expr(r, node->access.accessed);
+		break;
+	case AST_KIND_INDEX:
+		resolve_expr(r, node->index.indexed);
+		resolve_expr(r, node->index.index);
+		break;
+	default:
+		break;
+	}
+}
+
+static void resolve_block(resolve_t* r, flamingo_node_t id) {
+	ast_node_t const* const node = resolve_node(r, id);
+
+	if (node->kind != AST_KIND_BLOCK) {
+		return;
+	}
+
+	resolve_scope_t scope;
+	resolve_push(r, &scope, false);
+
+	resolve_stmts(r, node->block.stmts, false);
+	resolve_pop(r);
+}
+
+static void resolve_stmt(resolve_t* r, flamingo_node_t id) {
+	ast_node_t const* const node = resolve_node(r, id);
+	resolve_scope_t* const scope = r->scope;
+	uint32_t const barrier = r->barrier;
+
+	switch (node->kind) {
+	case AST_KIND_BLOCK:
+		resolve_block(r, id);
+		break;
+	case AST_KIND_FUNCTION_DECLARATION:
+		// The name is declared before anything in the callable can be evaluated.
+
+		scope->declared++;
+
+		if (node->function_declaration.kind == FLAMINGO_FN_KIND_EXTERN) {
+			break;
+		}
+
+		if (node->function_declaration.is_static) {
+			r->barrier = scope->level + 1;
+		}
+
+		resolve_callable(r, node->function_declaration.params, node->function_declaration.body, node->function_declaration.kind == FLAMINGO_FN_KIND_CLASS);
+		r->barrier = barrier;
+
+		break;
+	case AST_KIND_IF_CHAIN:
+		for (size_t i = 0; i < node->if_chain.branches.count; i += 2) {
+			resolve_expr(r, r->ast->lists[node->if_chain.branches.first + i]);
+			resolve_block(r, r->ast->lists[node->if_chain.branches.first + i + 1]);
+		}
+
+		resolve_block(r, node->if_chain.else_body);
+		break;
+	case AST_KIND_FOR_LOOP: {
+		resolve_expr(r, node->for_loop.iterator);
+
+		// Each iteration has a scope with just the current variable in it, in which the body's scope is pushed.
+
+		resolve_scope_t loop_scope;
+		resolve_push(r, &loop_scope, false);
+
+		resolve_add_name_node(r, node->for_loop.cur_var_name);
+		loop_scope.declared = 1;
+
+		resolve_block(r, node->for_loop.body);
+		resolve_pop(r);
+
+		break;
+	}
+	case AST_KIND_PRINT:
+		resolve_expr(r, node->print.msg);
+		break;
+	case AST_KIND_RETURN:
+		resolve_expr(r, node->return_.rv);
+		break;
+	case AST_KIND_ASSERT:
+		resolve_expr(r, node->assert_.test);
+		resolve_expr(r, node->assert_.msg);
+		break;
+	case AST_KIND_VAR_DECL:
+		// The variable is added to the scope before its initial value is evaluated.
+
+		scope->declared++;
+
+		if (node->var_decl.is_static) {
+			r->barrier = scope->level + 1;
+		}
+
+		resolve_expr(r, node->var_decl.initial);
+		r->barrier = barrier;
+
+		break;
+	case AST_KIND_ASSIGNMENT:
+		resolve_expr(r, node->assignment.left);
+		resolve_expr(r, node->assignment.right);
+		break;
+	case AST_KIND_IMPORT:
+		scope->imported = true;
+		break;
+	case AST_KIND_EXPR_STATEMENT:
+		resolve_expr(r, node->expr_statement.expr);
+		break;
+	default:
+		break;
+	}
+}
+
+static void resolve_stmts(resolve_t* r, ast_list_t stmts, bool is_class) {
+	resolve_scope_t* const scope = r->scope;
+
+	// Find all the names declared in the scope up front, for callables which close over it.
+
+	for (size_t i = 0; i < stmts.count; i++) {
+		ast_node_t const* const node = ast_list_node(r->ast, stmts, i);
+
+		if (node->kind == AST_KIND_VAR_DECL) {
+			resolve_add_name_node(r, node->var_decl.name);
+		}
+
+		else if (node->kind == AST_KIND_FUNCTION_DECLARATION) {
+			resolve_add_name_node(r, node->function_declaration.name);
+		}
+
+		else if (node->kind == AST_KIND_IMPORT) {
+			scope->has_import = true;
+		}
+	}
+
+	// The instance scope of a class gets a self variable once its body has run.
+
+	if (is_class) {
+		resolve_add_name(scope, "self", 4);
+	}
+
+	for (size_t i = 0; i < stmts.count; i++) {
+		resolve_stmt(r, r->ast->lists[stmts.first + i]);
+	}
+}
+
+/**
+ * Resolve all the identifiers in an AST.
+ *
+ * @param ast The AST to resolve.
+ * @param src The source the AST was lowered from.
+ */
+static void resolve(flamingo_ast_t* ast, char const* src) {
+	resolve_t r = {
+		.ast = ast,
+		.src = src,
+	};
+
+	// Everything has to be looked up by name unless we find out otherwise.
+
+	for (size_t i = 0; i < ast->node_count; i++) {
+		ast_node_t* const node = &ast->nodes[i];
+
+		if (node->kind == AST_KIND_IDENTIFIER || node->kind == AST_KIND_SELF) {
+			node->identifier.depth = AST_UNRESOLVED;
+			node->identifier.slot = AST_UNRESOLVED;
+		}
+	}
+
+	// The source file is run directly in the current scope.
+
+	resolve_scope_t scope;
+	resolve_push(&r, &scope, false);
+
+	resolve_stmts(&r, ast_node(ast, ast->root)->block.stmts, false);
+	resolve_pop(&r);
+}
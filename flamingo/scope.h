@@ -7,26 +7,40 @@
  *
  * A scope is a container for variables within a specific lexical context.
  * Scopes are reference-counted, as they can be shared between environments (e.g., in the case of closures).
+ * Each scope also holds a reference to its parent, so a scope keeps alive the whole chain of scopes it can see (see 'env.h').
  *
  * Each scope maintains a list of variables ({@link flamingo_var_t}) and can optionally have an "owner" (an instance or class) and a {@link flamingo_scope_t#class_scope} flag to indicate its role in the hierarchy.
+ *
+ * Variables are kept in declaration order, as that's the order hosts iterate over them in and what the resolver's slots refer to.
+ * Keys are symbols (see 'symbol.h'), so adding a variable never copies its name.
+ * Most scopes only have a handful of variables, so finding one by name is just a linear search, but once a scope has more than {@link SCOPE_INDEX_THRESHOLD} variables (e.g. large modules or wide classes), an open-addressing hash index is built on the side.
  */
 
 #pragma once
 
 #include "common.h"
+#include "symbol.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
-static flamingo_scope_t* scope_alloc(void) {
-	flamingo_scope_t* const scope = malloc(sizeof *scope);
-	assert(scope != NULL);
+#define SCOPE_INDEX_THRESHOLD 8
+
+static flamingo_scope_t* scope_alloc(flamingo_pool_t* pool) {
+	flamingo_scope_t* const scope = pool_alloc_block(pool, sizeof *scope);
 
 	scope->ref_count = 1;
+	scope->pool = pool;
+	scope->parent = NULL;
+
 	scope->vars_size = 0;
+	scope->vars_capacity = 0;
 	scope->vars = NULL;
 
+	scope->index_capacity = 0;
+	scope->index = NULL;
+
 	scope->owner = NULL;
 	scope->class_scope = false;
 
@@ -35,61 +49,165 @@ static flamingo_scope_t* scope_alloc(void) {
 
 static void scope_empty(flamingo_scope_t* scope) {
 	size_t const count = scope->vars_size;
+	size_t const capacity = scope->vars_capacity;
 	flamingo_var_t* const vars = scope->vars;
 
 	scope->vars_size = 0;
+	scope->vars_capacity = 0;
 	scope->vars = NULL;
 
+	free(scope->index);
+
+	scope->index_capacity = 0;
+	scope->index = NULL;
+
 	for (size_t i = 0; i < count; i++) {
 		flamingo_var_t* const var = &vars[i];
 
 		val_decref(var->val);
-		free(var->key);
 	}
 
-	free(vars);
+	pool_free_block(scope->pool, vars, capacity * sizeof *vars);
 }
 
 static void scope_free(flamingo_scope_t* scope) {
 	scope_empty(scope);
-	free(scope);
+	pool_free_block(scope->pool, scope, sizeof *scope);
 }
 
 static void scope_decref(flamingo_scope_t* scope) {
-	if (scope == NULL) {
-		return;
-	}
+	// Freeing a scope lets go of its parent, so walk up the chain instead of recursing, as it can get deep.
 
-	assert(scope->ref_count > 0);
-	scope->ref_count--;
+	while (scope != NULL) {
+		assert(scope->ref_count > 0);
+		scope->ref_count--;
+
+		if (scope->ref_count > 0) {
+			return;
+		}
+
+		flamingo_scope_t* const parent = scope->parent;
 
-	if (scope->ref_count == 0) {
 		scope_free(scope);
+		scope = parent;
 	}
 }
 
-static flamingo_var_t* scope_add_var(flamingo_scope_t* scope, char const* key, size_t key_size) {
-	scope->vars = (flamingo_var_t*) realloc(scope->vars, ++scope->vars_size * sizeof *scope->vars);
-	assert(scope->vars != NULL);
+// FNV-1a.
 
-	flamingo_var_t* const var = &scope->vars[scope->vars_size - 1];
+static size_t scope_hash(char const* key, size_t key_size) {
+	uint64_t hash = 0xCBF29CE484222325;
 
-	var->key = malloc(key_size);
-	assert(var->key != NULL);
+	for (size_t i = 0; i < key_size; i++) {
+		hash ^= (uint8_t) key[i];
+		hash *= 0x100000001B3;
+	}
+
+	return hash;
+}
 
+static void scope_index_insert(flamingo_scope_t* scope, size_t i) {
+	flamingo_var_t* const var = &scope->vars[i];
+	size_t const mask = scope->index_capacity - 1;
+
+	// Linear probing.
+	// Since variables are inserted in declaration order, the first variable with a given name will always be the first one found when probing.
+
+	for (size_t bucket = symbol_header(var->key)->hash & mask;; bucket = (bucket + 1) & mask) {
+		if (scope->index[bucket] == 0) {
+			scope->index[bucket] = i + 1;
+			return;
+		}
+	}
+}
+
+static void scope_index_rebuild(flamingo_scope_t* scope) {
+	// Keep the load factor under a half.
+
+	size_t capacity = 16;
+
+	while (capacity < scope->vars_size * 2) {
+		capacity *= 2;
+	}
+
+	free(scope->index);
+
+	scope->index_capacity = capacity;
+	scope->index = calloc(capacity, sizeof *scope->index);
+	assert(scope->index != NULL);
+
+	for (size_t i = 0; i < scope->vars_size; i++) {
+		scope_index_insert(scope, i);
+	}
+}
+
+static void scope_reserve_vars(flamingo_scope_t* scope, size_t count) {
+	size_t const needed = scope->vars_size + count;
+
+	if (needed <= scope->vars_capacity) {
+		return;
+	}
+
+	scope->vars = pool_realloc_block(scope->pool, scope->vars, scope->vars_capacity * sizeof *scope->vars, needed * sizeof *scope->vars);
+	scope->vars_capacity = needed;
+}
+
+static flamingo_var_t* scope_add_symbol_var(flamingo_scope_t* scope, char* symbol, size_t key_size) {
+	// Grow geometrically so that adding variables is amortized O(1).
+
+	if (scope->vars_size == scope->vars_capacity) {
+		size_t const capacity = scope->vars_capacity == 0 ? 4 : scope->vars_capacity * 2;
+
+		scope->vars = pool_realloc_block(scope->pool, scope->vars, scope->vars_capacity * sizeof *scope->vars, capacity * sizeof *scope->vars);
+		scope->vars_capacity = capacity;
+	}
+
+	flamingo_var_t* const var = &scope->vars[scope->vars_size++];
+
+	var->key = symbol_rehome(scope->pool, symbol, key_size);
 	var->key_size = key_size;
-	memcpy(var->key, key, key_size);
 
+	var->is_static = false;
 	var->val = NULL;
 
+	// Index the variable if the scope is large enough to have an index.
+
+	if (scope->vars_size > SCOPE_INDEX_THRESHOLD) {
+		if (scope->vars_size * 2 > scope->index_capacity) {
+			scope_index_rebuild(scope);
+		}
+
+		else {
+			scope_index_insert(scope, scope->vars_size - 1);
+		}
+	}
+
 	return var;
 }
 
+static flamingo_var_t* scope_add_var(flamingo_scope_t* scope, char const* key, size_t key_size) {
+	return scope_add_symbol_var(scope, symbol_intern(scope->pool, key, key_size), key_size);
+}
+
 static flamingo_var_t* scope_shallow_find_var(flamingo_scope_t* scope, char const* key, size_t key_size) {
+	if (scope->index != NULL) {
+		size_t const mask = scope->index_capacity - 1;
+
+		for (size_t bucket = scope_hash(key, key_size) & mask; scope->index[bucket] != 0; bucket = (bucket + 1) & mask) {
+			flamingo_var_t* const var = &scope->vars[scope->index[bucket] - 1];
+
+			if (symbol_eq(var->key, var->key_size, key, key_size)) {
+				return var;
+			}
+		}
+
+		return NULL;
+	}
+
 	for (size_t i = 0; i < scope->vars_size; i++) {
 		flamingo_var_t* const var = &scope->vars[i];
 
-		if (var->key_size == key_size && memcmp(var->key, key, key_size) == 0) {
+		if (symbol_eq(var->key, var->key_size, key, key_size)) {
 			return var;
 		}
 	}
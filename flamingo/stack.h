@@ -0,0 +1,153 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Evaluation stack.
+ *
+ * Every call needs some scratch memory that lives exactly as long as the call does: the argument list of a call expression, or the registers of the code unit the VM is running.
+ * Rather than putting these on the C stack (where a big enough argument list or enough nested calls crash the host) or going to malloc for each call, each instance carves them out of its own stack of heap-allocated chunks.
+ * Frames are pushed and popped in LIFO order, and a chunk is never moved once allocated, so pointers into a frame stay valid while calls nested within it push frames of their own.
+ * The chunk after the current one is kept around when popping back out of it, so that recursing back and forth across a chunk boundary doesn't allocate each time.
+ *
+ * The stack also keeps track of how many calls deep the instance is, as each of those nests C calls however little of the stack it uses.
+ * Calls are refused with an error past {@link flamingo_t#max_depth}, instead of overflowing the C stack (see {@link flamingo_set_max_depth}).
+ *
+ * The tree-walker also nests C calls for each level of expressions and statements it evaluates, which the VM doesn't.
+ * So when tree-walking a callable, every {@link STACK_NESTING_PER_CALL} levels its body goes counts as one more call, and deep recursion through a deeply nested body still errors out before running out of C stack.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_CHUNK_SIZE (64 * 1024)
+
+// Roughly how many levels of nesting take up as much of the C stack as a call does in the tree-walker.
+
+#define STACK_NESTING_PER_CALL 16
+
+struct flamingo_stack_chunk_t {
+	flamingo_stack_chunk_t* prev;
+	flamingo_stack_chunk_t* next;
+
+	size_t size;
+	size_t used;
+
+	max_align_t data[];
+};
+
+static flamingo_stack_chunk_t* stack_chunk_alloc(flamingo_stack_chunk_t* prev, size_t size) {
+	if (size < STACK_CHUNK_SIZE) {
+		size = STACK_CHUNK_SIZE;
+	}
+
+	flamingo_stack_chunk_t* const chunk = malloc(sizeof *chunk + size);
+	assert(chunk != NULL);
+
+	chunk->prev = prev;
+	chunk->next = NULL;
+
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+// Push a zeroed frame onto the evaluation stack.
+
+static void* stack_push(flamingo_t* flamingo, size_t size) {
+	size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+	flamingo_stack_chunk_t* chunk = flamingo->stack;
+
+	if (chunk == NULL) {
+		chunk = flamingo->stack = stack_chunk_alloc(NULL, size);
+	}
+
+	// If the frame doesn't fit in what's left of the current chunk, move on to the next one, making sure it's big enough.
+	// Frames never straddle two chunks.
+
+	if (chunk->size - chunk->used < size) {
+		flamingo_stack_chunk_t* next = chunk->next;
+
+		if (next != NULL && next->size < size) {
+			free(next);
+			next = NULL;
+		}
+
+		if (next == NULL) {
+			next = chunk->next = stack_chunk_alloc(chunk, size);
+		}
+
+		chunk = flamingo->stack = next;
+	}
+
+	void* const frame = (char*) chunk->data + chunk->used;
+	chunk->used += size;
+
+	memset(frame, 0, size);
+	return frame;
+}
+
+// Pop the frame at the top of the evaluation stack, along with any frame pushed after it.
+
+static void stack_pop(flamingo_t* flamingo, void* frame) {
+	flamingo_stack_chunk_t* chunk = flamingo->stack;
+	assert(chunk != NULL);
+
+	size_t const offset = (char*) frame - (char*) chunk->data;
+	assert(offset <= chunk->used);
+
+	chunk->used = offset;
+
+	// If that was the first frame of the chunk, go back to the previous one.
+	// Only keep the chunk we're leaving as a spare, not any after it.
+
+	if (chunk->used == 0 && chunk->prev != NULL) {
+		free(chunk->next);
+		chunk->next = NULL;
+
+		flamingo->stack = chunk->prev;
+	}
+}
+
+static void stack_free(flamingo_t* flamingo) {
+	flamingo_stack_chunk_t* chunk = flamingo->stack;
+
+	if (chunk == NULL) {
+		return;
+	}
+
+	while (chunk->prev != NULL) {
+		chunk = chunk->prev;
+	}
+
+	flamingo_stack_chunk_t* next;
+
+	for (; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	flamingo->stack = NULL;
+}
+
+// Enter a call counting as the given number of calls, refusing to if that would nest calls any deeper than allowed.
+
+static int stack_enter(flamingo_t* flamingo, size_t depth) {
+	if (depth > flamingo->max_depth - flamingo->depth) {
+		return error(flamingo, "maximum call depth of %zu exceeded", flamingo->max_depth);
+	}
+
+	flamingo->depth += depth;
+	return 0;
+}
+
+static void stack_leave(flamingo_t* flamingo, size_t depth) {
+	assert(flamingo->depth >= depth);
+	flamingo->depth -= depth;
+}
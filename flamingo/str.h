@@ -0,0 +1,132 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Strings.
+ *
+ * Concatenating two strings has to make a new one, as strings are shared between variables, so building up a string piece by piece (e.g. 's = s + line' in a loop) would copy everything built up so far each time.
+ * Instead, concatenation puts its result in a buffer with room to spare, and when the left operand of a later concatenation ends where the used part of its buffer does, the right operand is just copied in after it and the result shares the buffer.
+ * Each string sharing a buffer is a prefix of its contents, and only reads its own part of it, so claiming the rest doesn't change any other string.
+ * As the buffer grows geometrically, building up a string is amortized O(1) per character, and every string is still a contiguous run of characters which can be read straight out of 'str.str'.
+ *
+ * Strings which aren't made by concatenation (e.g. literals, or strings made by the host) own a plain buffer of their exact size.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STR_BUF_MIN_CAPACITY 16
+
+struct flamingo_str_buf_t {
+	size_t ref_count;
+	size_t capacity;
+	size_t used; // How far into the buffer the strings sharing it reach.
+	char data[];
+};
+
+static flamingo_str_buf_t* str_buf_alloc(size_t size) {
+	size_t capacity = STR_BUF_MIN_CAPACITY;
+
+	while (capacity < size * 2) {
+		capacity *= 2;
+	}
+
+	flamingo_str_buf_t* const buf = malloc(sizeof *buf + capacity);
+	assert(buf != NULL);
+
+	buf->ref_count = 1;
+	buf->capacity = capacity;
+	buf->used = 0;
+
+	return buf;
+}
+
+static void str_free(flamingo_val_t* str) {
+	assert(str->kind == FLAMINGO_VAL_KIND_STR);
+
+	flamingo_str_buf_t* const buf = str->str.buf;
+
+	if (buf == NULL) {
+		free(str->str.str);
+	}
+
+	else if (--buf->ref_count == 0) {
+		free(buf);
+	}
+
+	str->str.str = NULL;
+	str->str.buf = NULL;
+}
+
+// Check if characters can be appended to a string by claiming more of its buffer.
+
+static bool str_can_extend(flamingo_val_t* str, size_t size) {
+	flamingo_str_buf_t* const buf = str->str.buf;
+
+	if (buf == NULL) {
+		return false;
+	}
+
+	return str->str.str + str->str.size == buf->data + buf->used && buf->capacity - buf->used >= size;
+}
+
+static void str_concat(flamingo_val_t* str, flamingo_val_t* left, flamingo_val_t* right) {
+	assert(str->kind == FLAMINGO_VAL_KIND_STR);
+	assert(left->kind == FLAMINGO_VAL_KIND_STR);
+	assert(right->kind == FLAMINGO_VAL_KIND_STR);
+
+	size_t const size = left->str.size + right->str.size;
+	flamingo_str_buf_t* buf = left->str.buf;
+
+	if (str_can_extend(left, right->str.size)) {
+		buf->ref_count++;
+		str->str.str = left->str.str;
+	}
+
+	else {
+		buf = str_buf_alloc(size);
+		memcpy(buf->data, left->str.str, left->str.size);
+
+		buf->used = left->str.size;
+		str->str.str = buf->data;
+	}
+
+	// The right operand might share the buffer too, but then it's entirely in the used part of it, so it doesn't overlap with where it's copied to.
+
+	memcpy(buf->data + buf->used, right->str.str, right->str.size);
+	buf->used += right->str.size;
+
+	str->str.buf = buf;
+	str->str.size = size;
+}
+
+static void str_append(flamingo_val_t* str, flamingo_val_t* append) {
+	assert(str->kind == FLAMINGO_VAL_KIND_STR);
+	assert(append->kind == FLAMINGO_VAL_KIND_STR);
+
+	if (str_can_extend(str, append->str.size)) {
+		flamingo_str_buf_t* const buf = str->str.buf;
+
+		memcpy(buf->data + buf->used, append->str.str, append->str.size);
+		buf->used += append->str.size;
+		str->str.size += append->str.size;
+
+		return;
+	}
+
+	// Otherwise, concatenate into a new buffer and let go of the old one.
+
+	flamingo_val_t concat = {.kind = FLAMINGO_VAL_KIND_STR};
+	str_concat(&concat, str, append);
+
+	str_free(str);
+
+	str->str.str = concat.str.str;
+	str->str.size = concat.str.size;
+	str->str.buf = concat.str.buf;
+}
@@ -0,0 +1,131 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Symbols.
+ *
+ * Variable keys and value names are interned into symbols, so that every variable and value with the same name shares one copy of its characters instead of each copying (and later freeing) its own.
+ * Each pool has its own symbol table, because symbols have to live for as long as any scope or value referring to them, and a pool already lives until its last block is freed (see 'pool.h').
+ *
+ * Interning the same characters into the same pool always gives back the same symbol, so two keys from the same instance are equal exactly when they're the same pointer.
+ * Keys from different instances (e.g. imported modules, or an inherited environment) can still be equal without being the same pointer, so {@link symbol_eq} falls back to comparing characters when the pointers differ.
+ *
+ * Identifiers share the AST's constant table with string literals, and each instance caches the symbol of each the first time it's looked up (see {@link symbol_of}).
+ */
+
+#pragma once
+
+#include "common.h"
+#include "pool.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct symbol_t {
+	flamingo_pool_t* pool;
+	size_t hash;
+	size_t size;
+	char key[];
+};
+
+static inline symbol_t* symbol_header(char const* key) {
+	return (symbol_t*) (key - offsetof(symbol_t, key));
+}
+
+static bool symbol_eq(char const* a, size_t a_size, char const* b, size_t b_size) {
+	return a_size == b_size && (a == b || memcmp(a, b, a_size) == 0);
+}
+
+static void symbol_table_insert(flamingo_pool_t* pool, symbol_t* symbol) {
+	size_t const mask = pool->symbol_capacity - 1;
+
+	for (size_t bucket = symbol->hash & mask;; bucket = (bucket + 1) & mask) {
+		if (pool->symbols[bucket] == NULL) {
+			pool->symbols[bucket] = symbol;
+			return;
+		}
+	}
+}
+
+static char* symbol_intern(flamingo_pool_t* pool, char const* key, size_t size) {
+	size_t const hash = scope_hash(key, size);
+
+	if (pool->symbols != NULL) {
+		size_t const mask = pool->symbol_capacity - 1;
+
+		for (size_t bucket = hash & mask; pool->symbols[bucket] != NULL; bucket = (bucket + 1) & mask) {
+			symbol_t* const symbol = pool->symbols[bucket];
+
+			if (symbol->hash == hash && symbol_eq(symbol->key, symbol->size, key, size)) {
+				return symbol->key;
+			}
+		}
+	}
+
+	// Not seen yet, so add a new symbol, growing the table to keep its load factor under a half.
+
+	if ((pool->symbol_count + 1) * 2 > pool->symbol_capacity) {
+		symbol_t** const symbols = pool->symbols;
+		size_t const capacity = pool->symbol_capacity;
+
+		pool->symbol_capacity = capacity == 0 ? 64 : capacity * 2;
+		pool->symbols = calloc(pool->symbol_capacity, sizeof *pool->symbols);
+		assert(pool->symbols != NULL);
+
+		for (size_t i = 0; i < capacity; i++) {
+			if (symbols[i] != NULL) {
+				symbol_table_insert(pool, symbols[i]);
+			}
+		}
+
+		free(symbols);
+	}
+
+	symbol_t* const symbol = malloc(sizeof *symbol + size);
+	assert(symbol != NULL);
+
+	symbol->pool = pool;
+	symbol->hash = hash;
+	symbol->size = size;
+	memcpy(symbol->key, key, size);
+
+	symbol_table_insert(pool, symbol);
+	pool->symbol_count++;
+
+	return symbol->key;
+}
+
+// Get the symbol of a key which is already a symbol in some pool, in the given pool.
+// This is usually just the same symbol.
+
+static char* symbol_rehome(flamingo_pool_t* pool, char* key, size_t size) {
+	if (symbol_header(key)->pool == pool) {
+		return key;
+	}
+
+	return symbol_intern(pool, key, size);
+}
+
+static void symbol_table_free(flamingo_pool_t* pool) {
+	for (size_t i = 0; i < pool->symbol_capacity; i++) {
+		free(pool->symbols[i]);
+	}
+
+	free(pool->symbols);
+}
+
+// Get the symbol of an identifier (or 'self') node in the instance's pool.
+
+static char* symbol_of(flamingo_t* flamingo, ast_node_t const* node) {
+	assert(node->kind == AST_KIND_IDENTIFIER || node->kind == AST_KIND_SELF);
+	ast_const_t const* const constant = &flamingo->ast->consts[node->identifier.symbol];
+	flamingo_const_cache_t* const cache = &flamingo->consts[node->identifier.symbol];
+
+	if (cache->symbol == NULL) {
+		cache->symbol = symbol_intern(flamingo->pool, flamingo->src + constant->start, constant->size);
+	}
+
+	return cache->symbol;
+}
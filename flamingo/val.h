@@ -9,6 +9,8 @@
  * They are reference-counted and can represent various types, including primitives (integers, strings, booleans), collections (vectors, maps), and callables (functions, classes).
  *
  * Each value can have an optional name and an "owner" scope, which is used for memory management and debugging.
+ *
+ * Copying a vector or map doesn't copy its elements right away: the copy shares them with the original, along with a counter of how many values share them, until either is modified.
  */
 
 #pragma once
@@ -93,55 +95,124 @@ static char const* val_role_str(flamingo_val_t* val) {
 	}
 }
 
-static flamingo_val_t* val_alloc(void) {
-	flamingo_val_t* const val = calloc(1, sizeof *val);
-	assert(val != NULL);
+static flamingo_val_t* val_alloc(flamingo_pool_t* pool) {
+	flamingo_val_t* const val = pool_alloc_block(pool, sizeof *val);
+
+	memset(val, 0, sizeof *val);
+	val->pool = pool;
 
 	return val_init(val);
 }
 
-static flamingo_val_t* val_copy(flamingo_val_t* val) {
-	flamingo_val_t* const copy = calloc(1, sizeof *copy);
-	assert(copy != NULL);
+// Share the storage of a vector or map with one more value.
 
-	memcpy(copy, val, sizeof *val);
-	copy->ref_count = 1;
+static size_t* val_share(size_t** shared) {
+	if (*shared == NULL) {
+		*shared = malloc(sizeof **shared);
+		assert(*shared != NULL);
 
-	if (val->name != NULL) {
-		copy->name = strndup(val->name, val->name_size);
-		assert(copy->name != NULL);
+		**shared = 1;
 	}
 
-	switch (copy->kind) {
-	case FLAMINGO_VAL_KIND_NONE:
-	case FLAMINGO_VAL_KIND_BOOL:
-	case FLAMINGO_VAL_KIND_INT:
-		break;
-	case FLAMINGO_VAL_KIND_STR:
-		copy->str.str = strndup(val->str.str, val->str.size);
-		assert(copy->str.str != NULL);
-		break;
-	case FLAMINGO_VAL_KIND_VEC:
-		copy->vec.elems = malloc(val->vec.count * sizeof *copy->vec.elems);
-		assert(copy->vec.elems != NULL);
+	(**shared)++;
+	return *shared;
+}
+
+// Stop sharing the storage of a vector or map, returning true if there are still other values sharing it.
+
+static bool val_unshare(size_t** shared) {
+	if (*shared == NULL) {
+		return false;
+	}
+
+	bool const still_shared = --**shared > 0;
+
+	if (!still_shared) {
+		free(*shared);
+	}
+
+	*shared = NULL;
+	return still_shared;
+}
+
+static void val_detach(flamingo_val_t* val) {
+	if (val->kind == FLAMINGO_VAL_KIND_VEC) {
+		if (!val_unshare(&val->vec.shared)) {
+			return;
+		}
+
+		flamingo_val_t** const elems = val->vec.elems;
+
+		val->vec.capacity = val->vec.count;
+		val->vec.elems = malloc(val->vec.count * sizeof *val->vec.elems);
+		assert(val->vec.count == 0 || val->vec.elems != NULL);
 
 		for (size_t i = 0; i < val->vec.count; i++) {
-			copy->vec.elems[i] = val_incref(val->vec.elems[i]);
+			val->vec.elems[i] = val_incref(elems[i]);
 		}
+	}
 
-		break;
-	case FLAMINGO_VAL_KIND_MAP:
-		copy->map.keys = malloc(val->map.count * sizeof *copy->map.keys);
-		assert(copy->map.keys != NULL);
+	else if (val->kind == FLAMINGO_VAL_KIND_MAP) {
+		if (!val_unshare(&val->map.shared)) {
+			return;
+		}
 
-		copy->map.vals = malloc(val->map.count * sizeof *copy->map.vals);
-		assert(copy->map.vals != NULL);
+		flamingo_val_t** const keys = val->map.keys;
+		flamingo_val_t** const vals = val->map.vals;
+		size_t* const index = val->map.index;
+
+		val->map.capacity = 0;
+		val->map.keys = NULL;
+		val->map.vals = NULL;
+
+		map_reserve(val, val->map.count);
 
 		for (size_t i = 0; i < val->map.count; i++) {
-			copy->map.keys[i] = val_incref(val->map.keys[i]);
-			copy->map.vals[i] = val_incref(val->map.vals[i]);
+			val->map.keys[i] = val_incref(keys[i]);
+			val->map.vals[i] = val_incref(vals[i]);
+		}
+
+		// Entries stay at the same positions, so the index can be copied as-is.
+
+		if (index != NULL) {
+			val->map.index = malloc(val->map.index_capacity * sizeof *val->map.index);
+			assert(val->map.index != NULL);
+
+			memcpy(val->map.index, index, val->map.index_capacity * sizeof *val->map.index);
 		}
+	}
+}
+
+static flamingo_val_t* val_copy(flamingo_val_t* val) {
+	// Values which are only ever modified in-place when nothing else references them (see 'assignment_overwrite' and 'assignment_add') can just be shared.
+
+	switch (val->kind) {
+	case FLAMINGO_VAL_KIND_NONE:
+	case FLAMINGO_VAL_KIND_BOOL:
+	case FLAMINGO_VAL_KIND_INT:
+	case FLAMINGO_VAL_KIND_STR:
+		return val_incref(val);
+	default:
+		break;
+	}
+
+	flamingo_val_t* const copy = pool_alloc_block(val->pool, sizeof *copy);
+	memcpy(copy, val, sizeof *val);
+	copy->ref_count = 1;
+
+	// Only values made by the host own their name (see 'var_set_val').
+
+	if (val->pool == NULL && val->name != NULL) {
+		copy->name = strndup(val->name, val->name_size);
+		assert(copy->name != NULL);
+	}
 
+	switch (copy->kind) {
+	case FLAMINGO_VAL_KIND_VEC:
+		copy->vec.shared = val_share(&val->vec.shared);
+		break;
+	case FLAMINGO_VAL_KIND_MAP:
+		copy->map.shared = val_share(&val->map.shared);
 		break;
 	case FLAMINGO_VAL_KIND_FN:
 		if (val->fn.env != NULL) {
@@ -155,7 +226,7 @@ static flamingo_val_t* val_copy(flamingo_val_t* val) {
 		}
 
 		break;
-	case FLAMINGO_VAL_KIND_COUNT:
+	default:
 		break;
 	}
 
@@ -206,22 +277,9 @@ static bool val_eq(flamingo_val_t* x, flamingo_val_t* y) {
 
 			// Find key in y.
 
-			bool found = false;
-
-			for (size_t j = 0; j < y->map.count; j++) {
-				if (!val_eq(k, y->map.keys[j])) {
-					continue;
-				}
+			flamingo_val_t** const y_slot = map_find(y, k);
 
-				if (!val_eq(v, y->map.vals[j])) {
-					return false;
-				}
-
-				found = true;
-				break;
-			}
-
-			if (!found) {
+			if (y_slot == NULL || !val_eq(v, *y_slot)) {
 				return false;
 			}
 		}
@@ -238,14 +296,80 @@ static bool val_eq(flamingo_val_t* x, flamingo_val_t* y) {
 	return false; // XXX To make GCC happy.
 }
 
+// Mix the bits of a hash, so that values which only differ in a few bits (e.g. consecutive integers, or pointers) don't end up in neighbouring buckets.
+// This is the finalizer from MurmurHash3.
+
+static size_t val_hash_mix(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCD;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+static size_t val_hash(flamingo_val_t* val) {
+	uint64_t hash = val->kind;
+
+	switch (val->kind) {
+	case FLAMINGO_VAL_KIND_NONE:
+		break;
+	case FLAMINGO_VAL_KIND_BOOL:
+		hash = hash * 31 + val->boolean.boolean;
+		break;
+	case FLAMINGO_VAL_KIND_INT:
+		hash = hash * 31 + (uint64_t) val->integer.integer;
+		break;
+	case FLAMINGO_VAL_KIND_STR:
+		hash = hash * 31 + scope_hash(val->str.str, val->str.size);
+		break;
+	case FLAMINGO_VAL_KIND_VEC:
+		for (size_t i = 0; i < val->vec.count; i++) {
+			hash = hash * 31 + val_hash(val->vec.elems[i]);
+		}
+
+		break;
+	case FLAMINGO_VAL_KIND_MAP:
+		// Maps are equal regardless of the order of their entries, so combine the hashes of the entries in a way which doesn't depend on it either.
+
+		for (size_t i = 0; i < val->map.count; i++) {
+			hash += val_hash_mix(val_hash(val->map.keys[i]) * 31 + val_hash(val->map.vals[i]));
+		}
+
+		break;
+
+	// Functions and instances are compared bytewise by 'val_eq', so hash them bytewise too.
+
+	case FLAMINGO_VAL_KIND_FN:
+		hash = hash * 31 + scope_hash((char const*) &val->fn, sizeof val->fn);
+		break;
+	case FLAMINGO_VAL_KIND_INST:
+		hash = hash * 31 + scope_hash((char const*) &val->inst, sizeof val->inst);
+		break;
+	case FLAMINGO_VAL_KIND_COUNT:
+		break;
+	}
+
+	return val_hash_mix(hash);
+}
+
 static void val_free(flamingo_val_t* val) {
-	free(val->name);
+	if (val->pool == NULL) {
+		free(val->name);
+	}
 
 	switch (val->kind) {
 	case FLAMINGO_VAL_KIND_STR:
-		free(val->str.str);
+		str_free(val);
 		break;
 	case FLAMINGO_VAL_KIND_VEC:
+		// Elements which are still shared with other vectors are left to them.
+
+		if (val_unshare(&val->vec.shared)) {
+			break;
+		}
+
 		for (size_t i = 0; i < val->vec.count; i++) {
 			val_decref(val->vec.elems[i]);
 		}
@@ -253,6 +377,10 @@ static void val_free(flamingo_val_t* val) {
 		free(val->vec.elems);
 		break;
 	case FLAMINGO_VAL_KIND_MAP:
+		if (val_unshare(&val->map.shared)) {
+			break;
+		}
+
 		for (size_t i = 0; i < val->map.count; i++) {
 			val_decref(val->map.keys[i]);
 			val_decref(val->map.vals[i]);
@@ -260,12 +388,10 @@ static void val_free(flamingo_val_t* val) {
 
 		free(val->map.keys);
 		free(val->map.vals);
+		free(val->map.index);
 
 		break;
 	case FLAMINGO_VAL_KIND_FN:
-		free(val->fn.body);
-		free(val->fn.params);
-
 		if (val->fn.env != NULL) {
 			env_free(val->fn.env);
 		}
@@ -287,7 +413,7 @@ static void val_free(flamingo_val_t* val) {
 		assert(false);
 	}
 
-	free(val);
+	pool_free_block(val->pool, val, sizeof *val);
 }
 
 static flamingo_val_t* val_decref(flamingo_val_t* val) {
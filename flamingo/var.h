@@ -7,23 +7,31 @@
  * A variable is a named binding to a value within a scope.
  * It consists of a key (the variable name) and a pointer to a {@link flamingo_val_t}.
  *
- * When a value is assigned to a variable, the value's internal name is updated to match the variable's key for better error reporting and debugging.
+ * A value is named after the first variable it's bound to, which is usually the one declaring it, for better error reporting and debugging (and so hosts can tell external functions apart).
+ * Binding it to any other variable after that (e.g. passing it as an argument, or assigning it to another variable) leaves its name alone, so binding values is free.
+ * Keys are symbols, so naming a value only means pointing the name at the key's symbol in the value's pool (see 'symbol.h'), except for values made by the host, which aren't from any pool and so own a copy of their name.
  */
 
 #pragma once
 
-#include "../common.h"
+#include "common.h"
+#include "symbol.h"
 
 static void var_set_val(flamingo_var_t* var, flamingo_val_t* val) {
 	var->val = val;
 
-	if (val != NULL) {
-		if (val->name != NULL) {
-			free(val->name);
-		}
+	if (val == NULL || val->name != NULL) {
+		return;
+	}
+
+	if (val->pool != NULL) {
+		val->name = symbol_rehome(val->pool, var->key, var->key_size);
+	}
 
+	else {
 		val->name = strndup(var->key, var->key_size);
 		assert(val->name != NULL);
-		val->name_size = var->key_size;
 	}
+
+	val->name_size = var->key_size;
 }
@@ -0,0 +1,85 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Vectors.
+ *
+ * A vector's elements live in a single array with room for its capacity's worth of elements.
+ * The array grows geometrically, so pushing onto the end of a vector is amortized O(1).
+ *
+ * Like a map, a vector which shares its elements with its copies (see {@link val_detach}) must be detached before modifying it.
+ */
+
+#pragma once
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest capacity a vector can have, past which the size of its array would overflow.
+
+#define VEC_MAX_CAPACITY (SIZE_MAX / sizeof(flamingo_val_t*))
+
+static bool vec_reserve_elems(flamingo_val_t* vec, size_t capacity) {
+	assert(vec->kind == FLAMINGO_VAL_KIND_VEC);
+	assert(vec->vec.shared == NULL); // Must be detached first.
+
+	if (capacity <= vec->vec.capacity) {
+		return true;
+	}
+
+	if (capacity > VEC_MAX_CAPACITY) {
+		return false;
+	}
+
+	flamingo_val_t** const elems = realloc(vec->vec.elems, capacity * sizeof *vec->vec.elems);
+
+	if (elems == NULL) {
+		return false;
+	}
+
+	vec->vec.capacity = capacity;
+	vec->vec.elems = elems;
+
+	return true;
+}
+
+static void vec_insert_elem(flamingo_val_t* vec, size_t i, flamingo_val_t* elem) {
+	assert(vec->kind == FLAMINGO_VAL_KIND_VEC);
+	assert(vec->vec.shared == NULL); // Must be detached first.
+	assert(i <= vec->vec.count);
+
+	if (vec->vec.count == vec->vec.capacity) {
+		bool const reserved = vec_reserve_elems(vec, vec->vec.capacity == 0 ? 4 : vec->vec.capacity * 2);
+		assert(reserved);
+		(void) reserved;
+	}
+
+	flamingo_val_t** const elems = vec->vec.elems;
+
+	memmove(&elems[i + 1], &elems[i], (vec->vec.count - i) * sizeof *elems);
+	elems[i] = elem;
+
+	vec->vec.count++;
+}
+
+static void vec_push_elem(flamingo_val_t* vec, flamingo_val_t* elem) {
+	vec_insert_elem(vec, vec->vec.count, elem);
+}
+
+static flamingo_val_t* vec_remove_elem(flamingo_val_t* vec, size_t i) {
+	assert(vec->kind == FLAMINGO_VAL_KIND_VEC);
+	assert(vec->vec.shared == NULL); // Must be detached first.
+	assert(i < vec->vec.count);
+
+	flamingo_val_t** const elems = vec->vec.elems;
+	flamingo_val_t* const elem = elems[i];
+
+	vec->vec.count--;
+	memmove(&elems[i], &elems[i + 1], (vec->vec.count - i) * sizeof *elems);
+
+	return elem;
+}
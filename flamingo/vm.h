@@ -0,0 +1,643 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+/*
+ * Bytecode VM.
+ *
+ * This runs code units compiled by the bytecode compiler (see 'bytecode.h') when the instance's engine is set to {@link FLAMINGO_ENGINE_VM}.
+ * Code units are compiled lazily the first time they are run, and their bytecode is cached on the AST they come from.
+ *
+ * All the actual operations on values (operators, indexing, assignment checks, calls, &c) go through the same helpers as the tree-walker, so that both engines behave the same.
+ * 'break' and 'continue' are resolved at compile time, to jumps to the end or the head of the loop they're in, or to an error if they aren't in one (the tree-walker doesn't let them escape a callable's body into the loop it's called from either).
+ */
+
+#pragma once
+
+#include "bytecode.h"
+#include "call.h"
+#include "common.h"
+#include "env.h"
+#include "imm.h"
+#include "repr.h"
+#include "scope.h"
+#include "stack.h"
+#include "val.h"
+
+#include "grammar/assert.h"
+#include "grammar/assignment.h"
+#include "grammar/for_loop.h"
+#include "grammar/function_declaration.h"
+#include "grammar/import.h"
+#include "grammar/index.h"
+#include "grammar/return.h"
+#include "grammar/var_decl.h"
+
+// Get the bytecode of a code unit, compiling it the first time.
+// Another thread running the same program might be compiling the same unit at the same time, in which case whichever finishes last throws its bytecode away and uses the other's.
+
+static vm_code_t* vm_code(flamingo_ast_t* ast, flamingo_node_t body, vm_unit_kind_t kind) {
+	vm_code_t* _Atomic* code = atomic_load(&ast->code);
+
+	if (code == NULL) {
+		vm_code_t* _Atomic* const fresh = calloc(ast->node_count, sizeof *fresh);
+		assert(fresh != NULL);
+
+		if (atomic_compare_exchange_strong(&ast->code, &code, fresh)) {
+			code = fresh;
+		}
+
+		else {
+			free(fresh);
+		}
+	}
+
+	vm_code_t* unit = atomic_load(&code[body]);
+
+	if (unit == NULL) {
+		vm_code_t* const fresh = compile(ast, body, kind);
+
+		if (atomic_compare_exchange_strong(&code[body], &unit, fresh)) {
+			unit = fresh;
+		}
+
+		else {
+			vm_code_free(fresh);
+		}
+	}
+
+	assert(unit->kind == kind);
+	return unit;
+}
+
+static void vm_free_code(flamingo_ast_t* ast) {
+	vm_code_t* _Atomic* const code = atomic_load(&ast->code);
+
+	if (code == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < ast->node_count; i++) {
+		vm_code_t* const unit = atomic_load(&code[i]);
+
+		if (unit != NULL) {
+			vm_code_free(unit);
+		}
+	}
+
+	free(code);
+	atomic_store(&ast->code, NULL);
+}
+
+// An empty register is an unboxed none.
+
+static inline imm_t vm_take_imm(imm_t* regs, uint32_t reg) {
+	imm_t const imm = regs[reg];
+	regs[reg] = (imm_t) {0};
+
+	return imm;
+}
+
+// Take the value out of a register, boxing it if it isn't already, and leave the register empty.
+
+static inline flamingo_val_t* vm_take(flamingo_t* flamingo, imm_t* regs, uint32_t reg) {
+	return imm_box(flamingo, vm_take_imm(regs, reg));
+}
+
+// Borrow the value in a register, boxing it in-place if it isn't already.
+
+static inline flamingo_val_t* vm_borrow(flamingo_t* flamingo, imm_t* regs, uint32_t reg) {
+	regs[reg] = imm_from_val(imm_box(flamingo, regs[reg]));
+	return regs[reg].boxed;
+}
+
+static inline void vm_set(imm_t* regs, uint32_t reg, flamingo_val_t* val) {
+	if (reg != VM_NO_REG && val != NULL) {
+		regs[reg] = imm_from_val(val);
+	}
+}
+
+static inline imm_t* vm_dst(imm_t* regs, uint32_t reg) {
+	return reg == VM_NO_REG ? NULL : &regs[reg];
+}
+
+static void vm_pop_scopes(flamingo_t* flamingo, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		env_pop_scope(flamingo->env);
+	}
+}
+
+static int vm_run(flamingo_t* flamingo, flamingo_node_t body, flamingo_scope_t** inner_scope, flamingo_val_t** rv) {
+	flamingo_ast_t* const ast = flamingo->ast;
+	ast_kind_t const body_kind = ast_node(ast, body)->kind;
+
+	// The kind of code unit follows from the node at its root, and only class bodies have an instance scope to detach.
+
+	vm_unit_kind_t kind = VM_UNIT_EXPR;
+
+	if (body_kind == AST_KIND_SOURCE_FILE) {
+		kind = VM_UNIT_SOURCE;
+	}
+
+	else if (body_kind == AST_KIND_BLOCK) {
+		kind = inner_scope == NULL ? VM_UNIT_FUNCTION : VM_UNIT_CLASS;
+	}
+
+	// Like 'parse_expr', don't bother evaluating expressions which can't have side-effects if we're discarding their value anyway.
+
+	bool const is_leaf = body_kind == AST_KIND_LITERAL || body_kind == AST_KIND_IDENTIFIER || body_kind == AST_KIND_LAMBDA || body_kind == AST_KIND_SELF;
+
+	if (kind == VM_UNIT_EXPR && rv == NULL && is_leaf) {
+		return 0;
+	}
+
+	vm_code_t* const code = vm_code(ast, body, kind);
+
+	// Registers hold immediates, and each one has a counter next to it for loops.
+	// Arguments are boxed into their own array before calls, as argument lists are arrays of value pointers.
+	// All three live in one frame on the evaluation stack.
+
+	size_t const reg_count = code->reg_count;
+	size_t const slot_count = reg_count + 1;
+
+	imm_t* const regs = stack_push(flamingo, slot_count * (sizeof *regs + sizeof(flamingo_val_t*) + sizeof(size_t)));
+	flamingo_val_t** const args = (flamingo_val_t**) (regs + slot_count);
+	size_t* const counters = (size_t*) (args + slot_count);
+
+	// State which has to persist between instructions.
+
+	flamingo_var_t* decl_var = NULL;
+	assignment_t assignment = {0};
+
+	int res = 0;
+	vm_instr_t const* instr = code->instrs;
+
+	for (;; instr++) {
+		ast_node_t const* const node = ast_node(ast, instr->node);
+		flamingo_val_t* val;
+
+		switch (instr->op) {
+		case VM_OP_END:
+			goto done;
+		case VM_OP_ERROR:
+			res = error(flamingo, "%s", ast_str(flamingo->ast, node->invalid.msg));
+			goto done;
+
+		// Leaf expressions.
+
+		case VM_OP_LITERAL:
+			if (parse_literal_imm(flamingo, node, &regs[instr->a]) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_IDENTIFIER:
+			if (instr->c) {
+				if (parse_identifier_imm(flamingo, node, &regs[instr->a]) < 0) {
+					goto err;
+				}
+
+				break;
+			}
+
+			val = NULL;
+
+			if (parse_identifier(flamingo, node, &val) < 0) {
+				goto err;
+			}
+
+			vm_set(regs, instr->a, val);
+			break;
+		case VM_OP_SELF:
+			val = NULL;
+
+			if (parse_self(flamingo, node, &val) < 0) {
+				goto err;
+			}
+
+			vm_set(regs, instr->a, val);
+			break;
+		case VM_OP_LAMBDA:
+			val = NULL;
+
+			if (parse_lambda(flamingo, node, &val) < 0) {
+				goto err;
+			}
+
+			vm_set(regs, instr->a, val);
+			break;
+
+		// Compound expressions.
+
+		case VM_OP_VEC: {
+			size_t const count = node->vec.elems.count;
+
+			if (instr->a == VM_NO_REG) {
+				for (size_t i = 0; i < count; i++) {
+					imm_free(vm_take_imm(regs, instr->b + i));
+				}
+
+				break;
+			}
+
+			flamingo_val_t** const elems = malloc((count == 0 ? 1 : count) * sizeof *elems);
+			assert(elems != NULL);
+
+			for (size_t i = 0; i < count; i++) {
+				elems[i] = vm_take(flamingo, regs, instr->b + i);
+			}
+
+			val = val_alloc(flamingo->pool);
+
+			val->kind = FLAMINGO_VAL_KIND_VEC;
+			val->vec.count = count;
+			val->vec.capacity = count;
+			val->vec.elems = elems;
+
+			vm_set(regs, instr->a, val);
+			break;
+		}
+		case VM_OP_MAP_NEW:
+			val = val_alloc(flamingo->pool);
+
+			val->kind = FLAMINGO_VAL_KIND_MAP;
+			map_reserve(val, node->map.items.count / 2);
+
+			vm_set(regs, instr->a, val);
+			break;
+		case VM_OP_MAP_KEY:
+			if (map_find(regs[instr->a].boxed, vm_borrow(flamingo, regs, instr->b)) != NULL) {
+				res = error(flamingo, "duplicate key in map");
+				goto done;
+			}
+
+			break;
+		case VM_OP_MAP_INSERT:
+			map_insert(regs[instr->a].boxed, vm_take(flamingo, regs, instr->b), vm_take(flamingo, regs, instr->b + 1));
+			break;
+		case VM_OP_MAP:
+			val = vm_take(flamingo, regs, instr->b);
+
+			if (instr->a == VM_NO_REG) {
+				val_decref(val);
+				break;
+			}
+
+			vm_set(regs, instr->a, val);
+			break;
+		case VM_OP_CHECK_CALLABLE:
+			if (regs[instr->b].kind != FLAMINGO_VAL_KIND_FN) {
+				res = error(flamingo, "callable expression is of type %s, which is not callable", imm_type_str(regs[instr->b]));
+				goto done;
+			}
+
+			break;
+		case VM_OP_CALL:
+		case VM_OP_TAIL_CALL: {
+			// Arguments are already in consecutive registers, so we can just box them and point the argument list at them.
+
+			flamingo_arg_list_t arg_list = {
+				.count = node->call.args.count,
+				.args = &args[instr->c],
+			};
+
+			for (size_t i = 0; i < arg_list.count; i++) {
+				args[instr->c + i] = vm_borrow(flamingo, regs, instr->c + i);
+			}
+
+			// The register after the callable is left empty if it wasn't accessed on anything.
+
+			flamingo_val_t* const callable = vm_take(flamingo, regs, instr->b);
+			flamingo_val_t* const accessed_val = vm_take_imm(regs, instr->b + 1).boxed;
+
+			val = NULL;
+
+			bool const defer = instr->op == VM_OP_TAIL_CALL && call_can_defer(flamingo, callable);
+			int call_res = 0;
+
+			if (defer) {
+				call_defer(flamingo, callable, &arg_list);
+			}
+
+			else {
+				call_res = call(flamingo, callable, accessed_val, instr->a == VM_NO_REG ? NULL : &val, &arg_list);
+			}
+
+			val_decref(callable);
+			val_decref(accessed_val);
+
+			for (size_t i = 0; i < arg_list.count; i++) {
+				imm_free(vm_take_imm(regs, instr->c + i));
+			}
+
+			if (call_res < 0) {
+				goto err;
+			}
+
+			// If the call was deferred, do the job of the return which follows, without a return value.
+
+			if (defer) {
+				vm_instr_t const* const ret = instr + 1;
+				assert(ret->op == VM_OP_RETURN);
+
+				flamingo->cur_fn_rv = CALL_DEFERRED_RV;
+
+				vm_pop_scopes(flamingo, ret->c);
+				instr = &code->instrs[ret->a] - 1;
+
+				break;
+			}
+
+			vm_set(regs, instr->a, val);
+			break;
+		}
+		case VM_OP_UNARY:
+			if (unary_expr_eval(flamingo, node, vm_take_imm(regs, instr->b), vm_dst(regs, instr->a)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_BINARY:
+			if (binary_expr_eval(flamingo, node, vm_take_imm(regs, instr->b), vm_take_imm(regs, instr->c), vm_dst(regs, instr->a)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_SHORT_CIRCUIT:
+			if (binary_expr_short_circuit(node, regs[instr->b], vm_dst(regs, instr->c))) {
+				regs[instr->b] = (imm_t) {0};
+				instr = &code->instrs[instr->a] - 1;
+			}
+
+			break;
+		case VM_OP_ACCESS: {
+			flamingo_var_t* var;
+
+			if (access_lookup(flamingo, vm_borrow(flamingo, regs, instr->b), ast_node(ast, node->access.accessor), &var) < 0) {
+				goto err;
+			}
+
+			if (instr->a != VM_NO_REG) {
+				vm_set(regs, instr->a, val_incref(var->val));
+			}
+
+			// Keep the accessed value around if it's needed for a call.
+
+			if (!instr->c) {
+				imm_free(vm_take_imm(regs, instr->b));
+			}
+
+			break;
+		}
+		case VM_OP_CHECK_INDEXED:
+			if (index_check_indexed(flamingo, vm_borrow(flamingo, regs, instr->b)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_INDEX: {
+			val = vm_take(flamingo, regs, instr->b);
+			flamingo_val_t* indexed_val = NULL;
+
+			if (index_eval(flamingo, val, vm_take(flamingo, regs, instr->c), instr->a == VM_NO_REG ? NULL : &indexed_val, NULL, false) < 0) {
+				goto err;
+			}
+
+			vm_set(regs, instr->a, indexed_val);
+			break;
+		}
+
+		// Statements.
+
+		case VM_OP_PRINT: {
+			char* to_print = NULL;
+			val = vm_take(flamingo, regs, instr->b);
+
+			res = repr(flamingo, val, &to_print);
+
+			if (res == 0) {
+				assert(to_print != NULL);
+				printf("%s\n", to_print);
+			}
+
+			free(to_print);
+			val_decref(val);
+
+			if (res < 0) {
+				goto err;
+			}
+
+			break;
+		}
+		case VM_OP_ASSERT:
+			if (assert_check(flamingo, node, vm_take(flamingo, regs, instr->b)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_VAR_DECL:
+			if (var_decl_add(flamingo, node, &decl_var) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_VAR_INIT:
+			var_decl_init(flamingo, decl_var, instr->b == VM_NO_REG ? NULL : vm_take(flamingo, regs, instr->b));
+			decl_var = NULL;
+
+			break;
+		case VM_OP_ASSIGN_VAR:
+			assignment = (assignment_t) {
+				.lhs = flamingo->src + node->start,
+				.lhs_size = node->end - node->start,
+			};
+
+			assignment.var = env_find_var_at(flamingo->env, node->identifier.depth, node->identifier.slot, symbol_of(flamingo, node), assignment.lhs_size);
+
+			if (assignment.var == NULL) {
+				res = error(flamingo, "'%.*s' was never declared", (int) assignment.lhs_size, assignment.lhs);
+				goto done;
+			}
+
+			assignment.val = assignment.var->val;
+
+			if (assignment_check_lhs(flamingo, &assignment) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_ASSIGN_ACCESS:
+			assignment = (assignment_t) {
+				.lhs = flamingo->src + node->start,
+				.lhs_size = node->end - node->start,
+			};
+
+			if (access_lookup(flamingo, vm_borrow(flamingo, regs, instr->b), ast_node(ast, node->access.accessor), &assignment.var) < 0) {
+				goto err;
+			}
+
+			assignment.val = assignment.var->val;
+
+			if (assignment_check_lhs(flamingo, &assignment) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_ASSIGN_INDEX:
+			assignment = (assignment_t) {
+				.lhs = flamingo->src + node->start,
+				.lhs_size = node->end - node->start,
+			};
+
+			val = vm_take(flamingo, regs, instr->b);
+
+			if (index_eval(flamingo, val, vm_take(flamingo, regs, instr->c), &assignment.val, &assignment.slot, true) < 0) {
+				goto err;
+			}
+
+			if (assignment_check_lhs(flamingo, &assignment) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_ASSIGN:
+			if (assignment_finish(flamingo, &assignment, vm_take_imm(regs, instr->b)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_ASSIGN_ADD:
+			val = vm_take(flamingo, regs, instr->b);
+
+			if (assignment_add(flamingo, &assignment, node, val, vm_take(flamingo, regs, instr->c)) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_FN_DECL:
+			if (parse_function_declaration(flamingo, node) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_IMPORT:
+			if (parse_import(flamingo, node) < 0) {
+				goto err;
+			}
+
+			break;
+		case VM_OP_CLEAR:
+			imm_free(vm_take_imm(regs, instr->b));
+			break;
+
+		// Scopes and control flow.
+
+		case VM_OP_PUSH_SCOPE:
+			env_push_scope(flamingo->env);
+			break;
+		case VM_OP_POP_SCOPE:
+			vm_pop_scopes(flamingo, instr->c);
+			break;
+		case VM_OP_DETACH_SCOPE:
+			*inner_scope = env_gently_detach_scope(flamingo->env);
+			break;
+		case VM_OP_JUMP:
+			vm_pop_scopes(flamingo, instr->c);
+			instr = &code->instrs[instr->a] - 1;
+
+			break;
+		case VM_OP_JUMP_IF_FALSE: {
+			imm_t const condition = vm_take_imm(regs, instr->b);
+
+			if (condition.kind != FLAMINGO_VAL_KIND_BOOL) {
+				res = error(flamingo, "expected boolean value for %s condition, got %s", instr->c ? "elif" : "if", imm_type_str(condition));
+				goto done;
+			}
+
+			if (!imm_boolean(condition)) {
+				instr = &code->instrs[instr->a] - 1;
+			}
+
+			imm_free(condition);
+			break;
+		}
+		case VM_OP_FOR_PREP: {
+			flamingo_val_t** elems;
+
+			if (for_loop_iterable(flamingo, vm_borrow(flamingo, regs, instr->b), &counters[instr->b + 1], &elems) < 0) {
+				goto err;
+			}
+
+			counters[instr->b] = 0;
+			break;
+		}
+		case VM_OP_FOR_NEXT: {
+			flamingo_val_t* const elem = for_loop_elem(flamingo, vm_borrow(flamingo, regs, instr->b), counters[instr->b + 1], counters[instr->b]);
+
+			if (elem == NULL) {
+				instr = &code->instrs[instr->a] - 1;
+				break;
+			}
+
+			// Create the scope and the current variable in it.
+
+			ast_node_t const* const cur_var_name_node = ast_node(ast, node->for_loop.cur_var_name);
+
+			flamingo_scope_t* const scope = env_push_scope(flamingo->env);
+			flamingo_var_t* const cur_var = scope_add_symbol_var(scope, symbol_of(flamingo, cur_var_name_node), cur_var_name_node->end - cur_var_name_node->start);
+
+			cur_var->val = val_incref(elem);
+			counters[instr->b]++;
+
+			break;
+		}
+		case VM_OP_RETURN_BEGIN:
+			res = return_begin(flamingo, node);
+
+			if (res < 0) {
+				goto done;
+			}
+
+			if (res == 0) {
+				vm_pop_scopes(flamingo, instr->c);
+				instr = &code->instrs[instr->a] - 1;
+			}
+
+			res = 0;
+			break;
+		case VM_OP_RETURN:
+			flamingo->cur_fn_rv = vm_take(flamingo, regs, instr->b);
+
+			vm_pop_scopes(flamingo, instr->c);
+			instr = &code->instrs[instr->a] - 1;
+
+			break;
+		case VM_OP_LOOSE_BREAK:
+			res = error(flamingo, "trying to break outside of a loop");
+			goto done;
+		case VM_OP_LOOSE_CONTINUE:
+			res = error(flamingo, "trying to continue outside of a loop");
+			goto done;
+		}
+	}
+
+err:
+
+	res = -1;
+
+done:
+
+	// An expression code unit leaves its value in its first register.
+
+	if (res == 0 && kind == VM_UNIT_EXPR && rv != NULL) {
+		assert(*rv == NULL);
+		*rv = vm_take(flamingo, regs, 0);
+	}
+
+	for (size_t i = 0; i < reg_count; i++) {
+		imm_free(regs[i]);
+	}
+
+	stack_pop(flamingo, regs);
+
+	return res;
+}
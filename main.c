@@ -199,11 +199,32 @@ int main(int argc, char* argv[]) {
 		goto err_fread;
 	}
 
+	// parse the program, going through the precompiled module cache if asked to
+	// FLAMINGO_CACHE is the directory to put caches in, or empty to put them next to their sources
+
+	char const* const cache_env = getenv("FLAMINGO_CACHE");
+	char const* const cache_dir = cache_env == NULL || *cache_env == '\0' ? NULL : cache_env;
+	char* cache_path = NULL;
+
+	if (cache_env != NULL) {
+		cache_path = flamingo_cache_path(path, cache_dir);
+	}
+
+	flamingo_program_t* const program = flamingo_program_create_cached(src, src_size, cache_path);
+	free(cache_path);
+
+	if (program == NULL) {
+		fprintf(stderr, "flamingo: failed to parse source\n");
+		goto err_flamingo_program_create;
+	}
+
 	// create flamingo engine
 
 	flamingo_t flamingo;
+	int const create_rv = flamingo_create_from_program(&flamingo, basename(path), program);
+	flamingo_program_decref(program);
 
-	if (flamingo_create(&flamingo, basename(path), src, src_size) < 0) {
+	if (create_rv < 0) {
 		fprintf(stderr, "flamingo: %s\n", flamingo_err(&flamingo));
 		goto err_flamingo_create;
 	}
@@ -211,9 +232,18 @@ int main(int argc, char* argv[]) {
 	flamingo_register_external_fn_cb(&flamingo, external_fn_cb, NULL);
 	flamingo_register_class_decl_cb(&flamingo, class_decl_cb, NULL);
 	flamingo_register_class_inst_cb(&flamingo, class_inst_cb, NULL);
+	flamingo_set_cache(&flamingo, cache_env != NULL, cache_dir);
 
 	flamingo_add_import_path(&flamingo, "tests/import_path");
 
+	// select execution engine
+
+	char const* const engine = getenv("FLAMINGO_ENGINE");
+
+	if (engine != NULL && strcmp(engine, "vm") == 0) {
+		flamingo_set_engine(&flamingo, FLAMINGO_ENGINE_VM);
+	}
+
 	// run program
 
 	if (flamingo_run(&flamingo) < 0) {
@@ -223,7 +253,7 @@ int main(int argc, char* argv[]) {
 
 	// print out all top-level scope variables
 
-	flamingo_scope_t* const scope = flamingo.env->scope_stack[0];
+	flamingo_scope_t* const scope = flamingo.env->scope;
 
 	for (size_t i = 0; i < scope->vars_size; i++) {
 		flamingo_var_t* const var = &scope->vars[i];
@@ -231,6 +261,26 @@ int main(int argc, char* argv[]) {
 		printf("var: %.*s\n", (int) var->key_size, var->key);
 	}
 
+	// print out allocation statistics if asked to
+
+	if (getenv("FLAMINGO_ALLOC_STATS") != NULL) {
+		flamingo_alloc_stats_t stats;
+		flamingo_alloc_stats(&flamingo, &stats);
+
+		fprintf(stderr, "allocs: %zu, mallocs: %zu\n", stats.allocs, stats.mallocs);
+	}
+
+	// print out per-module load statistics if asked to
+
+	if (getenv("FLAMINGO_MODULE_STATS") != NULL) {
+		for (size_t i = 0; i < flamingo_module_count(&flamingo); i++) {
+			flamingo_module_stats_t stats;
+			flamingo_module_stats(&flamingo, i, &stats);
+
+			fprintf(stderr, "module: %s, imports: %zu, %s: %.3f ms, run: %.3f ms\n", stats.path, stats.imports, stats.cached ? "cache load" : "parse", stats.load_ns / 1e6, stats.run_ns / 1e6);
+		}
+	}
+
 	// finished everything successfully!
 
 	rv = EXIT_SUCCESS;
@@ -240,6 +290,7 @@ err_flamingo_run:
 	flamingo_destroy(&flamingo);
 
 err_flamingo_create:
+err_flamingo_program_create:
 err_fread:
 
 	free(src);
@@ -0,0 +1,51 @@
+#!/bin/sh
+set -e
+
+# Compare the tree-walker and the bytecode VM on the examples.
+# The donuts never finish, so they're run for a fixed amount of time and we count how much they managed to output instead.
+
+if [ $# -gt 1 ]; then
+	echo "Usage: scripts/bench-engines.sh [donut seconds]"
+	exit 1
+fi
+
+SECS=${1:-10}
+
+if [ -z "$CC" ]; then
+	CC=cc
+fi
+
+# Build an optimized binary, as the one from build.sh is built with sanitizers.
+
+mkdir -p bin/bench
+
+cc_flags="-O2 -std=c11 -Iflamingo/runtime"
+
+$CC $cc_flags -c flamingo/flamingo.c -o bin/bench/flamingo.o
+$CC $cc_flags -c main.c -o bin/bench/main.o
+$CC bin/bench/flamingo.o bin/bench/main.o -lm -o bin/bench/flamingo
+
+for engine in tree-walker vm; do
+	echo "== $engine =="
+
+	for donut in examples/donut_*.fl; do
+		bytes=$(FLAMINGO_ENGINE=$engine timeout $SECS bin/bench/flamingo $donut | wc -c || true)
+		echo "$donut: $bytes bytes in ${SECS}s"
+	done
+
+	for aoc in examples/aoc/*/*/main.fl; do
+		start=$(date +%s%N)
+		(cd $(dirname $aoc) && FLAMINGO_ENGINE=$engine ../../../../bin/bench/flamingo main.fl > /dev/null)
+		end=$(date +%s%N)
+
+		echo "$aoc: $(((end - start) / 1000000))ms"
+	done
+
+	for bench in examples/bench/*.fl; do
+		start=$(date +%s%N)
+		FLAMINGO_ENGINE=$engine bin/bench/flamingo $bench > /dev/null
+		end=$(date +%s%N)
+
+		echo "$bench: $(((end - start) / 1000000))ms"
+	done
+done
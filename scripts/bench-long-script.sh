@@ -0,0 +1,67 @@
+#!/bin/sh
+set -e
+
+# Check that loading a script scales linearly with its length.
+# This generates scripts of 12.5k, 25k, and 50k lines, each with a long function body, a long run of top-level statements, and big map and vector literals, and times running each of them.
+# The time per line should stay about the same from one to the next.
+
+if [ $# -gt 0 ]; then
+	echo "Usage: scripts/bench-long-script.sh"
+	exit 1
+fi
+
+if [ -z "$CC" ]; then
+	CC=cc
+fi
+
+# Build an optimized binary, as the one from build.sh is built with sanitizers.
+
+mkdir -p bin/bench
+
+cc_flags="-O2 -std=c11 -Iflamingo/runtime"
+
+$CC $cc_flags -c flamingo/flamingo.c -o bin/bench/flamingo.o
+$CC $cc_flags -c main.c -o bin/bench/main.o
+$CC bin/bench/flamingo.o bin/bench/main.o -lm -o bin/bench/flamingo
+
+for lines in 12500 25000 50000; do
+	script=bin/bench/long_$lines.fl
+
+	awk -v n=$lines 'BEGIN {
+		print "fn body() {"
+
+		for (i = 0; i < n / 2; i++) {
+			print "\tlet a" i " = " i
+		}
+
+		print "}"
+		print "body()"
+
+		for (i = 0; i < n / 2; i++) {
+			print "let b" i " = " i
+		}
+
+		printf "let m = {"
+
+		for (i = 0; i < n / 10; i++) {
+			printf "%s\"k%d\": %d", i ? ", " : "", i, i
+		}
+
+		print "}"
+		printf "let v = ["
+
+		for (i = 0; i < n / 10; i++) {
+			printf "%s%d", i ? ", " : "", i
+		}
+
+		print "]"
+	}' > $script
+
+	for engine in tree-walker vm; do
+		start=$(date +%s%N)
+		FLAMINGO_ENGINE=$engine bin/bench/flamingo $script > /dev/null
+		end=$(date +%s%N)
+
+		echo "$script ($engine): $(((end - start) / 1000000))ms, $(((end - start) / lines))ns per line"
+	done
+done
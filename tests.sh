@@ -3,22 +3,88 @@
 export ASAN_OPTIONS=detect_leaks=0 # XXX For now, let's not worry about leaks.
 all_passed=1
 
-for test in $(ls -p tests | grep -v /); do
-	if [ $test = "import_helper.fl" ]; then
-		continue
-	fi
-
-	printf "Running test $test... "
-	bin/flamingo tests/$test > /dev/null
-
-	if [ $? = 0 ]; then
-		echo "PASSED"
-	else
-		echo "FAILED"
-		all_passed=0
-	fi
+# Run all tests with the given environment, labelled with the first argument.
+# They're run with the binary in '$flamingo', which is the one 'build.sh' builds by default.
+
+flamingo=bin/flamingo
+
+run_tests() {
+	label=$1
+	shift
+
+	for test in $(ls -p tests | grep -v /); do
+		if [ $test = "import_helper.fl" ]; then
+			continue
+		fi
+
+		printf "Running test $test ($label)... "
+		env "$@" $flamingo tests/$test > /dev/null
+
+		if [ $? = 0 ]; then
+			echo "PASSED"
+		else
+			echo "FAILED"
+			all_passed=0
+		fi
+	done
+
+	# Tests in 'tests/errors' must fail with an error starting with what's on their first line, and nothing else (e.g. a crash or a sanitizer report).
+
+	for test in $(ls tests/errors); do
+		printf "Running error test $test ($label)... "
+		expected=$(sed -n '1s/^# error: //p' tests/errors/$test)
+		output=$(env "$@" $flamingo tests/errors/$test 2>&1 > /dev/null)
+
+		if [ $? != 0 ] && [ $(echo "$output" | wc -l) = 1 ] && echo "$output" | grep -qF "flamingo: $test:0:0: $expected"; then
+			echo "PASSED"
+		else
+			echo "FAILED"
+			all_passed=0
+		fi
+	done
+}
+
+# Run all tests with both the tree-walker and the bytecode VM.
+
+for engine in tree-walker vm; do
+	run_tests $engine FLAMINGO_ENGINE=$engine
+done
+
+# Run them again through the precompiled module cache, once to write it and once to load from it.
+
+cache_dir=$(mktemp -d)
+
+for pass in cold warm; do
+	run_tests "cache, $pass" FLAMINGO_CACHE=$cache_dir
+done
+
+# Corrupt the caches in the middle of their contents, after which they must be ignored rather than loaded.
+
+for cache in $cache_dir/*.flc; do
+	size=$(wc -c < $cache)
+	printf '\125\252\125\252\125\252\125\252' | dd of=$cache bs=1 seek=$((size / 2)) conv=notrunc 2> /dev/null
 done
 
+run_tests "cache, corrupted" FLAMINGO_CACHE=$cache_dir
+
+rm -rf $cache_dir
+
+# Run them once more with the binary which allocates from pools even with AddressSanitizer (see 'build.sh').
+
+flamingo=bin/flamingo-pool
+run_tests pool
+
+# Run instances of one program concurrently with both engines, which mustn't modify anything they share.
+
+printf "Running test programs... "
+
+if bin/programs; then
+	echo "PASSED"
+else
+	echo "FAILED"
+	all_passed=0
+fi
+
 if [ $all_passed = 0 ]; then
 	echo "TESTS FAILED!"
 	exit 1
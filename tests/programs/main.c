@@ -0,0 +1,139 @@
+// This Source Form is subject to the terms of the AQUA Software License, v. 1.0.
+// Copyright (c) 2024 Aymeric Wibo
+
+// Run many instances of one program at the same time, on several threads and with both engines (see 'flamingo_program_create').
+// The program is only parsed once, and everything the instances share (its AST, and the bytecode the VM compiles from it as it goes) must not be modified by any of them.
+
+#include "../../flamingo/flamingo.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREAD_COUNT 8
+#define RUNS_PER_THREAD 16
+
+// Something which goes through as much of the runtime as possible: calls, closures, loops, classes, and string, vector, and map constants.
+
+static char const src[] =
+	"fn fib(n: int) -> int {\n"
+	"	if n < 2 {\n"
+	"		return n\n"
+	"	}\n"
+	"\n"
+	"	return fib(n - 1) + fib(n - 2)\n"
+	"}\n"
+	"\n"
+	"class Counter(start: int) {\n"
+	"	let count = start\n"
+	"\n"
+	"	fn add(n: int) {\n"
+	"		count = count + n\n"
+	"	}\n"
+	"}\n"
+	"\n"
+	"let counter = Counter(0)\n"
+	"let names = {\"zero\": 0, \"one\": 1, \"two\": 2}\n"
+	"let squares = [0, 1, 2, 3, 4, 5].map(|x| x * x)\n"
+	"\n"
+	"for x in squares {\n"
+	"	counter.add(x + fib(x % 12))\n"
+	"}\n"
+	"\n"
+	"for name in names {\n"
+	"	counter.add(names[name])\n"
+	"}\n"
+	"\n"
+	"let result = counter.count\n";
+
+// 0 + 1 + 4 + 9 + 16 + 25, plus fib(0), fib(1), fib(4), fib(9), fib(4), fib(1), plus 0 + 1 + 2.
+
+#define EXPECTED_RESULT (55 + (0 + 1 + 3 + 34 + 3 + 1) + 3)
+
+typedef struct {
+	flamingo_program_t* program;
+	size_t index;
+	int rv;
+} thread_t;
+
+static int run(flamingo_program_t* program, flamingo_engine_t engine) {
+	flamingo_t flamingo;
+
+	if (flamingo_create_from_program(&flamingo, "programs", program) < 0) {
+		fprintf(stderr, "flamingo: %s\n", flamingo_err(&flamingo));
+		return -1;
+	}
+
+	flamingo_set_engine(&flamingo, engine);
+	int rv = -1;
+
+	if (flamingo_run(&flamingo) < 0) {
+		fprintf(stderr, "flamingo: %s\n", flamingo_err(&flamingo));
+		goto done;
+	}
+
+	flamingo_var_t* const result = flamingo_find_var(&flamingo, "result", strlen("result"));
+
+	if (result == NULL || result->val->kind != FLAMINGO_VAL_KIND_INT || result->val->integer.integer != EXPECTED_RESULT) {
+		fprintf(stderr, "programs: wrong result\n");
+		goto done;
+	}
+
+	rv = 0;
+
+done:
+
+	flamingo_destroy(&flamingo);
+	return rv;
+}
+
+// Threads alternate between engines from one run to the next, so that both of them run at the same time.
+
+static void* thread(void* arg) {
+	thread_t* const t = arg;
+
+	for (size_t i = 0; i < RUNS_PER_THREAD && t->rv == 0; i++) {
+		flamingo_engine_t const engine = (t->index + i) % 2 ? FLAMINGO_ENGINE_VM : FLAMINGO_ENGINE_TREE_WALKER;
+		t->rv = run(t->program, engine);
+	}
+
+	return NULL;
+}
+
+int main(void) {
+	flamingo_program_t* const program = flamingo_program_create(src, sizeof src - 1);
+
+	if (program == NULL) {
+		fprintf(stderr, "programs: failed to parse source\n");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t threads[THREAD_COUNT];
+	thread_t args[THREAD_COUNT];
+
+	for (size_t i = 0; i < THREAD_COUNT; i++) {
+		args[i] = (thread_t) {
+			.program = program,
+			.index = i,
+		};
+
+		if (pthread_create(&threads[i], NULL, thread, &args[i]) != 0) {
+			fprintf(stderr, "programs: failed to create thread\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	int rv = EXIT_SUCCESS;
+
+	for (size_t i = 0; i < THREAD_COUNT; i++) {
+		pthread_join(threads[i], NULL);
+
+		if (args[i].rv < 0) {
+			rv = EXIT_FAILURE;
+		}
+	}
+
+	flamingo_program_decref(program);
+	return rv;
+}